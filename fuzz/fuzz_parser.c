@@ -24,6 +24,22 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     char *error = NULL;
     Node *node = parse_string(text, &incomplete, &error);
 
+    if (node) {
+        StrBuf encoded;
+        StrBuf again;
+        sb_init(&encoded);
+        sb_init(&again);
+        node_encode(node, &encoded);
+        Node *decoded = node_decode(encoded.data, encoded.len);
+        if (!decoded) abort();
+        node_encode(decoded, &again);
+        if (again.len != encoded.len || memcmp(again.data, encoded.data, encoded.len) != 0) abort();
+        node_free(decoded);
+        sb_free(&again);
+        sb_free(&encoded);
+    }
+    node_free(node_decode((const char *)data, size));
+
     node_free(node);
     free(error);
     free(text);
@@ -141,6 +141,71 @@ pub extern "C" fn fresh_count_block(data: *const u8, len: usize, counts: *mut Co
     out.in_word = in_word as u32;
 }
 
+const TRANSLATE_DELETE: u32 = 1;
+const TRANSLATE_SQUEEZE: u32 = 2;
+
+#[repr(C)]
+pub struct Translation {
+    pub map: [u8; 256],
+    pub dropped: [u8; 32],
+    pub squeezed: [u8; 32],
+    pub mode: u32,
+    pub last: u32,
+}
+
+#[inline]
+fn in_set(set: &[u8; 32], byte: u8) -> bool {
+    (set[(byte >> 3) as usize] >> (byte & 7)) & 1 != 0
+}
+
+#[no_mangle]
+pub extern "C" fn fresh_translate_block(
+    data: *const u8,
+    len: usize,
+    out: *mut u8,
+    translation: *mut Translation,
+) -> usize {
+    if data.is_null() || out.is_null() || translation.is_null() {
+        return 0;
+    }
+
+    let input = unsafe { slice::from_raw_parts(data, len) };
+    let output = unsafe { slice::from_raw_parts_mut(out, len) };
+    let table = unsafe { &mut *translation };
+
+    if table.mode == 0 {
+        for (target, &byte) in output.iter_mut().zip(input) {
+            *target = table.map[byte as usize];
+        }
+        return len;
+    }
+
+    let dropping = table.mode & TRANSLATE_DELETE != 0;
+    let squeezing = table.mode & TRANSLATE_SQUEEZE != 0;
+    let mut last = table.last;
+    let mut written = 0usize;
+
+    for &byte in input {
+        if dropping && in_set(&table.dropped, byte) {
+            continue;
+        }
+        let mapped = table.map[byte as usize];
+        if squeezing && in_set(&table.squeezed, mapped) {
+            if last == mapped as u32 + 1 {
+                continue;
+            }
+            last = mapped as u32 + 1;
+        } else {
+            last = 0;
+        }
+        output[written] = mapped;
+        written += 1;
+    }
+
+    table.last = last;
+    written
+}
+
 const MAX_ENTRIES: usize = 512;
 
 #[inline]
@@ -18,6 +18,7 @@
 #include "regex.h"
 #include "shell.h"
 #include "util.h"
+#include "vars.h"
 
 #define AWK_STREAMS 16
 
@@ -173,7 +174,7 @@ static void awk_fail(Awk *awk, const char *fmt, ...) {
     vsnprintf(message, sizeof(message), fmt, args);
     va_end(args);
 
-    fflush(stdout);
+    out_flush();
     shell_error("%s", message);
     awk->exiting = 1;
     awk->status = 2;
@@ -1260,7 +1261,11 @@ static FILE *writer_for(Awk *awk, const char *target, const char *mode) {
 
     for (int i = 0; i < AWK_STREAMS; i++) {
         if (writer_names[i]) continue;
-        fflush(stdout);
+        out_flush();
+        if (pipe) {
+            capture_use_pipe();
+            vars_sync_environment();
+        }
         FILE *f = pipe ? _popen(target, "w") : fopen(target, strcmp(mode, ">>") == 0 ? "a" : "w");
         if (!f) {
             awk_fail(awk, "awk: cannot write to %s", target);
@@ -1650,7 +1655,7 @@ static const char *call_builtin(Awk *awk, Expr *e) {
 
     if (strcmp(name, "system") == 0) {
         char *command = xstrdup(first ? evaluate(awk, first) : "");
-        fflush(stdout);
+        out_flush();
         fflush(stderr);
         int status = exec_subshell(command);
         free(command);
@@ -1665,7 +1670,7 @@ static const char *call_builtin(Awk *awk, Expr *e) {
     }
 
     if (strcmp(name, "fflush") == 0) {
-        fflush(stdout);
+        out_flush();
         return "0";
     }
 
@@ -1827,6 +1832,22 @@ static const char *evaluate(Awk *awk, Expr *e) {
     return "";
 }
 
+static void stream_write(FILE *out, const char *text, size_t length) {
+    if (out == stdout) {
+        out_write(text, length);
+    } else if (out == stderr) {
+        out_flush();
+        fwrite(text, 1, length, out);
+        fflush(stderr);
+    } else {
+        fwrite(text, 1, length, out);
+    }
+}
+
+static void stream_puts(FILE *out, const char *text) {
+    stream_write(out, text, strlen(text));
+}
+
 static FILE *output_for(Awk *awk, Stmt *s) {
     if (!s->name || !s->second) return stdout;
     char *target = xstrdup(evaluate(awk, s->second));
@@ -1845,15 +1866,15 @@ static void run_print(Awk *awk, Stmt *s) {
 
     awk->printing = 1;
     if (s->count == 0) {
-        fputs(field_value(awk, 0), out);
+        stream_puts(out, field_value(awk, 0));
     } else {
         for (int i = 0; i < s->count; i++) {
-            if (i > 0) fputs(separator, out);
-            fputs(evaluate(awk, s->list[i]), out);
+            if (i > 0) stream_puts(out, separator);
+            stream_puts(out, evaluate(awk, s->list[i]));
         }
     }
     awk->printing = 0;
-    fputs(*terminator ? terminator : "\n", out);
+    stream_puts(out, *terminator ? terminator : "\n");
 }
 
 static void run_printf(Awk *awk, Stmt *s) {
@@ -1863,7 +1884,7 @@ static void run_printf(Awk *awk, Stmt *s) {
     StrBuf sb;
     sb_init(&sb);
     format_into(awk, &sb, s->list, s->count);
-    if (sb.len) fwrite(sb.data, 1, sb.len, out);
+    if (sb.len) stream_write(out, sb.data, sb.len);
     sb_free(&sb);
 }
 
@@ -2048,8 +2069,8 @@ static void run_rules(Awk *awk, int begin, int end) {
 
         if (!rule->action) {
             const char *terminator = variable_get(awk, "ORS");
-            fputs(field_value(awk, 0), stdout);
-            fputs(*terminator ? terminator : "\n", stdout);
+            out_puts(field_value(awk, 0));
+            out_puts(*terminator ? terminator : "\n");
             continue;
         }
         execute(awk, rule->action);
@@ -2297,7 +2318,7 @@ int awk_main(int argc, char **argv) {
     if (parsed) run_rules(&awk, 0, 1);
     arena_reset(&awk);
 
-    fflush(stdout);
+    out_flush();
     streams_close();
 
     for (int i = 0; i < awk.field_count; i++) free(awk.fields[i]);
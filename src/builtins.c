@@ -58,7 +58,7 @@ static int builtin_cd(int argc, char **argv) {
         char shown[PATH_BUF];
         snprintf(shown, sizeof(shown), "%s", target);
         path_to_slashes(shown);
-        printf("%s\n", shown);
+        out_printf("%s\n", shown);
     } else {
         target = argv[1];
     }
@@ -82,7 +82,7 @@ static int builtin_pwd(int argc, char **argv) {
     char cwd[PATH_BUF];
     if (!GetCurrentDirectoryA(sizeof(cwd), cwd)) return 1;
     path_to_slashes(cwd);
-    printf("%s\n", cwd);
+    out_printf("%s\n", cwd);
     return 0;
 }
 
@@ -94,20 +94,20 @@ static int builtin_exit(int argc, char **argv) {
 static void echo_escaped(const char *text) {
     for (const char *p = text; *p; p++) {
         if (*p != '\\' || !p[1]) {
-            putchar(*p);
+            out_putc(*p);
             continue;
         }
         p++;
         switch (*p) {
-        case 'n': putchar('\n'); break;
-        case 't': putchar('\t'); break;
-        case 'r': putchar('\r'); break;
-        case '0': putchar('\0'); break;
-        case 'e': putchar('\x1b'); break;
-        case '\\': putchar('\\'); break;
+        case 'n': out_putc('\n'); break;
+        case 't': out_putc('\t'); break;
+        case 'r': out_putc('\r'); break;
+        case '0': out_putc('\0'); break;
+        case 'e': out_putc('\x1b'); break;
+        case '\\': out_putc('\\'); break;
         default:
-            putchar('\\');
-            putchar(*p);
+            out_putc('\\');
+            out_putc(*p);
             break;
         }
     }
@@ -129,11 +129,11 @@ static int builtin_echo(int argc, char **argv) {
     }
 
     for (int i = index; i < argc; i++) {
-        if (i > index) putchar(' ');
+        if (i > index) out_putc(' ');
         if (escapes) echo_escaped(argv[i]);
-        else fputs(argv[i], stdout);
+        else out_puts(argv[i]);
     }
-    if (newline) putchar('\n');
+    if (newline) out_putc('\n');
     return 0;
 }
 
@@ -144,7 +144,7 @@ static int builtin_export(int argc, char **argv) {
         vars_exported_names(&names);
         sl_sort(&names);
         for (size_t i = 0; i < names.len; i++)
-            printf("export %s=\"%s\"\n", names.items[i], var_get(names.items[i]));
+            out_printf("export %s=\"%s\"\n", names.items[i], var_get(names.items[i]));
         sl_free(&names);
         return 0;
     }
@@ -152,7 +152,7 @@ static int builtin_export(int argc, char **argv) {
         StrList list;
         sl_init(&list);
         vars_list(&list);
-        for (size_t i = 0; i < list.len; i++) printf("export %s\n", list.items[i]);
+        for (size_t i = 0; i < list.len; i++) out_printf("export %s\n", list.items[i]);
         sl_free(&list);
         return 0;
     }
@@ -165,7 +165,6 @@ static int builtin_export(int argc, char **argv) {
         } else {
             var_export(argv[i]);
         }
-        if (strcmp(argv[i], "PATH") == 0 || strncmp(argv[i], "PATH=", 5) == 0) path_rehash();
     }
     return 0;
 }
@@ -204,7 +203,7 @@ static int builtin_set(int argc, char **argv) {
         StrList list;
         sl_init(&list);
         vars_list(&list);
-        for (size_t i = 0; i < list.len; i++) printf("%s\n", list.items[i]);
+        for (size_t i = 0; i < list.len; i++) out_printf("%s\n", list.items[i]);
         sl_free(&list);
         return 0;
     }
@@ -218,10 +217,10 @@ static int builtin_set(int argc, char **argv) {
             break;
         }
         if (argv[i][1] == 'o' && i + 1 >= argc) {
-            printf("%-12s%s\n", "errexit", shell.errexit ? "on" : "off");
-            printf("%-12s%s\n", "nounset", shell.nounset ? "on" : "off");
-            printf("%-12s%s\n", "xtrace", shell.xtrace ? "on" : "off");
-            printf("%-12s%s\n", "pipefail", shell.pipefail ? "on" : "off");
+            out_printf("%-12s%s\n", "errexit", shell.errexit ? "on" : "off");
+            out_printf("%-12s%s\n", "nounset", shell.nounset ? "on" : "off");
+            out_printf("%-12s%s\n", "xtrace", shell.xtrace ? "on" : "off");
+            out_printf("%-12s%s\n", "pipefail", shell.pipefail ? "on" : "off");
             continue;
         }
         if (argv[i][1] == 'o') {
@@ -342,7 +341,7 @@ static int builtin_declare(int argc, char **argv) {
         StrList list;
         sl_init(&list);
         vars_list(&list);
-        for (size_t i = 0; i < list.len; i++) printf("%s%s\n", printing ? "declare -- " : "", list.items[i]);
+        for (size_t i = 0; i < list.len; i++) out_printf("%s%s\n", printing ? "declare -- " : "", list.items[i]);
         sl_free(&list);
         return 0;
     }
@@ -358,7 +357,7 @@ static int builtin_declare(int argc, char **argv) {
             const char *flags = var_kind(argv[index]) == VAR_ASSOC   ? "-A"
                                 : var_kind(argv[index]) == VAR_INDEXED ? "-a"
                                                                        : "--";
-            printf("declare %s %s=\"%s\"\n", flags, argv[index], var_get(argv[index]));
+            out_printf("declare %s %s=\"%s\"\n", flags, argv[index], var_get(argv[index]));
         }
         return status;
     }
@@ -401,7 +400,7 @@ static int builtin_trap(int argc, char **argv) {
 
     if (argc < 2 || strcmp(argv[1], "-p") == 0) {
         for (int i = 0; i < count; i++)
-            if (*slots[i].slot) printf("trap -- '%s' %s\n", *slots[i].slot, slots[i].name);
+            if (*slots[i].slot) out_printf("trap -- '%s' %s\n", *slots[i].slot, slots[i].name);
         return 0;
     }
 
@@ -456,7 +455,7 @@ static int builtin_jobs(int argc, char **argv) {
     jobs_list(&lines);
 
     for (size_t i = 0; i < lines.len; i++)
-        printf("  %s%s%s\n", style(S_DIM), lines.items[i], style(S_RESET));
+        out_printf("  %s%s%s\n", style(S_DIM), lines.items[i], style(S_RESET));
     sl_free(&lines);
     return 0;
 }
@@ -470,7 +469,7 @@ static int builtin_wait(int argc, char **argv) {
 }
 
 static int builtin_die(int argc, char **argv) {
-    fflush(stdout);
+    out_flush();
     fprintf(stderr, "%s", style(S_ERROR));
     for (int i = 1; i < argc; i++) fprintf(stderr, "%s%s", i > 1 ? " " : "", argv[i]);
     if (argc < 2) fprintf(stderr, "aborted");
@@ -494,9 +493,9 @@ static int builtin_have(int argc, char **argv) {
 }
 
 static int print_styled(int argc, char **argv, const char *marker, const char *colour) {
-    printf("%s%s%s ", style(colour), marker, style(S_RESET));
-    for (int i = 1; i < argc; i++) printf("%s%s", i > 1 ? " " : "", argv[i]);
-    printf("\n");
+    out_printf("%s%s%s ", style(colour), marker, style(S_RESET));
+    for (int i = 1; i < argc; i++) out_printf("%s%s", i > 1 ? " " : "", argv[i]);
+    out_printf("\n");
     return 0;
 }
 
@@ -517,7 +516,7 @@ static int builtin_alias(int argc, char **argv) {
         StrList list;
         sl_init(&list);
         alias_list(&list);
-        for (size_t i = 0; i < list.len; i++) printf("alias %s\n", list.items[i]);
+        for (size_t i = 0; i < list.len; i++) out_printf("alias %s\n", list.items[i]);
         sl_free(&list);
         return 0;
     }
@@ -525,7 +524,7 @@ static int builtin_alias(int argc, char **argv) {
         char *eq = strchr(argv[i], '=');
         if (!eq) {
             const char *value = alias_get(argv[i]);
-            if (value) printf("alias %s='%s'\n", argv[i], value);
+            if (value) out_printf("alias %s='%s'\n", argv[i], value);
             else {
                 shell_error("alias: %s: not found", argv[i]);
                 return 1;
@@ -575,36 +574,40 @@ static int builtin_history(int argc, char **argv) {
         history_clear();
         return 0;
     }
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        history_read();
+        return 0;
+    }
     int count = history_count();
     int limit = argc > 1 ? atoi(argv[1]) : count;
     if (limit <= 0 || limit > count) limit = count;
     for (int i = count - limit; i < count; i++)
-        printf("  %s%4d%s  %s\n", style(S_DIM), i + 1, style(S_RESET), history_get(i));
+        out_printf("  %s%4d%s  %s\n", style(S_DIM), i + 1, style(S_RESET), history_get(i));
     return 0;
 }
 
 static int describe_command(const char *name, int verbose) {
     if (alias_get(name)) {
-        if (verbose) printf("%s is an alias for %s\n", name, alias_get(name));
-        else printf("%s: aliased to %s\n", name, alias_get(name));
+        if (verbose) out_printf("%s is an alias for %s\n", name, alias_get(name));
+        else out_printf("%s: aliased to %s\n", name, alias_get(name));
         return 0;
     }
     if (function_defined(name)) {
-        printf("%s is a shell function\n", name);
+        out_printf("%s is a shell function\n", name);
         return 0;
     }
     if (builtin_lookup(name)) {
-        printf("%s is a shell builtin\n", name);
+        out_printf("%s is a shell builtin\n", name);
         return 0;
     }
     char path[PATH_BUF];
     if (resolve_command(name, path, sizeof(path))) {
         path_to_slashes(path);
-        printf("%s\n", path);
+        out_printf("%s\n", path);
         return 0;
     }
     if (coreutil_lookup(name)) {
-        printf("%s is a command bundled with FreSH\n", name);
+        out_printf("%s is a command bundled with FreSH\n", name);
         return 0;
     }
     shell_error("%s: not found", name);
@@ -643,7 +646,7 @@ static int builtin_type(int argc, char **argv) {
             continue;
         }
         const char *kind = command_kind(argv[i]);
-        if (kind) printf("%s\n", kind);
+        if (kind) out_printf("%s\n", kind);
         else status = 1;
     }
     return status;
@@ -670,9 +673,9 @@ static int builtin_command(int argc, char **argv) {
                 char path[PATH_BUF];
                 resolve_command(argv[i], path, sizeof(path));
                 path_to_slashes(path);
-                printf("%s\n", path);
+                out_printf("%s\n", path);
             } else {
-                printf("%s\n", argv[i]);
+                out_printf("%s\n", argv[i]);
             }
         }
         return status;
@@ -726,7 +729,7 @@ static int builtin_readonly(int argc, char **argv) {
         sl_init(&names);
         vars_readonly_names(&names);
         for (size_t i = 0; i < names.len; i++)
-            printf("readonly %s=\"%s\"\n", names.items[i], var_get(names.items[i]));
+            out_printf("readonly %s=\"%s\"\n", names.items[i], var_get(names.items[i]));
         sl_free(&names);
         return 0;
     }
@@ -828,7 +831,7 @@ static void print_long_entry(const WIN32_FIND_DATAA *data) {
     char decorated[MAX_PATH + 2];
     snprintf(decorated, sizeof(decorated), "%s%c", data->cFileName, marker);
 
-    printf("%s%c%c%c%s  %s%8s%s  %s%2d %s %02d:%02d%s  %s%s%s\n", style(S_DIM), is_dir ? 'd' : '-',
+    out_printf("%s%c%c%c%s  %s%8s%s  %s%2d %s %02d:%02d%s  %s%s%s\n", style(S_DIM), is_dir ? 'd' : '-',
            (data->dwFileAttributes & FILE_ATTRIBUTE_READONLY) ? '-' : 'w',
            is_executable_name(data->cFileName) || is_dir ? 'x' : '-', style(S_RESET),
            style(S_VALUE), size_text, style(S_RESET), style(S_DIM), st.wDay,
@@ -911,22 +914,27 @@ static int builtin_ls(int argc, char **argv) {
         int columns = one_per_line ? 1 : (column_width > 0 ? width / column_width : 1);
         if (columns < 1) columns = 1;
 
+        StrBuf row;
+        sb_init(&row);
         for (size_t i = 0; i < names.len; i++) {
             const char *entry = names.items[i];
-            fputs(entry, stdout);
+            sb_puts(&row, entry);
             if ((i + 1) % (size_t)columns == 0 || i + 1 == names.len) {
-                putchar('\n');
+                sb_putc(&row, '\n');
+                out_write(row.data, row.len);
+                sb_clear(&row);
             } else {
-                for (int pad = display_width(entry); pad < column_width; pad++) putchar(' ');
+                for (int pad = display_width(entry); pad < column_width; pad++) sb_putc(&row, ' ');
             }
         }
+        sb_free(&row);
     }
     sl_free(&names);
 
     if (directories + files > 0) {
         char size_text[32];
         human_size(total, size_text, sizeof(size_text));
-        printf("%s%s %d director%s, %d file%s, %s%s\n", style(S_DIM), S_LAMBDA, directories,
+        out_printf("%s%s %d director%s, %d file%s, %s%s\n", style(S_DIM), S_LAMBDA, directories,
                directories == 1 ? "y" : "ies", files, files == 1 ? "" : "s", size_text,
                style(S_RESET));
     }
@@ -1036,13 +1044,13 @@ static int builtin_read(int argc, char **argv) {
         }
     }
     if (prompt) {
-        fputs(prompt, stdout);
-        fflush(stdout);
+        out_puts(prompt);
+        out_flush();
     }
 
     StrBuf input;
     sb_init(&input);
-    fflush(stdout);
+    out_flush();
     if (read_line_fd(0, &input) == 0) {
         sb_free(&input);
         return 1;
@@ -1099,7 +1107,7 @@ static int builtin_shopt(int argc, char **argv) {
     if (index >= argc) {
         for (int i = 0; KNOWN[i]; i++) {
             int *slot = shopt_slot(KNOWN[i]);
-            printf("%-12s%s\n", KNOWN[i], !slot || *slot ? "on" : "off");
+            out_printf("%-12s%s\n", KNOWN[i], !slot || *slot ? "on" : "off");
         }
         return 0;
     }
@@ -1121,7 +1129,7 @@ static int builtin_shopt(int argc, char **argv) {
         else if (clearing && slot) *slot = 0;
         else if (!setting && !clearing) {
             int on = !slot || *slot;
-            if (!quiet) printf("%-12s%s\n", argv[index], on ? "on" : "off");
+            if (!quiet) out_printf("%-12s%s\n", argv[index], on ? "on" : "off");
             if (!on) status = 1;
         }
     }
@@ -1232,7 +1240,7 @@ static int builtin_jump(int argc, char **argv) {
 
     if (argc < 2) {
         sl_sort(&listing);
-        for (size_t i = 0; i < listing.len; i++) printf("%s\n", listing.items[i]);
+        for (size_t i = 0; i < listing.len; i++) out_printf("%s\n", listing.items[i]);
         sl_free(&listing);
         return 0;
     }
@@ -1250,7 +1258,7 @@ static int builtin_jump(int argc, char **argv) {
         shell_error("z: %s: gone", best);
         return 1;
     }
-    printf("%s\n", best);
+    out_printf("%s\n", best);
     sync_cwd();
     return 0;
 }
@@ -1338,7 +1346,7 @@ static int builtin_paste(int argc, char **argv) {
     if (data) {
         const char *text = GlobalLock(data);
         if (text) {
-            printf("%s\n", text);
+            out_printf("%s\n", text);
             GlobalUnlock(data);
         }
     }
@@ -1431,6 +1439,7 @@ static int builtin_admin(int argc, char **argv) {
     ExecuteFn execute =
         shell_library ? (ExecuteFn)(void *)GetProcAddress(shell_library, "ShellExecuteExA") : NULL;
 
+    vars_sync_environment();
     int status = execute && execute(&info) ? 0 : 1;
     if (status) shell_error("admin: the elevated shell was refused");
     sb_free(&parameters);
@@ -1442,7 +1451,7 @@ static int builtin_bind(int argc, char **argv) {
         StrList widgets;
         sl_init(&widgets);
         widget_names(&widgets);
-        for (size_t i = 0; i < widgets.len; i++) printf("%s\n", widgets.items[i]);
+        for (size_t i = 0; i < widgets.len; i++) out_printf("%s\n", widgets.items[i]);
         sl_free(&widgets);
         return 0;
     }
@@ -1459,9 +1468,9 @@ static int builtin_bind(int argc, char **argv) {
         StrList rows;
         sl_init(&rows);
         bind_list(&rows);
-        for (size_t i = 0; i < rows.len; i++) printf("  %s\n", rows.items[i]);
+        for (size_t i = 0; i < rows.len; i++) out_printf("  %s\n", rows.items[i]);
         if (rows.len == 0)
-            printf("  %snothing bound, try bind ctrl+g \"git status\"%s\n", style(S_DIM),
+            out_printf("  %snothing bound, try bind ctrl+g \"git status\"%s\n", style(S_DIM),
                    style(S_RESET));
         sl_free(&rows);
         return 0;
@@ -1642,31 +1651,121 @@ static int builtin_dirs(int argc, char **argv) {
     char cwd[PATH_BUF];
     if (GetCurrentDirectoryA(sizeof(cwd), cwd)) {
         path_to_slashes(cwd);
-        printf("%s", cwd);
+        out_printf("%s", cwd);
     }
-    for (size_t i = directory_stack.len; i > 0; i--) printf(" %s", directory_stack.items[i - 1]);
-    printf("\n");
+    for (size_t i = directory_stack.len; i > 0; i--) out_printf(" %s", directory_stack.items[i - 1]);
+    out_printf("\n");
     return 0;
 }
 
+static void mapfile_callback(const char *callback, size_t index, const char *line) {
+    StrBuf command;
+    sb_init(&command);
+    sb_printf(&command, "%s %zu '", callback, index);
+    for (const char *p = line; *p; p++) {
+        if (*p == '\'') sb_puts(&command, "'\\''");
+        else sb_putc(&command, *p);
+    }
+    sb_putc(&command, '\'');
+    exec_text(command.data);
+    sb_free(&command);
+}
+
+static int mapfile_number(const char *value, char option, long *out) {
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (!*value || *end || number < 0 || (option == 'c' && number == 0)) {
+        shell_error("mapfile: %s: invalid %s", value,
+                    option == 'c' ? "callback quantum" : "line count");
+        return 0;
+    }
+    *out = number;
+    return 1;
+}
+
 static int builtin_mapfile(int argc, char **argv) {
     int strip = 0;
+    long count = 0;
+    long skip = 0;
+    long quantum = 5000;
+    const char *callback = NULL;
     int index = 1;
-    for (; index < argc && argv[index][0] == '-'; index++) {
-        if (strchr(argv[index], 't')) strip = 1;
+    for (; index < argc && argv[index][0] == '-' && argv[index][1]; index++) {
+        if (strcmp(argv[index], "--") == 0) {
+            index++;
+            break;
+        }
+        for (const char *flag = argv[index] + 1; *flag; flag++) {
+            if (*flag == 't') {
+                strip = 1;
+                continue;
+            }
+            if (!strchr("nscC", *flag)) {
+                shell_error("mapfile: -%c: invalid option", *flag);
+                return 2;
+            }
+            const char *value = flag[1] ? flag + 1 : index + 1 < argc ? argv[++index] : NULL;
+            if (!value) {
+                shell_error("mapfile: -%c: option requires an argument", *flag);
+                return 2;
+            }
+            if (*flag == 'C') callback = value;
+            else if (!mapfile_number(value, *flag, *flag == 'n' ? &count : *flag == 's' ? &skip : &quantum))
+                return 1;
+            break;
+        }
     }
     const char *name = index < argc ? argv[index] : "MAPFILE";
 
     StrList rows;
     sl_init(&rows);
-    char line[4096];
-    while (fgets(line, sizeof(line), stdin)) {
-        if (strip) line[strcspn(line, "\r\n")] = '\0';
-        sl_push_copy(&rows, line);
+    StrBuf line;
+    sb_init(&line);
+    StrBuf input;
+    sb_init(&input);
+    const char *cursor = NULL;
+    if (count == 0) {
+        out_flush();
+        read_all_fd(0, &input);
+        cursor = input.data;
+    }
+
+    for (;;) {
+        int kind;
+        if (cursor) {
+            if (!*cursor) break;
+            const char *newline = strchr(cursor, '\n');
+            size_t length = newline ? (size_t)(newline - cursor) : strlen(cursor);
+            sb_clear(&line);
+            sb_putn(&line, cursor, length);
+            cursor += length + (newline ? 1 : 0);
+            kind = newline ? 1 : 2;
+            if (kind == 1 && line.len && line.data[line.len - 1] == '\r') {
+                line.len--;
+                line.data[line.len] = '\0';
+            }
+        } else {
+            if ((long)rows.len >= count) break;
+            kind = read_line_fd(0, &line);
+            if (kind == 0) break;
+        }
+
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        if (!strip && kind == 1) sb_putc(&line, '\n');
+        if (callback && (rows.len + 1) % (size_t)quantum == 0) {
+            var_set_array(name, &rows, VAR_INDEXED);
+            mapfile_callback(callback, rows.len, line.data);
+        }
+        sl_push_copy(&rows, line.data);
     }
 
     var_set_array(name, &rows, VAR_INDEXED);
     sl_free(&rows);
+    sb_free(&line);
+    sb_free(&input);
     return 0;
 }
 
@@ -1716,7 +1815,7 @@ static int builtin_gitinfo(int argc, char **argv) {
     (void)argv;
     char root[PATH_BUF];
     if (!git_repo_root(root, sizeof(root))) {
-        printf("not a git repository\n");
+        out_printf("not a git repository\n");
         return 1;
     }
     path_to_slashes(root);
@@ -1726,7 +1825,7 @@ static int builtin_gitinfo(int argc, char **argv) {
                              {"user", git_user() ? git_user() : "not configured"},
                              {"state", git_dirty() ? "dirty" : "clean"}};
     for (int i = 0; i < 5; i++)
-        printf("  %s%-11s%s %s%s%s\n", style(S_LABEL), rows[i][0], style(S_RESET), style(S_VALUE),
+        out_printf("  %s%-11s%s %s%s%s\n", style(S_LABEL), rows[i][0], style(S_RESET), style(S_VALUE),
                rows[i][1], style(S_RESET));
     return 0;
 }
@@ -1738,9 +1837,9 @@ static int builtin_help(int argc, char **argv) {
         return status;
     }
 
-    printf("\n  %s%s%s  %sFreSH%s %s%s%s\n", style(S_ACCENT), S_LAMBDA, style(S_RESET),
+    out_printf("\n  %s%s%s  %sFreSH%s %s%s%s\n", style(S_ACCENT), S_LAMBDA, style(S_RESET),
            style(S_HEADING), style(S_RESET), style(S_DIM), FRESH_VERSION, style(S_RESET));
-    printf("  %sa zsh flavoured shell for Windows%s\n\n", style(S_DIM), style(S_RESET));
+    out_printf("  %sa zsh flavoured shell for Windows%s\n\n", style(S_DIM), style(S_RESET));
     int width = term_width();
     int columns = width / 14;
     if (columns < 1) columns = 1;
@@ -1753,13 +1852,13 @@ static int builtin_help(int argc, char **argv) {
         else coreutil_names(&names);
         sl_sort(&names);
 
-        printf("  %s%s%s\n", style(S_LABEL), titles[group], style(S_RESET));
+        out_printf("  %s%s%s\n", style(S_LABEL), titles[group], style(S_RESET));
         for (size_t i = 0; i < names.len; i++) {
-            printf("  %-12s", names.items[i]);
-            if ((i + 1) % (size_t)columns == 0) putchar('\n');
+            out_printf("  %-12s", names.items[i]);
+            if ((i + 1) % (size_t)columns == 0) out_putc('\n');
         }
-        if (names.len % (size_t)columns) putchar('\n');
-        putchar('\n');
+        if (names.len % (size_t)columns) out_putc('\n');
+        out_putc('\n');
         sl_free(&names);
     }
 
@@ -1768,29 +1867,29 @@ static int builtin_help(int argc, char **argv) {
     help_described_names(&described);
     if (described.len > 0) {
         sl_sort(&described);
-        printf("  %sDescribed by plugins:%s\n", style(S_LABEL), style(S_RESET));
+        out_printf("  %sDescribed by plugins:%s\n", style(S_LABEL), style(S_RESET));
         for (size_t i = 0; i < described.len; i++) {
-            printf("  %-12s", described.items[i]);
-            if ((i + 1) % (size_t)columns == 0) putchar('\n');
+            out_printf("  %-12s", described.items[i]);
+            if ((i + 1) % (size_t)columns == 0) out_putc('\n');
         }
-        if (described.len % (size_t)columns) putchar('\n');
-        putchar('\n');
+        if (described.len % (size_t)columns) out_putc('\n');
+        out_putc('\n');
     }
     sl_free(&described);
 
-    printf("  %sLine editing%s\n", style(S_LABEL), style(S_RESET));
-    printf("  Tab              complete commands, files and variables\n");
-    printf("  Up / Down        history, filtered by what is already typed\n");
-    printf("  Right / End      accept the inline history suggestion\n");
-    printf("  Ctrl+R           search history\n");
-    printf("  Ctrl+A / Ctrl+E  start and end of line\n");
-    printf("  Ctrl+W / Backsp  delete the previous word\n");
-    printf("  Ctrl+U / Ctrl+K  cut to start and to end\n");
-    printf("  Ctrl+L           clear the screen\n");
-    printf("  Ctrl+C           abandon the line, or the block you are part way through\n\n");
-    printf("  %shelp <command> for what it does and the arguments it takes%s\n", style(S_DIM),
+    out_printf("  %sLine editing%s\n", style(S_LABEL), style(S_RESET));
+    out_printf("  Tab              complete commands, files and variables\n");
+    out_printf("  Up / Down        history, filtered by what is already typed\n");
+    out_printf("  Right / End      accept the inline history suggestion\n");
+    out_printf("  Ctrl+R           search history\n");
+    out_printf("  Ctrl+A / Ctrl+E  start and end of line\n");
+    out_printf("  Ctrl+W / Backsp  delete the previous word\n");
+    out_printf("  Ctrl+U / Ctrl+K  cut to start and to end\n");
+    out_printf("  Ctrl+L           clear the screen\n");
+    out_printf("  Ctrl+C           abandon the line, or the block you are part way through\n\n");
+    out_printf("  %shelp <command> for what it does and the arguments it takes%s\n", style(S_DIM),
            style(S_RESET));
-    printf("  %sConfiguration lives in ~/.freshrc%s\n\n", style(S_DIM), style(S_RESET));
+    out_printf("  %sConfiguration lives in ~/.freshrc%s\n\n", style(S_DIM), style(S_RESET));
     return 0;
 }
 
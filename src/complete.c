@@ -19,8 +19,38 @@
 #include "help.h"
 #include "parser.h"
 #include "style.h"
+#include "table.h"
 #include "vars.h"
 
+#define LISTING_SLOTS 8
+
+typedef struct {
+    char *dir;
+    unsigned long long stamp;
+    StrList names;
+} Listing;
+
+struct CompleteJob {
+    StrList matches;
+    size_t start;
+    int listing;
+    char *token;
+    char *dir;
+    char *leaf;
+    int wildcard;
+    int directories_only;
+    unsigned long long cached_stamp;
+    unsigned long long stamp;
+    StrList names;
+    int fresh;
+    HANDLE thread;
+    volatile LONG cancelled;
+    volatile LONG refs;
+};
+
+static Listing listings[LISTING_SLOTS];
+static size_t listing_count = 0;
+
 static size_t token_start(const char *buffer, size_t cursor) {
     size_t start = 0;
     char quote = 0;
@@ -118,7 +148,87 @@ static int wants_directories(const char *command) {
            strcmp(command, "pushd") == 0 || strcmp(command, "mkdir") == 0;
 }
 
-static void complete_paths(const char *token, StrList *out, int directories_only) {
+static unsigned long long directory_stamp(const char *dir) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(dir, GetFileExInfoStandard, &data)) return 0;
+    return ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+           data.ftLastWriteTime.dwLowDateTime;
+}
+
+static Listing *listing_find(const char *dir) {
+    for (size_t i = 0; i < listing_count; i++) {
+        if (str_ieq(listings[i].dir, dir)) return &listings[i];
+    }
+    return NULL;
+}
+
+static Listing *listing_store(const char *dir, unsigned long long stamp, StrList *names) {
+    Listing *entry = listing_find(dir);
+    if (!entry) {
+        if (listing_count == LISTING_SLOTS) {
+            free(listings[0].dir);
+            sl_free(&listings[0].names);
+            memmove(&listings[0], &listings[1], (LISTING_SLOTS - 1) * sizeof(Listing));
+            listing_count--;
+        }
+        entry = &listings[listing_count++];
+        entry->dir = xstrdup(dir);
+    } else {
+        sl_free(&entry->names);
+    }
+    entry->stamp = stamp;
+    entry->names = *names;
+    sl_init(names);
+    return entry;
+}
+
+static void job_release(CompleteJob *job) {
+    if (InterlockedDecrement(&job->refs) > 0) return;
+    sl_free(&job->matches);
+    sl_free(&job->names);
+    free(job->token);
+    free(job->dir);
+    free(job->leaf);
+    free(job);
+}
+
+static DWORD WINAPI listing_worker(LPVOID parameter) {
+    CompleteJob *job = parameter;
+    job->stamp = job->wildcard ? 0 : directory_stamp(job->dir);
+
+    if (!job->stamp || job->stamp != job->cached_stamp) {
+        StrBuf pattern;
+        sb_init(&pattern);
+        sb_puts(&pattern, job->dir);
+        if (job->wildcard) sb_puts(&pattern, job->leaf);
+        sb_putc(&pattern, '*');
+
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA(pattern.data, &data);
+        sb_free(&pattern);
+        if (find != INVALID_HANDLE_VALUE) {
+            do {
+                if (job->cancelled) break;
+                if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
+                if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                    StrBuf name;
+                    sb_init(&name);
+                    sb_printf(&name, "%s/", data.cFileName);
+                    sl_push(&job->names, sb_take(&name));
+                } else {
+                    sl_push_copy(&job->names, data.cFileName);
+                }
+            } while (FindNextFileA(find, &data));
+            FindClose(find);
+        }
+        job->fresh = 1;
+    }
+
+    job_release(job);
+    return 0;
+}
+
+static void listing_start(CompleteJob *job, const char *token, int directories_only) {
     char expanded[PATH_BUF];
     const char *home = var_get("HOME");
     if (token[0] == '~' && (token[1] == '/' || token[1] == '\\' || token[1] == '\0'))
@@ -139,12 +249,14 @@ static void complete_paths(const char *token, StrList *out, int directories_only
         leaf = slash + 1;
     }
 
-    char pattern[PATH_BUF];
-    snprintf(pattern, sizeof(pattern), "%s%s*", directory, leaf);
-
-    WIN32_FIND_DATAA data;
-    HANDLE find = FindFirstFileA(pattern, &data);
-    if (find == INVALID_HANDLE_VALUE) return;
+    char absolute[PATH_BUF] = "";
+    if (!path_is_absolute(directory) && GetCurrentDirectoryA(sizeof(absolute), absolute)) {
+        size_t length = strlen(absolute);
+        if (length > 0 && absolute[length - 1] != '\\')
+            snprintf(absolute + length, sizeof(absolute) - length, "\\");
+    }
+    size_t length = strlen(absolute);
+    snprintf(absolute + length, sizeof(absolute) - length, "%s", directory);
 
     const char *token_slash = strpbrk(token, "/\\");
     const char *token_last = NULL;
@@ -152,45 +264,109 @@ static void complete_paths(const char *token, StrList *out, int directories_only
         token_last = token_slash;
         token_slash = strpbrk(token_slash + 1, "/\\");
     }
-    size_t prefix_length = token_last ? (size_t)(token_last - token) + 1 : 0;
 
-    do {
-        if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
-        if (data.cFileName[0] == '.' && leaf[0] != '.') continue;
-        if (directories_only && !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+    job->listing = 1;
+    job->token = xstrndup(token, token_last ? (size_t)(token_last - token) + 1 : 0);
+    job->dir = xstrdup(absolute);
+    job->leaf = xstrdup(leaf);
+    job->wildcard = strpbrk(leaf, "*?") != NULL;
+    job->directories_only = directories_only;
+
+    Listing *cached = job->wildcard ? NULL : listing_find(job->dir);
+    job->cached_stamp = cached ? cached->stamp : 0;
+
+    job->refs = 2;
+    job->thread = CreateThread(NULL, 0, listing_worker, job, 0, NULL);
+    if (!job->thread) listing_worker(job);
+}
+
+static void listing_collect(CompleteJob *job, StrList *out) {
+    const StrList *names = &job->names;
+    if (!job->fresh) {
+        Listing *cached = listing_find(job->dir);
+        if (cached) names = &cached->names;
+    } else if (!job->wildcard && job->stamp) {
+        names = &listing_store(job->dir, job->stamp, &job->names)->names;
+    }
+
+    Table seen;
+    table_init(&seen, 64, 0, NULL);
+    for (size_t i = 0; i < out->len; i++) table_put(&seen, out->items[i], out->items[i]);
+
+    size_t leaf_length = strlen(job->leaf);
+    size_t before = out->len;
+    for (size_t i = 0; i < names->len; i++) {
+        const char *name = names->items[i];
+        size_t length = strlen(name);
+        int directory = length > 0 && name[length - 1] == '/';
+        if (!job->wildcard && _strnicmp(name, job->leaf, leaf_length) != 0) continue;
+        if (name[0] == '.' && job->leaf[0] != '.') continue;
+        if (job->directories_only && !directory) continue;
 
         StrBuf sb;
         sb_init(&sb);
-        sb_putn(&sb, token, prefix_length);
-        sb_puts(&sb, data.cFileName);
-        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) sb_putc(&sb, '/');
+        sb_puts(&sb, job->token);
+        sb_puts(&sb, name);
         path_to_slashes(sb.data);
-        push_unique(out, sb.data);
-        sb_free(&sb);
-    } while (FindNextFileA(find, &data));
-    FindClose(find);
-    sl_sort(out);
+        if (table_get(&seen, sb.data)) {
+            sb_free(&sb);
+            continue;
+        }
+        char *match = sb_take(&sb);
+        table_put(&seen, match, match);
+        sl_push(out, match);
+    }
+    table_free(&seen);
+    if (out->len > before) sl_sort(out);
 }
 
-void complete_at(const char *buffer, size_t cursor, StrList *matches, size_t *replace_start) {
+CompleteJob *complete_start(const char *buffer, size_t cursor) {
+    CompleteJob *job = xmalloc(sizeof(CompleteJob));
+    memset(job, 0, sizeof(*job));
+    sl_init(&job->matches);
+    sl_init(&job->names);
+    job->refs = 1;
+
     size_t start = token_start(buffer, cursor);
-    *replace_start = start;
+    job->start = start;
 
     char *raw = xstrndup(buffer + start, cursor - start);
     char *token = raw;
     if (*token == '"' || *token == '\'') token++;
 
     if (token[0] == '$') {
-        complete_variables(token, matches);
+        complete_variables(token, &job->matches);
     } else if (at_command_position(buffer, start) && !strpbrk(token, "/\\.")) {
-        complete_commands(token, matches);
-        complete_paths(token, matches, 0);
+        complete_commands(token, &job->matches);
+        listing_start(job, token, 0);
     } else {
         char *command = command_word(buffer, start);
-        if (token[0] == '-') help_flags(command, token, matches);
-        else if (wants_commands(command)) complete_commands(token, matches);
-        else complete_paths(token, matches, wants_directories(command));
+        if (token[0] == '-') help_flags(command, token, &job->matches);
+        else if (wants_commands(command)) complete_commands(token, &job->matches);
+        else listing_start(job, token, wants_directories(command));
         free(command);
     }
     free(raw);
+    return job;
+}
+
+int complete_wait(CompleteJob *job, unsigned milliseconds) {
+    return !job->thread || WaitForSingleObject(job->thread, milliseconds) == WAIT_OBJECT_0;
+}
+
+void complete_finish(CompleteJob *job, StrList *matches, size_t *replace_start) {
+    complete_wait(job, INFINITE);
+    if (job->listing) listing_collect(job, &job->matches);
+
+    for (size_t i = 0; i < job->matches.len; i++) sl_push(matches, job->matches.items[i]);
+    job->matches.len = 0;
+    *replace_start = job->start;
+    complete_cancel(job);
+}
+
+void complete_cancel(CompleteJob *job) {
+    InterlockedExchange(&job->cancelled, 1);
+    if (job->thread) CloseHandle(job->thread);
+    job->thread = NULL;
+    job_release(job);
 }
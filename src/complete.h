@@ -9,6 +9,11 @@
 
 #include "util.h"
 
-void complete_at(const char *buffer, size_t cursor, StrList *matches, size_t *replace_start);
+typedef struct CompleteJob CompleteJob;
+
+CompleteJob *complete_start(const char *buffer, size_t cursor);
+int complete_wait(CompleteJob *job, unsigned milliseconds);
+void complete_finish(CompleteJob *job, StrList *matches, size_t *replace_start);
+void complete_cancel(CompleteJob *job);
 
 #endif
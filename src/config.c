@@ -105,31 +105,32 @@ void config_report(int found_problems, const StrList *problems) {
     path_to_slashes(rc);
 
     const char *tone = found_problems ? S_ERROR : S_ACCENT;
-    printf("\n");
+    out_printf("\n");
     for (int i = 0; i < 5; i++) {
-        printf("  %s%-12s%s   ", style(tone), art[i], style(S_RESET));
+        out_printf("  %s%-12s%s   ", style(tone), art[i], style(S_RESET));
 
         if (i == 0) {
-            printf("%sFreSH%s %s%s%s\n", style(S_HEADING), style(S_RESET), style(S_DIM),
+            out_printf("%sFreSH%s %s%s%s\n", style(S_HEADING), style(S_RESET), style(S_DIM),
                    FRESH_VERSION, style(S_RESET));
         } else if (i == 1) {
-            printf("%s%s%s\n", style(S_DIM), rc, style(S_RESET));
+            out_printf("%s%s%s\n", style(S_DIM), rc, style(S_RESET));
         } else if (i == 3 && !found_problems) {
-            printf("%s\xe2\x9c\x93%s  the configuration is valid\n", style(S_ACCENT),
+            out_printf("%s\xe2\x9c\x93%s  the configuration is valid\n", style(S_ACCENT),
                    style(S_RESET));
         } else if (i == 3) {
-            printf("%s\xe2\x9c\x97%s  %d problem%s in the configuration\n", style(S_ERROR),
+            out_printf("%s\xe2\x9c\x97%s  %d problem%s in the configuration\n", style(S_ERROR),
                    style(S_RESET), found_problems, found_problems == 1 ? "" : "s");
         } else {
-            printf("\n");
+            out_printf("\n");
         }
     }
 
     for (size_t i = 0; i < problems->len; i++)
-        printf("  %s%s%s\n", style(S_WARN), problems->items[i], style(S_RESET));
+        out_printf("  %s%s%s\n", style(S_WARN), problems->items[i], style(S_RESET));
 
     if (found_problems)
-        printf("\n  %sedit %s, then run fresh doctor again%s\n", style(S_DIM), rc, style(S_RESET));
-    printf("\n");
+        out_printf("\n  %sedit %s, then run fresh doctor again%s\n", style(S_DIM), rc,
+                   style(S_RESET));
+    out_printf("\n");
     free(rc);
 }
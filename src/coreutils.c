@@ -8,6 +8,7 @@
 
 #include <ctype.h>
 #include <direct.h>
+#include <io.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +26,9 @@
 #include "vars.h"
 
 #define LINE_MAX_LEN 8192
+#define BLOCK_SIZE 65536
+#define COPY_SIZE (1 << 20)
+#define MAP_WINDOW (64u << 20)
 
 static FILE *open_input(const char *path) {
     if (!path || strcmp(path, "-") == 0) return stdin;
@@ -37,6 +41,41 @@ static void close_input(FILE *f) {
     if (f && f != stdin) fclose(f);
 }
 
+typedef void (*LineFn)(const char *line, size_t length, int ended, void *context);
+
+static void deliver_line(const char *line, size_t length, int ended, LineFn fn, void *context) {
+    if (ended && length && line[length - 1] == '\r') length--;
+    fn(line, length, ended, context);
+}
+
+static void each_line(FILE *f, LineFn fn, void *context) {
+    char *block = xmalloc(BLOCK_SIZE);
+    StrBuf carry;
+    sb_init(&carry);
+
+    size_t read;
+    while ((read = fread(block, 1, BLOCK_SIZE, f)) > 0) {
+        const char *p = block;
+        const char *end = block + read;
+        const char *newline;
+        while ((newline = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+            if (carry.len) {
+                sb_putn(&carry, p, (size_t)(newline - p));
+                deliver_line(carry.data, carry.len, 1, fn, context);
+                sb_clear(&carry);
+            } else {
+                deliver_line(p, (size_t)(newline - p), 1, fn, context);
+            }
+            p = newline + 1;
+        }
+        if (p < end) sb_putn(&carry, p, (size_t)(end - p));
+    }
+    if (carry.len) deliver_line(carry.data, carry.len, 0, fn, context);
+
+    sb_free(&carry);
+    free(block);
+}
+
 static void strip_newline(char *line) {
     line[strcspn(line, "\r\n")] = '\0';
 }
@@ -56,6 +95,75 @@ static int first_operand(int argc, char **argv) {
     return argc;
 }
 
+static HANDLE file_handle(FILE *f) {
+    return (HANDLE)_get_osfhandle(_fileno(f));
+}
+
+static int is_disk_file(FILE *f) {
+    return GetFileType(file_handle(f)) == FILE_TYPE_DISK;
+}
+
+static int write_handle(HANDLE target, const char *data, size_t length) {
+    while (length > 0) {
+        DWORD chunk = length > MAP_WINDOW ? MAP_WINDOW : (DWORD)length;
+        DWORD written = 0;
+        if (!WriteFile(target, data, chunk, &written, NULL) || written == 0) return 0;
+        data += written;
+        length -= written;
+    }
+    return 1;
+}
+
+static int copy_bytes(FILE *f, long long limit) {
+    char *buffer = xmalloc(COPY_SIZE);
+    int ok = 1;
+    while (limit != 0) {
+        size_t want = limit > 0 && limit < COPY_SIZE ? (size_t)limit : COPY_SIZE;
+        size_t n = fread(buffer, 1, want, f);
+        if (n == 0) break;
+        if (out_write(buffer, n) != n) {
+            ok = 0;
+            break;
+        }
+        if (limit > 0) limit -= (long long)n;
+    }
+    free(buffer);
+    return ok;
+}
+
+static int map_to_stdout(FILE *f) {
+    HANDLE source = file_handle(f);
+    LARGE_INTEGER size;
+    if (out_is_buffered() || !is_disk_file(f) || !GetFileSizeEx(source, &size)) return 0;
+    if (size.QuadPart == 0) return 1;
+
+    HANDLE mapping = CreateFileMappingA(source, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return 0;
+
+    out_flush();
+    HANDLE target = file_handle(stdout);
+    long long offset = 0;
+    while (offset < size.QuadPart) {
+        long long left = size.QuadPart - offset;
+        SIZE_T span = left > MAP_WINDOW ? MAP_WINDOW : (SIZE_T)left;
+        const char *view = MapViewOfFile(mapping, FILE_MAP_READ,
+                                         (DWORD)((unsigned long long)offset >> 32),
+                                         (DWORD)offset, span);
+        if (!view) break;
+        int ok = write_handle(target, view, span);
+        UnmapViewOfFile(view);
+        if (!ok) {
+            CloseHandle(mapping);
+            return -1;
+        }
+        offset += (long long)span;
+    }
+    CloseHandle(mapping);
+    if (offset == size.QuadPart) return 1;
+    _fseeki64(f, offset, SEEK_SET);
+    return 0;
+}
+
 static int core_cat(int argc, char **argv) {
     int start = first_operand(argc, argv);
     int numbered = flag_set(argc, argv, 'n');
@@ -63,9 +171,7 @@ static int core_cat(int argc, char **argv) {
     int line_number = 0;
 
     if (start >= argc) {
-        char buffer[4096];
-        size_t n;
-        while ((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0) fwrite(buffer, 1, n, stdout);
+        copy_bytes(stdin, -1);
         return 0;
     }
 
@@ -80,88 +186,370 @@ static int core_cat(int argc, char **argv) {
             sb_init(&line);
             int kind;
             while ((kind = read_line(f, &line)) != 0)
-                printf("%6d  %s%s", ++line_number, line.data, kind == 1 ? "\n" : "");
+                out_printf("%6d  %s%s", ++line_number, line.data, kind == 1 ? "\n" : "");
             sb_free(&line);
         } else {
-            char buffer[4096];
-            size_t n;
-            while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) fwrite(buffer, 1, n, stdout);
+            int mapped = f == stdin ? 0 : map_to_stdout(f);
+            if (mapped < 0) status = 1;
+            else if (mapped == 0) copy_bytes(f, -1);
         }
         close_input(f);
     }
     return status;
 }
 
+static void print_lines(FILE *f, long long limit) {
+    StrBuf line;
+    sb_init(&line);
+    int kind;
+    while (limit != 0 && (kind = read_line(f, &line)) != 0) {
+        out_write(line.data, line.len);
+        if (kind == 1) out_putc('\n');
+        if (limit > 0) limit--;
+    }
+    sb_free(&line);
+}
+
+static long long tail_line_start(FILE *f, long long size, long long count) {
+    char *block = xmalloc(BLOCK_SIZE);
+    long long end = size;
+    long long found = 0;
+    long long start = 0;
+
+    if (size > 0 && _fseeki64(f, size - 1, SEEK_SET) == 0 && fgetc(f) == '\n') end--;
+    while (end > 0) {
+        long long from = end > BLOCK_SIZE ? end - BLOCK_SIZE : 0;
+        size_t span = (size_t)(end - from);
+        if (_fseeki64(f, from, SEEK_SET) != 0 || fread(block, 1, span, f) != span) break;
+        size_t i = span;
+        while (i > 0 && found < count) {
+            if (block[--i] == '\n') found++;
+        }
+        if (found == count) {
+            start = from + (long long)i + 1;
+            break;
+        }
+        end = from;
+    }
+    free(block);
+    return start;
+}
+
+static void tail_stream_lines(FILE *f, long long count) {
+    char **ring = xmalloc((size_t)count * sizeof(char *));
+    int *ended = xmalloc((size_t)count * sizeof(int));
+    for (long long r = 0; r < count; r++) ring[r] = NULL;
+    long long total = 0;
+
+    StrBuf line;
+    sb_init(&line);
+    int kind;
+    while ((kind = read_line(f, &line)) != 0) {
+        long long slot = total % count;
+        free(ring[slot]);
+        ring[slot] = xstrdup(line.data);
+        ended[slot] = kind == 1;
+        total++;
+    }
+    sb_free(&line);
+
+    long long available = total < count ? total : count;
+    for (long long r = 0; r < available; r++) {
+        long long slot = (total - available + r) % count;
+        out_puts(ring[slot]);
+        if (ended[slot]) out_putc('\n');
+    }
+    for (long long r = 0; r < count; r++) free(ring[r]);
+    free(ring);
+    free(ended);
+}
+
+static void tail_stream_bytes(FILE *f, long long count) {
+    StrBuf kept;
+    sb_init(&kept);
+    char *block = xmalloc(BLOCK_SIZE);
+    size_t n;
+    while ((n = fread(block, 1, BLOCK_SIZE, f)) > 0) {
+        sb_putn(&kept, block, n);
+        if (kept.len > (size_t)count * 2 + BLOCK_SIZE) {
+            memmove(kept.data, kept.data + kept.len - (size_t)count, (size_t)count);
+            kept.len = (size_t)count;
+        }
+    }
+    size_t keep = kept.len > (size_t)count ? (size_t)count : kept.len;
+    out_write(kept.data + kept.len - keep, keep);
+    free(block);
+    sb_free(&kept);
+}
+
+static void tail_file(FILE *f, long long count, int bytes, int from_start) {
+    if (from_start) {
+        long long skip = count > 0 ? count - 1 : 0;
+        if (bytes) {
+            if (is_disk_file(f)) _fseeki64(f, skip, SEEK_CUR);
+            else
+                while (skip-- > 0 && fgetc(f) != EOF) {}
+            copy_bytes(f, -1);
+        } else {
+            StrBuf line;
+            sb_init(&line);
+            while (skip-- > 0 && read_line(f, &line) != 0) {}
+            sb_free(&line);
+            print_lines(f, -1);
+        }
+        return;
+    }
+    if (count == 0) return;
+
+    if (is_disk_file(f) && _fseeki64(f, 0, SEEK_END) == 0) {
+        long long size = _ftelli64(f);
+        long long start;
+        if (bytes) start = size > count ? size - count : 0;
+        else start = tail_line_start(f, size, count);
+        _fseeki64(f, start, SEEK_SET);
+        if (bytes) copy_bytes(f, -1);
+        else print_lines(f, -1);
+        return;
+    }
+    if (bytes) tail_stream_bytes(f, count);
+    else tail_stream_lines(f, count);
+}
+
+enum { FOLLOW_NONE, FOLLOW_DESCRIPTOR, FOLLOW_NAME };
+
+#define FOLLOW_RECHECK_MS 1000
+
+typedef struct {
+    const char *path;
+    FILE *file;
+    long long offset;
+    DWORD volume;
+    DWORD index_high;
+    DWORD index_low;
+} Followed;
+
+static HANDLE follow_stop = NULL;
+
+static BOOL WINAPI follow_ctrl(DWORD type) {
+    if (type != CTRL_C_EVENT && type != CTRL_BREAK_EVENT) return FALSE;
+    SetEvent(follow_stop);
+    return TRUE;
+}
+
+static int identify(HANDLE handle, Followed *item) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(handle, &info)) return 0;
+    item->volume = info.dwVolumeSerialNumber;
+    item->index_high = info.nFileIndexHigh;
+    item->index_low = info.nFileIndexLow;
+    return 1;
+}
+
+static int same_file(const Followed *item) {
+    HANDLE handle = CreateFileA(item->path, FILE_READ_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return -1;
+    Followed now;
+    int known = identify(handle, &now);
+    CloseHandle(handle);
+    return known && now.volume == item->volume && now.index_high == item->index_high &&
+           now.index_low == item->index_low;
+}
+
+static int follow_read(Followed *item, size_t index, size_t *shown, int multiple) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_handle(item->file), &size)) return 1;
+    if (size.QuadPart < item->offset) {
+        shell_error("tail: %s: file truncated", item->path);
+        item->offset = 0;
+    }
+    if (size.QuadPart == item->offset) return 1;
+
+    if (multiple && *shown != index) out_printf("\n==> %s <==\n", item->path);
+    *shown = index;
+    clearerr(item->file);
+    _fseeki64(item->file, item->offset, SEEK_SET);
+    int ok = copy_bytes(item->file, size.QuadPart - item->offset);
+    item->offset = _ftelli64(item->file);
+    return out_flush() == 0 && ok;
+}
+
+static void follow_reopen(Followed *item) {
+    item->file = fopen(item->path, "rb");
+    item->offset = 0;
+    if (item->file && !identify(file_handle(item->file), item)) {
+        fclose(item->file);
+        item->file = NULL;
+    }
+}
+
+static int follow_check(Followed *item, int mode, size_t index, size_t *shown, int multiple) {
+    if (mode == FOLLOW_DESCRIPTOR) return !item->file || follow_read(item, index, shown, multiple);
+
+    int current = item->file ? same_file(item) : -1;
+    if (item->file && current == 1) return follow_read(item, index, shown, multiple);
+    if (item->file) {
+        if (!follow_read(item, index, shown, multiple)) return 0;
+        fclose(item->file);
+        item->file = NULL;
+        if (current == -1) shell_error("tail: %s: gone, waiting for it to come back", item->path);
+    }
+    if (!item->file && (current == 0 || same_file(item) != -1)) {
+        follow_reopen(item);
+        if (!item->file) return 1;
+        shell_error("tail: %s: following the new file", item->path);
+        return follow_read(item, index, shown, multiple);
+    }
+    return 1;
+}
+
+static void watch_directory(const char *path, HANDLE *watches, char **names, DWORD *count) {
+    const char *slash = strrchr(path, '/');
+    const char *backslash = strrchr(path, '\\');
+    if (!slash || (backslash && backslash > slash)) slash = backslash;
+    char *directory = slash ? xstrndup(path, (size_t)(slash - path) + (slash == path)) : xstrdup(".");
+
+    for (DWORD i = 1; i < *count; i++) {
+        if (_stricmp(names[i], directory) == 0) {
+            free(directory);
+            return;
+        }
+    }
+    if (*count >= MAXIMUM_WAIT_OBJECTS) {
+        free(directory);
+        return;
+    }
+    HANDLE watch = FindFirstChangeNotificationA(
+        directory, FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (watch == INVALID_HANDLE_VALUE) {
+        free(directory);
+        return;
+    }
+    names[*count] = directory;
+    watches[(*count)++] = watch;
+}
+
+static void follow_files(Followed *items, size_t count, int mode) {
+    HANDLE watches[MAXIMUM_WAIT_OBJECTS];
+    char *names[MAXIMUM_WAIT_OBJECTS];
+    DWORD watching = 1;
+
+    follow_stop = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!follow_stop) return;
+    watches[0] = follow_stop;
+    names[0] = NULL;
+    for (size_t i = 0; i < count; i++) watch_directory(items[i].path, watches, names, &watching);
+    SetConsoleCtrlHandler(follow_ctrl, TRUE);
+    out_flush();
+
+    size_t shown = count - 1;
+    int multiple = count > 1;
+    while (!shell.interrupted) {
+        DWORD woke = WaitForMultipleObjects(watching, watches, FALSE, FOLLOW_RECHECK_MS);
+        if (woke == WAIT_OBJECT_0 || woke == WAIT_FAILED) break;
+        if (woke > WAIT_OBJECT_0 && woke < WAIT_OBJECT_0 + watching)
+            FindNextChangeNotification(watches[woke - WAIT_OBJECT_0]);
+
+        int writing = 1;
+        for (size_t i = 0; i < count && writing; i++)
+            writing = follow_check(&items[i], mode, i, &shown, multiple);
+        if (!writing) break;
+    }
+
+    SetConsoleCtrlHandler(follow_ctrl, FALSE);
+    for (DWORD i = 1; i < watching; i++) {
+        FindCloseChangeNotification(watches[i]);
+        free(names[i]);
+    }
+    CloseHandle(follow_stop);
+    follow_stop = NULL;
+}
+
 static int core_head_tail(int argc, char **argv, int is_head) {
-    int count = 10;
+    const char *name = is_head ? "head" : "tail";
+    long long count = 10;
+    int bytes = 0;
+    int from_start = 0;
+    int follow = FOLLOW_NONE;
     int start = 1;
 
     while (start < argc) {
-        if (strcmp(argv[start], "-n") == 0 && start + 1 < argc) {
-            count = atoi(argv[start + 1]);
-            start += 2;
-            continue;
-        }
-        if (argv[start][0] == '-' && isdigit((unsigned char)argv[start][1])) {
-            count = atoi(argv[start] + 1);
+        const char *arg = argv[start];
+        const char *value = NULL;
+        if (strcmp(arg, "-f") == 0 || strcmp(arg, "--follow") == 0 ||
+            strcmp(arg, "--follow=descriptor") == 0) {
+            follow = FOLLOW_DESCRIPTOR;
+        } else if (strcmp(arg, "-F") == 0 || strcmp(arg, "--follow=name") == 0) {
+            follow = FOLLOW_NAME;
+        } else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "-c") == 0) && start + 1 < argc) {
+            value = argv[start + 1];
             start++;
-            continue;
-        }
-        if (argv[start][0] == '-' && argv[start][1]) {
+        } else if ((arg[0] == '-' && (arg[1] == 'n' || arg[1] == 'c')) && arg[2]) {
+            value = arg + 2;
+        } else if (arg[0] == '-' && isdigit((unsigned char)arg[1])) {
+            value = arg + 1;
+        } else if (strcmp(arg, "--") == 0) {
             start++;
-            continue;
+            break;
+        } else if (arg[0] != '-' || !arg[1]) {
+            break;
+        }
+        start++;
+        if (!value) continue;
+
+        bytes = arg[1] == 'c';
+        from_start = !is_head && value[0] == '+';
+        char *end;
+        count = strtoll(value + (value[0] == '+'), &end, 10);
+        if (*end || count < 0) {
+            shell_error("%s: %s: invalid count", name, value);
+            return 2;
         }
-        break;
     }
-    if (count <= 0) count = 10;
 
+    if (is_head || start >= argc) follow = FOLLOW_NONE;
     int multiple = argc - start > 1;
     int status = 0;
     int i = start;
+    Followed *followed = NULL;
+    if (follow) {
+        followed = xmalloc((size_t)(argc - start) * sizeof(Followed));
+        memset(followed, 0, (size_t)(argc - start) * sizeof(Followed));
+    }
 
     do {
-        const char *name = i < argc ? argv[i] : NULL;
-        FILE *f = open_input(name);
+        const char *path = i < argc ? argv[i] : NULL;
+        FILE *f = open_input(path);
+        if (followed) followed[i - start].path = path;
         if (!f) {
             status = 1;
             i++;
             continue;
         }
-        if (multiple) printf("==> %s <==\n", name);
+        if (multiple) out_printf("==> %s <==\n", path);
 
-        StrBuf line;
-        sb_init(&line);
+        if (!is_head) tail_file(f, count, bytes, from_start);
+        else if (bytes) copy_bytes(f, count);
+        else print_lines(f, count);
 
-        if (is_head) {
-            int printed = 0;
-            int kind;
-            while (printed < count && (kind = read_line(f, &line)) != 0) {
-                fputs(line.data, stdout);
-                if (kind == 1) fputc('\n', stdout);
-                printed++;
-            }
+        Followed *item = followed ? &followed[i - start] : NULL;
+        if (item && f != stdin && is_disk_file(f) && identify(file_handle(f), item)) {
+            item->file = f;
+            item->offset = _ftelli64(f);
         } else {
-            char **ring = xmalloc((size_t)count * sizeof(char *));
-            for (int r = 0; r < count; r++) ring[r] = NULL;
-            int total = 0;
-            while (read_line(f, &line) != 0) {
-                int slot = total % count;
-                free(ring[slot]);
-                ring[slot] = xstrdup(line.data);
-                total++;
-            }
-            int available = total < count ? total : count;
-            for (int r = 0; r < available; r++) {
-                int slot = (total - available + r) % count;
-                if (ring[slot]) printf("%s\n", ring[slot]);
-            }
-            for (int r = 0; r < count; r++) free(ring[r]);
-            free(ring);
+            close_input(f);
         }
-        sb_free(&line);
-        close_input(f);
         i++;
     } while (i < argc);
+
+    if (followed) {
+        follow_files(followed, (size_t)(argc - start), follow);
+        for (int k = 0; k < argc - start; k++)
+            if (followed[k].file) fclose(followed[k].file);
+        free(followed);
+    }
     return status;
 }
 
@@ -200,11 +588,11 @@ static int core_wc(int argc, char **argv) {
             core_count_block(block, read, &counts);
         close_input(f);
 
-        if (show_lines) printf("%8llu", counts.lines);
-        if (show_words) printf("%8llu", counts.words);
-        if (show_bytes) printf("%8llu", counts.bytes);
-        if (name) printf(" %s", name);
-        printf("\n");
+        if (show_lines) out_printf("%8llu", counts.lines);
+        if (show_words) out_printf("%8llu", counts.words);
+        if (show_bytes) out_printf("%8llu", counts.bytes);
+        if (name) out_printf(" %s", name);
+        out_printf("\n");
         index++;
     } while (index < argc);
     return status;
@@ -283,18 +671,18 @@ static int core_grep(int argc, char **argv) {
                 return 0;
             }
             if (count_only || list_files) continue;
-            if (multiple && name) printf("%s:", name);
-            if (numbered) printf("%ld:", number);
-            printf("%s\n", line.data);
+            if (multiple && name) out_printf("%s:", name);
+            if (numbered) out_printf("%ld:", number);
+            out_printf("%s\n", line.data);
         }
         sb_free(&line);
         close_input(f);
 
         if (count_only) {
-            if (multiple && name) printf("%s:", name);
-            printf("%ld\n", matches);
+            if (multiple && name) out_printf("%s:", name);
+            out_printf("%ld\n", matches);
         }
-        if (list_files && matches > 0 && name) printf("%s\n", name);
+        if (list_files && matches > 0 && name) out_printf("%s\n", name);
         index++;
     } while (index < argc);
 
@@ -335,7 +723,7 @@ static int core_sort(int argc, char **argv) {
             size_t previous = reverse ? index + 1 : index - 1;
             if (strcmp(lines.items[index], lines.items[previous]) == 0) continue;
         }
-        printf("%s\n", lines.items[index]);
+        out_printf("%s\n", lines.items[index]);
     }
     sl_free(&lines);
     return 0;
@@ -351,48 +739,255 @@ static int core_uniq(int argc, char **argv) {
     while (i < lines.len) {
         size_t run = 1;
         while (i + run < lines.len && strcmp(lines.items[i], lines.items[i + run]) == 0) run++;
-        if (show_count) printf("%7zu %s\n", run, lines.items[i]);
-        else printf("%s\n", lines.items[i]);
+        if (show_count) out_printf("%7zu %s\n", run, lines.items[i]);
+        else out_printf("%s\n", lines.items[i]);
         i += run;
     }
     sl_free(&lines);
     return 0;
 }
 
+typedef struct {
+    size_t low;
+    size_t high;
+} CutRange;
+
+typedef struct {
+    CutRange *ranges;
+    size_t count;
+    int bytes;
+    int complement;
+    int only_delimited;
+    char delimiter;
+    const char *output_delimiter;
+    int explicit_output;
+    StrBuf out;
+} CutSpec;
+
+static int compare_ranges(const void *a, const void *b) {
+    const CutRange *x = a;
+    const CutRange *y = b;
+    return x->low < y->low ? -1 : x->low > y->low;
+}
+
+static int parse_cut_list(const char *list, CutSpec *spec) {
+    const char *p = list;
+    while (*p) {
+        size_t low = 1;
+        size_t high = (size_t)-1;
+        char *end;
+        if (isdigit((unsigned char)*p)) {
+            low = (size_t)strtoul(p, &end, 10);
+            p = end;
+            high = low;
+        }
+        if (*p == '-') {
+            p++;
+            high = (size_t)-1;
+            if (isdigit((unsigned char)*p)) {
+                high = (size_t)strtoul(p, &end, 10);
+                p = end;
+            } else if (p - 1 == list || p[-2] == ',') {
+                return 0;
+            }
+        }
+        if (low == 0 || high < low || (*p && *p != ',')) return 0;
+        if (*p == ',') p++;
+
+        spec->ranges = xrealloc(spec->ranges, (spec->count + 1) * sizeof(CutRange));
+        spec->ranges[spec->count].low = low;
+        spec->ranges[spec->count].high = high;
+        spec->count++;
+    }
+    if (!spec->count) return 0;
+
+    qsort(spec->ranges, spec->count, sizeof(CutRange), compare_ranges);
+    size_t kept = 0;
+    for (size_t i = 1; i < spec->count; i++) {
+        CutRange *last = &spec->ranges[kept];
+        if (last->high == (size_t)-1) break;
+        if (spec->ranges[i].low <= last->high + 1) {
+            if (spec->ranges[i].high > last->high) last->high = spec->ranges[i].high;
+        } else {
+            spec->ranges[++kept] = spec->ranges[i];
+        }
+    }
+    spec->count = kept + 1;
+    return 1;
+}
+
+static int cut_selected(const CutSpec *spec, size_t *cursor, size_t index) {
+    while (*cursor < spec->count && spec->ranges[*cursor].high < index) (*cursor)++;
+    int inside = *cursor < spec->count && spec->ranges[*cursor].low <= index;
+    return spec->complement ? !inside : inside;
+}
+
+static int cut_done(const CutSpec *spec, size_t cursor) {
+    return !spec->complement && cursor >= spec->count;
+}
+
+static void cut_bytes(const CutSpec *spec, const char *line, size_t length, StrBuf *out) {
+    size_t cursor = 0;
+    int printed = 0;
+    int gap = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!cut_selected(spec, &cursor, i + 1)) {
+            gap = printed;
+            if (cut_done(spec, cursor)) break;
+            continue;
+        }
+        if (gap && spec->explicit_output) sb_puts(out, spec->output_delimiter);
+        gap = 0;
+        sb_putc(out, line[i]);
+        printed = 1;
+    }
+}
+
+static void cut_fields(const CutSpec *spec, const char *line, size_t length, StrBuf *out) {
+    const char *end = line + length;
+    const char *field = line;
+    size_t cursor = 0;
+    size_t index = 1;
+    int printed = 0;
+
+    while (field <= end) {
+        const char *stop = memchr(field, spec->delimiter, (size_t)(end - field));
+        if (!stop) stop = end;
+        if (cut_selected(spec, &cursor, index)) {
+            if (printed) sb_puts(out, spec->output_delimiter);
+            sb_putn(out, field, (size_t)(stop - field));
+            printed = 1;
+        } else if (cut_done(spec, cursor)) {
+            break;
+        }
+        field = stop + 1;
+        index++;
+    }
+}
+
+static void cut_flush(CutSpec *spec) {
+    if (spec->out.len) out_write(spec->out.data, spec->out.len);
+    sb_clear(&spec->out);
+}
+
+static void cut_line(const char *line, size_t length, int ended, void *context) {
+    (void)ended;
+    CutSpec *spec = context;
+
+    if (spec->bytes) {
+        cut_bytes(spec, line, length, &spec->out);
+    } else if (!memchr(line, spec->delimiter, length)) {
+        if (spec->only_delimited) return;
+        sb_putn(&spec->out, line, length);
+    } else {
+        cut_fields(spec, line, length, &spec->out);
+    }
+    sb_putc(&spec->out, '\n');
+    if (spec->out.len >= BLOCK_SIZE) cut_flush(spec);
+}
+
 static int core_cut(int argc, char **argv) {
-    char delimiter = '\t';
-    int field = 0;
+    CutSpec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.delimiter = '\t';
+    const char *list = NULL;
+    const char *delimiter = NULL;
     int start = argc;
+    int status = 0;
 
     for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) delimiter = argv[++i][0];
-        else if (strncmp(argv[i], "-d", 2) == 0 && argv[i][2]) delimiter = argv[i][2];
-        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) field = atoi(argv[++i]);
-        else if (strncmp(argv[i], "-f", 2) == 0 && argv[i][2]) field = atoi(argv[i] + 2);
-        else if (argv[i][0] != '-') {
+        const char *arg = argv[i];
+        if (str_has_prefix(arg, "--output-delimiter")) {
+            const char *value = strchr(arg, '=');
+            spec.output_delimiter = value ? value + 1 : i + 1 < argc ? argv[++i] : "";
+            spec.explicit_output = 1;
+        } else if (strcmp(arg, "--complement") == 0) {
+            spec.complement = 1;
+        } else if (strcmp(arg, "--only-delimited") == 0) {
+            spec.only_delimited = 1;
+        } else if (strcmp(arg, "--") == 0) {
+            start = i + 1;
+            break;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            continue;
+        } else if (arg[0] == '-' && arg[1]) {
+            const char *flag = arg + 1;
+            while (*flag && !strchr("dfbc", *flag)) {
+                if (*flag == 's') spec.only_delimited = 1;
+                flag++;
+            }
+            if (!*flag) continue;
+            const char *value = flag[1] ? flag + 1 : i + 1 < argc ? argv[++i] : NULL;
+            if (!value) status = 2;
+            else if (*flag == 'd') delimiter = value;
+            else list = value;
+            if (*flag == 'b' || *flag == 'c') spec.bytes = 1;
+        } else {
             start = i;
             break;
         }
     }
-    if (field < 1) {
-        shell_error("cut: usage: cut -d C -f N [file...]");
+    if (delimiter) {
+        if (strlen(delimiter) > 1) {
+            shell_error("cut: the delimiter must be a single character");
+            return 2;
+        }
+        spec.delimiter = delimiter[0];
+    }
+    if (status || !list) {
+        shell_error("cut: usage: cut -f LIST [-d C] [-s] | -b LIST | -c LIST [file...]");
+        return 2;
+    }
+    if (!parse_cut_list(list, &spec)) {
+        shell_error("cut: %s: invalid list", list);
+        free(spec.ranges);
         return 2;
     }
 
-    StrList lines;
-    sl_init(&lines);
-    read_all_lines(argc, argv, start, &lines);
+    char delimiter_text[2] = {spec.delimiter, '\0'};
+    if (!spec.output_delimiter) spec.output_delimiter = spec.bytes ? "" : delimiter_text;
 
-    for (size_t i = 0; i < lines.len; i++) {
-        char *cursor = lines.items[i];
-        char *piece = NULL;
-        for (int f = 0; f < field; f++) {
-            piece = str_next_field(&cursor, delimiter);
-            if (!piece) break;
+    sb_init(&spec.out);
+    int index = start;
+    do {
+        FILE *f = open_input(index < argc ? argv[index] : NULL);
+        if (!f) {
+            status = 1;
+        } else {
+            each_line(f, cut_line, &spec);
+            cut_flush(&spec);
+            close_input(f);
         }
-        if (piece) printf("%s\n", piece);
+        index++;
+    } while (index < argc);
+
+    sb_free(&spec.out);
+    free(spec.ranges);
+    return status;
+}
+
+static int add_set_class(const char **p, StrBuf *out) {
+    static const struct {
+        const char *name;
+        int (*test)(int);
+    } CLASSES[] = {
+        {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+        {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+        {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+    };
+    if ((*p)[0] != '[' || (*p)[1] != ':') return 0;
+    const char *close = strstr(*p + 2, ":]");
+    if (!close) return 0;
+
+    size_t length = (size_t)(close - (*p + 2));
+    for (size_t i = 0; i < sizeof(CLASSES) / sizeof(CLASSES[0]); i++) {
+        if (strlen(CLASSES[i].name) != length || strncmp(CLASSES[i].name, *p + 2, length) != 0)
+            continue;
+        for (int c = 0; c < 256; c++)
+            if (CLASSES[i].test(c)) sb_putc(out, (char)c);
+        *p = close + 1;
+        return 1;
     }
-    sl_free(&lines);
     return 0;
 }
 
@@ -402,6 +997,7 @@ static char *expand_set(const char *spec, size_t *length_out) {
 
     for (const char *p = spec; *p; p++) {
         char c = *p;
+        if (add_set_class(&p, &out)) continue;
         if (c == '\\' && p[1]) {
             p++;
             switch (*p) {
@@ -416,7 +1012,7 @@ static char *expand_set(const char *spec, size_t *length_out) {
             continue;
         }
         if (p[1] == '-' && p[2] && p[2] != '-' && (unsigned char)p[2] >= (unsigned char)c) {
-            for (unsigned char step = (unsigned char)c; step <= (unsigned char)p[2]; step++)
+            for (unsigned step = (unsigned char)c; step <= (unsigned char)p[2]; step++)
                 sb_putc(&out, (char)step);
             p += 2;
             continue;
@@ -428,11 +1024,42 @@ static char *expand_set(const char *spec, size_t *length_out) {
     return sb_take(&out);
 }
 
+static void set_bits(unsigned char *bits, const char *set, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)set[i];
+        bits[c >> 3] |= (unsigned char)(1 << (c & 7));
+    }
+}
+
+static char *complement_set(const char *set, size_t length, size_t *length_out) {
+    unsigned char bits[32] = {0};
+    set_bits(bits, set, length);
+    char *out = xmalloc(256);
+    size_t n = 0;
+    for (int c = 0; c < 256; c++)
+        if (!((bits[c >> 3] >> (c & 7)) & 1)) out[n++] = (char)c;
+    *length_out = n;
+    return out;
+}
+
 static int core_tr(int argc, char **argv) {
-    int deleting = flag_set(argc, argv, 'd');
-    int index = first_operand(argc, argv);
+    int deleting = 0;
+    int squeezing = 0;
+    int complement = 0;
+    int index = 1;
+    for (; index < argc && argv[index][0] == '-' && argv[index][1]; index++) {
+        if (strcmp(argv[index], "--") == 0) {
+            index++;
+            break;
+        }
+        for (const char *flag = argv[index] + 1; *flag; flag++) {
+            if (*flag == 'd') deleting = 1;
+            else if (*flag == 's') squeezing = 1;
+            else if (*flag == 'c' || *flag == 'C') complement = 1;
+        }
+    }
     if (index >= argc) {
-        shell_error("tr: usage: tr [-d] SET1 [SET2]");
+        shell_error("tr: usage: tr [-cds] SET1 [SET2]");
         return 2;
     }
 
@@ -440,25 +1067,41 @@ static int core_tr(int argc, char **argv) {
     size_t to_length = 0;
     char *from = expand_set(argv[index], &from_length);
     char *to = expand_set(index + 1 < argc ? argv[index + 1] : "", &to_length);
+    if (complement) {
+        char *inverted = complement_set(from, from_length, &from_length);
+        free(from);
+        from = inverted;
+    }
 
-    int c;
-    while ((c = fgetc(stdin)) != EOF) {
-        size_t position = from_length;
-        for (size_t i = 0; i < from_length; i++) {
-            if ((unsigned char)from[i] == (unsigned char)c) {
-                position = i;
-                break;
-            }
-        }
+    FreshTranslation translation;
+    memset(&translation, 0, sizeof(translation));
+    for (int c = 0; c < 256; c++) translation.map[c] = (unsigned char)c;
+
+    if (deleting || (!squeezing && to_length == 0)) {
+        set_bits(translation.dropped, from, from_length);
+        translation.mode |= FRESH_TRANSLATE_DELETE;
+    } else if (to_length) {
+        for (size_t i = 0; i < from_length; i++)
+            translation.map[(unsigned char)from[i]] =
+                (unsigned char)to[i < to_length ? i : to_length - 1];
+    }
+    if (squeezing) {
+        int squeeze_second = to_length > 0;
+        set_bits(translation.squeezed, squeeze_second ? to : from,
+                 squeeze_second ? to_length : from_length);
+        translation.mode |= FRESH_TRANSLATE_SQUEEZE;
+    }
 
-        if (position == from_length) {
-            fputc(c, stdout);
-            continue;
-        }
-        if (deleting || to_length == 0) continue;
-        fputc(to[position < to_length ? position : to_length - 1], stdout);
+    unsigned char *block = xmalloc(BLOCK_SIZE);
+    unsigned char *out = xmalloc(BLOCK_SIZE);
+    size_t read;
+    while ((read = fread(block, 1, BLOCK_SIZE, stdin)) > 0) {
+        size_t written = core_translate_block(block, read, out, &translation);
+        if (out_write((const char *)out, written) != written) break;
     }
 
+    free(block);
+    free(out);
     free(from);
     free(to);
     return 0;
@@ -468,23 +1111,36 @@ static int core_tee(int argc, char **argv) {
     int append = flag_set(argc, argv, 'a');
     int start = first_operand(argc, argv);
     int count = argc - start;
+    int status = 0;
 
     FILE **files = count > 0 ? xmalloc((size_t)count * sizeof(FILE *)) : NULL;
     for (int i = 0; i < count; i++) {
         files[i] = fopen(argv[start + i], append ? "ab" : "wb");
-        if (!files[i]) shell_error("tee: %s: cannot open", argv[start + i]);
+        if (!files[i]) {
+            shell_error("tee: %s: cannot open", argv[start + i]);
+            status = 1;
+        }
     }
 
-    int c;
-    while ((c = fgetc(stdin)) != EOF) {
-        fputc(c, stdout);
-        for (int i = 0; i < count; i++)
-            if (files[i]) fputc(c, files[i]);
+    out_flush();
+    char *buffer = xmalloc(COPY_SIZE);
+    int n;
+    while ((n = _read(_fileno(stdin), buffer, COPY_SIZE)) > 0) {
+        out_write(buffer, (size_t)n);
+        out_flush();
+        for (int i = 0; i < count; i++) {
+            if (!files[i] || fwrite(buffer, 1, (size_t)n, files[i]) == (size_t)n) continue;
+            shell_error("tee: %s: write failed", argv[start + i]);
+            fclose(files[i]);
+            files[i] = NULL;
+            status = 1;
+        }
     }
+    free(buffer);
     for (int i = 0; i < count; i++)
         if (files[i]) fclose(files[i]);
     free(files);
-    return 0;
+    return status;
 }
 
 typedef struct {
@@ -572,29 +1228,147 @@ static int core_rm(int argc, char **argv) {
     return status;
 }
 
-static int copy_recursive(const char *source, const char *destination) {
-    if (!path_is_dir(source)) return CopyFileA(source, destination, FALSE) ? 0 : 1;
+#define COPY_WORKERS 8
+#define UNBUFFERED_COPY (256LL << 20)
+
+typedef struct {
+    StrList sources;
+    StrList targets;
+    StrList directories;
+    StrList directory_targets;
+    char *failed;
+    volatile LONG next;
+    int preserve;
+    int update;
+} CopyPlan;
+
+static long long attribute_size(const WIN32_FILE_ATTRIBUTE_DATA *info) {
+    return (long long)(((unsigned long long)info->nFileSizeHigh << 32) | info->nFileSizeLow);
+}
+
+static int copy_times(const char *source, const char *target, int directory) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(source, GetFileExInfoStandard, &info)) return 0;
+    HANDLE handle = CreateFileA(target, FILE_WRITE_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, directory ? FILE_FLAG_BACKUP_SEMANTICS : 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return 0;
+    BOOL done = SetFileTime(handle, &info.ftCreationTime, &info.ftLastAccessTime,
+                            &info.ftLastWriteTime);
+    CloseHandle(handle);
+    return done != 0;
+}
+
+static int copy_file(const char *source, const char *target, int preserve, int update) {
+    WIN32_FILE_ATTRIBUTE_DATA from;
+    if (!GetFileAttributesExA(source, GetFileExInfoStandard, &from)) return 1;
+
+    WIN32_FILE_ATTRIBUTE_DATA to;
+    if (update && GetFileAttributesExA(target, GetFileExInfoStandard, &to) &&
+        attribute_size(&to) == attribute_size(&from) &&
+        CompareFileTime(&to.ftLastWriteTime, &from.ftLastWriteTime) >= 0)
+        return 0;
+
+    DWORD flags = attribute_size(&from) >= UNBUFFERED_COPY ? COPY_FILE_NO_BUFFERING : 0;
+    if (!CopyFileExA(source, target, NULL, NULL, NULL, flags)) return 1;
+    return preserve && !copy_times(source, target, 0);
+}
+
+static int plan_tree(CopyPlan *plan, const char *source, const char *destination) {
+    if (!path_mkdirs(destination)) {
+        shell_error("cp: %s: cannot create", destination);
+        return 1;
+    }
+    sl_push_copy(&plan->directories, source);
+    sl_push_copy(&plan->directory_targets, destination);
 
-    path_mkdirs(destination);
     char pattern[PATH_BUF];
     snprintf(pattern, sizeof(pattern), "%s\\*", source);
     WIN32_FIND_DATAA data;
     HANDLE find = FindFirstFileA(pattern, &data);
-    if (find == INVALID_HANDLE_VALUE) return 1;
+    if (find == INVALID_HANDLE_VALUE) {
+        shell_error("cp: %s: cannot copy", source);
+        return 1;
+    }
 
     int status = 0;
     do {
         if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
         char *from = path_join(source, data.cFileName);
         char *to = path_join(destination, data.cFileName);
-        status |= copy_recursive(from, to);
-        free(from);
-        free(to);
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            status |= plan_tree(plan, from, to);
+            free(from);
+            free(to);
+        } else {
+            sl_push(&plan->sources, from);
+            sl_push(&plan->targets, to);
+        }
     } while (FindNextFileA(find, &data));
     FindClose(find);
     return status;
 }
 
+static DWORD WINAPI copy_worker(LPVOID context) {
+    CopyPlan *plan = context;
+    LONG index;
+    while ((index = InterlockedIncrement(&plan->next) - 1) < (LONG)plan->sources.len) {
+        plan->failed[index] = (char)copy_file(plan->sources.items[index],
+                                              plan->targets.items[index], plan->preserve,
+                                              plan->update);
+    }
+    return 0;
+}
+
+static int copy_tree(const char *source, const char *destination, int preserve, int update) {
+    CopyPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    sl_init(&plan.sources);
+    sl_init(&plan.targets);
+    sl_init(&plan.directories);
+    sl_init(&plan.directory_targets);
+    plan.preserve = preserve;
+    plan.update = update;
+    int status = plan_tree(&plan, source, destination);
+
+    size_t count = plan.sources.len;
+    plan.failed = xmalloc(count + 1);
+    memset(plan.failed, 0, count + 1);
+
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    size_t workers = system.dwNumberOfProcessors;
+    if (workers > COPY_WORKERS) workers = COPY_WORKERS;
+    if (workers > count) workers = count;
+
+    HANDLE threads[COPY_WORKERS];
+    size_t started = 0;
+    for (size_t i = 1; i < workers; i++) {
+        threads[started] = CreateThread(NULL, 0, copy_worker, &plan, 0, NULL);
+        if (threads[started]) started++;
+    }
+    copy_worker(&plan);
+    if (started) WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
+    for (size_t i = 0; i < started; i++) CloseHandle(threads[i]);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!plan.failed[i]) continue;
+        shell_error("cp: %s: cannot copy", plan.sources.items[i]);
+        status = 1;
+    }
+    if (preserve) {
+        for (size_t i = plan.directories.len; i-- > 0;)
+            copy_times(plan.directories.items[i], plan.directory_targets.items[i], 1);
+    }
+
+    free(plan.failed);
+    sl_free(&plan.sources);
+    sl_free(&plan.targets);
+    sl_free(&plan.directories);
+    sl_free(&plan.directory_targets);
+    return status;
+}
+
 static void resolve_destination(const char *destination, const char *source, char *out,
                                 size_t out_size) {
     if (!path_is_dir(destination)) {
@@ -613,10 +1387,13 @@ static void resolve_destination(const char *destination, const char *source, cha
 }
 
 static int core_cp(int argc, char **argv) {
-    int recursive = flag_set(argc, argv, 'r') || flag_set(argc, argv, 'R');
+    int archive = flag_set(argc, argv, 'a');
+    int recursive = archive || flag_set(argc, argv, 'r') || flag_set(argc, argv, 'R');
+    int preserve = archive || flag_set(argc, argv, 'p');
+    int update = flag_set(argc, argv, 'u');
     int start = first_operand(argc, argv);
     if (argc - start < 2) {
-        shell_error("cp: usage: cp [-r] source... destination");
+        shell_error("cp: usage: cp [-rpua] source... destination");
         return 2;
     }
     const char *destination = argv[argc - 1];
@@ -635,8 +1412,8 @@ static int core_cp(int argc, char **argv) {
                 status = 1;
                 continue;
             }
-            status |= copy_recursive(source, target);
-        } else if (!CopyFileA(source, target, FALSE)) {
+            status |= copy_tree(source, target, preserve, update);
+        } else if (copy_file(source, target, preserve, update) != 0) {
             shell_error("cp: %s: cannot copy", argv[i]);
             status = 1;
         }
@@ -645,9 +1422,10 @@ static int core_cp(int argc, char **argv) {
 }
 
 static int core_mv(int argc, char **argv) {
+    int update = flag_set(argc, argv, 'u');
     int start = first_operand(argc, argv);
     if (argc - start < 2) {
-        shell_error("mv: usage: mv source... destination");
+        shell_error("mv: usage: mv [-u] source... destination");
         return 2;
     }
     const char *destination = argv[argc - 1];
@@ -660,10 +1438,21 @@ static int core_mv(int argc, char **argv) {
         snprintf(source, sizeof(source), "%s", argv[i]);
         path_to_backslashes(source);
 
-        if (!MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
-            shell_error("mv: %s: cannot move", argv[i]);
-            status = 1;
-        }
+        WIN32_FILE_ATTRIBUTE_DATA from;
+        WIN32_FILE_ATTRIBUTE_DATA to;
+        if (update && GetFileAttributesExA(source, GetFileExInfoStandard, &from) &&
+            GetFileAttributesExA(target, GetFileExInfoStandard, &to) &&
+            CompareFileTime(&to.ftLastWriteTime, &from.ftLastWriteTime) >= 0)
+            continue;
+
+        if (MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED))
+            continue;
+        if (GetLastError() == ERROR_NOT_SAME_DEVICE && path_is_dir(source) &&
+            copy_tree(source, target, 1, 0) == 0 &&
+            remove_recursive(source) == 0)
+            continue;
+        shell_error("mv: %s: cannot move", argv[i]);
+        status = 1;
     }
     return status;
 }
@@ -741,7 +1530,7 @@ static int core_basename(int argc, char **argv) {
     snprintf(result, sizeof(result), "%s", leaf);
     if (argc > 2 && str_has_suffix_i(result, argv[2]))
         result[strlen(result) - strlen(argv[2])] = '\0';
-    printf("%s\n", result);
+    out_printf("%s\n", result);
     return 0;
 }
 
@@ -759,13 +1548,13 @@ static int core_dirname(int argc, char **argv) {
 
     char *leaf = strrchr(native, '\\');
     if (!leaf) {
-        printf(".\n");
+        out_puts(".\n");
         return 0;
     }
     if (leaf == native) leaf[1] = '\0';
     else *leaf = '\0';
     path_to_slashes(native);
-    printf("%s\n", native);
+    out_printf("%s\n", native);
     return 0;
 }
 
@@ -789,8 +1578,8 @@ static int core_seq(int argc, char **argv) {
     if (increment == 0) return 1;
 
     for (double value = first; increment > 0 ? value <= last : value >= last; value += increment) {
-        if (value == (long long)value) printf("%lld\n", (long long)value);
-        else printf("%g\n", value);
+        if (value == (long long)value) out_printf("%lld\n", (long long)value);
+        else out_printf("%g\n", value);
     }
     return 0;
 }
@@ -801,7 +1590,7 @@ static int core_env(int argc, char **argv) {
         StrList list;
         sl_init(&list);
         vars_list(&list);
-        for (size_t i = 0; i < list.len; i++) printf("%s\n", list.items[i]);
+        for (size_t i = 0; i < list.len; i++) out_printf("%s\n", list.items[i]);
         sl_free(&list);
         return 0;
     }
@@ -825,13 +1614,14 @@ static int core_date(int argc, char **argv) {
 
     char buffer[512];
     strftime(buffer, sizeof(buffer), format, local);
-    printf("%s\n", buffer);
+    out_printf("%s\n", buffer);
     return 0;
 }
 
 static int core_sleep(int argc, char **argv) {
     if (argc < 2) return 0;
     double seconds = atof(argv[1]);
+    out_flush();
     if (seconds > 0) Sleep((DWORD)(seconds * 1000));
     return 0;
 }
@@ -842,7 +1632,7 @@ static int core_whoami(int argc, char **argv) {
     char user[256];
     DWORD size = sizeof(user);
     if (!win_user_name(user, &size)) return 1;
-    printf("%s\n", user);
+    out_printf("%s\n", user);
     return 0;
 }
 
@@ -852,14 +1642,14 @@ static int core_hostname(int argc, char **argv) {
     char host[256];
     DWORD size = sizeof(host);
     if (!GetComputerNameA(host, &size)) return 1;
-    printf("%s\n", host);
+    out_printf("%s\n", host);
     return 0;
 }
 
 static int core_uname(int argc, char **argv) {
     int all = flag_set(argc, argv, 'a');
     if (!all) {
-        printf("Windows\n");
+        out_printf("Windows\n");
         return 0;
     }
     char host[256];
@@ -872,7 +1662,7 @@ static int core_uname(int argc, char **argv) {
         system.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_AMD64 ? "x86_64"
         : system.wProcessorArchitecture == PROCESSOR_ARCHITECTURE_ARM64 ? "arm64"
                                                                         : "x86";
-    printf("Windows %s %s\n", host, architecture);
+    out_printf("Windows %s %s\n", host, architecture);
     return 0;
 }
 
@@ -922,9 +1712,9 @@ static int core_du(int argc, char **argv) {
             value /= 1024;
             unit++;
         }
-        printf("%.1f%s\t%s\n", value, units[unit], target);
+        out_printf("%.1f%s\t%s\n", value, units[unit], target);
     } else {
-        printf("%llu\t%s\n", total / 1024, target);
+        out_printf("%llu\t%s\n", total / 1024, target);
     }
     return 0;
 }
@@ -947,7 +1737,7 @@ static void find_walk(const char *directory, const char *name_pattern, char type
             char shown[PATH_BUF];
             snprintf(shown, sizeof(shown), "%s", child);
             path_to_slashes(shown);
-            printf("%s\n", shown);
+            out_printf("%s\n", shown);
         }
         if (is_dir) find_walk(child, name_pattern, type);
         free(child);
@@ -1036,14 +1826,53 @@ static void printf_escapes(const char *s, StrBuf *out) {
     }
 }
 
-static int core_printf(int argc, char **argv) {
-    if (argc < 2) return 2;
+static int printf_destination(const char *name) {
+    if (!isalpha((unsigned char)*name) && *name != '_') return 0;
+    const char *p = name;
+    while (isalnum((unsigned char)*p) || *p == '_') p++;
+    if (*p == '[') {
+        const char *close = strchr(p, ']');
+        return close && close > p + 1 && close[1] == '\0';
+    }
+    return *p == '\0';
+}
+
+static void printf_assign(const char *destination, const char *value) {
+    const char *open = strchr(destination, '[');
+    if (!open) {
+        var_set(destination, value);
+        return;
+    }
+    char *name = xstrndup(destination, (size_t)(open - destination));
+    char *index = xstrndup(open + 1, strlen(open + 1) - 1);
+    var_set_element(name, index, value);
+    free(index);
+    free(name);
+}
 
+static int core_printf(int argc, char **argv) {
     const char *destination = NULL;
     int start = 1;
-    if (argc > 3 && strcmp(argv[1], "-v") == 0) {
-        destination = argv[2];
-        start = 3;
+    if (start < argc && strncmp(argv[start], "-v", 2) == 0) {
+        if (argv[start][2]) {
+            destination = argv[start] + 2;
+            start++;
+        } else if (start + 1 < argc) {
+            destination = argv[start + 1];
+            start += 2;
+        } else {
+            shell_error("printf: -v: option requires an argument");
+            return 2;
+        }
+        if (!printf_destination(destination)) {
+            shell_error("printf: `%s': not a valid identifier", destination);
+            return 2;
+        }
+    }
+    if (start < argc && strcmp(argv[start], "--") == 0) start++;
+    if (start >= argc) {
+        shell_error("printf: usage: printf [-v var] format [arguments]");
+        return 2;
     }
 
     const char *format = argv[start];
@@ -1144,8 +1973,8 @@ static int core_printf(int argc, char **argv) {
         }
     } while (next < argc && has_conversion);
 
-    if (destination) var_set(destination, rendered.data);
-    else fwrite(rendered.data, 1, rendered.len, stdout);
+    if (destination) printf_assign(destination, rendered.data);
+    else out_write(rendered.data, rendered.len);
     sb_free(&rendered);
     return 0;
 }
@@ -22,6 +22,7 @@
 #include "expand.h"
 #include "foreign.h"
 #include "parser.h"
+#include "pathindex.h"
 #include "regex.h"
 #include "rustcore.h"
 #include "style.h"
@@ -52,6 +53,7 @@ typedef struct {
     int extra_fd[EXTRA_FDS];
     int extra_saved[EXTRA_FDS];
     int extra_count;
+    Sink sink;
 } FdSave;
 
 static Table function_table;
@@ -61,6 +63,7 @@ static int tracked_count = 0;
 
 static StrList command_cache;
 static int command_cache_valid = 0;
+static unsigned long dispatch_generation = 1;
 
 static int exec_command(Node *node, IoSet io, int background, HANDLE *async_out);
 static int exec_pipeline(Node *node, int background);
@@ -108,6 +111,7 @@ static void temp_cleanup(void) {
 void exec_cleanup(void) {
     table_free(&function_table);
     sl_free(&command_cache);
+    path_index_release();
     resolutions_release();
     spools_close();
     temp_cleanup();
@@ -124,6 +128,7 @@ static Node *function_find(const char *name) {
 void function_define(const char *name, Node *body) {
     if (!function_table.buckets) table_init(&function_table, 32, 0, function_release);
     table_put(&function_table, name, body);
+    dispatch_generation++;
 }
 
 int function_defined(const char *name) {
@@ -131,6 +136,7 @@ int function_defined(const char *name) {
 }
 
 int function_undefine(const char *name) {
+    dispatch_generation++;
     return table_remove(&function_table, name);
 }
 
@@ -198,11 +204,19 @@ static void resolution_remember(const char *name, const char *path) {
 int resolve_command(const char *name, char *out, size_t out_size) {
     if (!name || !*name) return 0;
 
+    int qualified = strchr(name, '/') || strchr(name, '\\');
+    const char *remembered = qualified ? NULL : resolution_find(name);
+    if (remembered) {
+        if (!*remembered) return 0;
+        snprintf(out, out_size, "%s", remembered);
+        return 1;
+    }
+
     StrList extensions;
     sl_init(&extensions);
     pathext_list(&extensions);
 
-    if (strchr(name, '/') || strchr(name, '\\')) {
+    if (qualified) {
         char base[PATH_BUF];
         snprintf(base, sizeof(base), "%s", name);
         path_to_backslashes(base);
@@ -211,14 +225,6 @@ int resolve_command(const char *name, char *out, size_t out_size) {
         return found;
     }
 
-    const char *remembered = resolution_find(name);
-    if (remembered) {
-        sl_free(&extensions);
-        if (!*remembered) return 0;
-        snprintf(out, out_size, "%s", remembered);
-        return 1;
-    }
-
     const char *path = var_get("PATH");
     if (!path) {
         sl_free(&extensions);
@@ -244,7 +250,9 @@ int resolve_command(const char *name, char *out, size_t out_size) {
 
 void path_rehash(void) {
     command_cache_valid = 0;
+    path_index_invalidate();
     resolutions_forget();
+    dispatch_generation++;
 }
 
 typedef LSTATUS(WINAPI *RegOpenFn)(HKEY, LPCSTR, DWORD, REGSAM, PHKEY);
@@ -352,39 +360,14 @@ void path_reload_environment(void) {
     free(user);
     for (size_t i = 0; i < bin_count; i++) free(found[i]);
 
-    command_cache_valid = 0;
-    resolutions_forget();
-}
-
-static int is_command_extension(const StrList *extensions, const char *ext) {
-    for (size_t i = 0; i < extensions->len; i++) {
-        if (str_ieq(extensions->items[i], ext)) return 1;
-    }
-    return 0;
+    path_rehash();
 }
 
 static int compare_names_fold(const void *a, const void *b) {
     return _stricmp(*(const char *const *)a, *(const char *const *)b);
 }
 
-static void scan_directory(const char *dir, const StrList *extensions, StrList *out) {
-    char *pattern = path_join(dir, "*");
-    WIN32_FIND_DATAA data;
-    HANDLE find = FindFirstFileA(pattern, &data);
-    free(pattern);
-    if (find == INVALID_HANDLE_VALUE) return;
-
-    do {
-        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
-        const char *ext = path_ext(data.cFileName);
-        if (!*ext || !is_command_extension(extensions, ext)) continue;
-        sl_push(out, xstrndup(data.cFileName, strlen(data.cFileName) - strlen(ext)));
-    } while (FindNextFileA(find, &data));
-    FindClose(find);
-}
-
-static void ensure_command_cache(void) {
-    if (command_cache_valid) return;
+static void build_command_cache(int background) {
     sl_clear(&command_cache);
 
     const char *path = var_get("PATH");
@@ -392,14 +375,7 @@ static void ensure_command_cache(void) {
         StrList extensions;
         sl_init(&extensions);
         pathext_list(&extensions);
-
-        char *copy = xstrdup(path);
-        char *cursor = copy;
-        char *dir;
-        while ((dir = str_next_field(&cursor, ';')) != NULL) {
-            if (*dir) scan_directory(dir, &extensions, &command_cache);
-        }
-        free(copy);
+        path_index_commands(path, &extensions, background, &command_cache);
         sl_free(&extensions);
     }
 
@@ -409,6 +385,23 @@ static void ensure_command_cache(void) {
     command_cache_valid = 1;
 }
 
+static void ensure_command_cache(void) {
+    if (path_index_refreshed()) {
+        command_cache_valid = 0;
+        dispatch_generation++;
+    }
+    if (!command_cache_valid) build_command_cache(0);
+}
+
+unsigned long command_generation(void) {
+    ensure_command_cache();
+    return dispatch_generation;
+}
+
+void path_commands_prepare(void) {
+    if (!command_cache_valid) build_command_cache(1);
+}
+
 static size_t cache_lower_bound(const char *name, size_t prefix_length) {
     size_t low = 0;
     size_t high = command_cache.len;
@@ -494,6 +487,7 @@ static int io_is_default(const IoSet *io) {
 }
 
 static void discard_stdin_buffer(void) {
+    read_buffer_reset();
     fflush(stdin);
     setvbuf(stdin, NULL, _IOFBF, BUFSIZ);
 }
@@ -526,6 +520,10 @@ static void fds_apply(const IoSet *io, FdSave *save) {
             _close(fd);
         }
     }
+    if (save->saved[1] >= 0) {
+        sink_file(&save->sink, stdout);
+        out_push(&save->sink);
+    }
 
     save->extra_count = 0;
     for (int i = 0; i < io->extra_count; i++) {
@@ -559,6 +557,7 @@ static void fds_apply(const IoSet *io, FdSave *save) {
 static void fds_restore(FdSave *save) {
     fflush(stdout);
     fflush(stderr);
+    if (save->saved[1] >= 0) out_pop(&save->sink);
     if (save->saved[0] >= 0) discard_stdin_buffer();
     for (int i = 0; i < 3; i++) {
         if (save->saved[i] < 0) continue;
@@ -609,6 +608,7 @@ static int io_assign(IoSet *io, int fd, HANDLE handle) {
 }
 
 static void fds_discard(FdSave *save) {
+    if (save->saved[1] >= 0) out_pop(&save->sink);
     for (int i = 0; i < 3; i++) {
         if (save->saved[i] >= 0) _close(save->saved[i]);
         save->saved[i] = -1;
@@ -769,7 +769,7 @@ static int apply_redirs(Redir *redirs, IoSet *io) {
     return 1;
 }
 
-static void quote_argument(StrBuf *sb, const char *arg) {
+void quote_argument(StrBuf *sb, const char *arg) {
     if (*arg && !strpbrk(arg, " \t\"")) {
         sb_puts(sb, arg);
         return;
@@ -820,6 +820,57 @@ static int is_shell_script(const char *path) {
     return strstr(head, "sh") != NULL;
 }
 
+typedef struct {
+    Node *function;
+    BuiltinFn builtin;
+    BuiltinFn fallback;
+    int resolved;
+    int script;
+    char path[PATH_BUF];
+} Target;
+
+struct Dispatch {
+    unsigned long generation;
+    Target target;
+    char name[];
+};
+
+static void target_resolve(const char *name, int functions, Target *out) {
+    out->function = functions ? function_find(name) : NULL;
+    out->builtin = out->function ? NULL : builtin_lookup(name);
+    out->fallback = NULL;
+    out->resolved = 0;
+    out->script = 0;
+    out->path[0] = '\0';
+    if (out->function || out->builtin) return;
+
+    if (!coreutil_preferred(name)) out->resolved = resolve_command(name, out->path, sizeof(out->path));
+    if (out->resolved) out->script = is_shell_script(out->path);
+    else out->fallback = coreutil_lookup(name);
+}
+
+static const Target *target_for(Node *node, const char *name, Target *scratch) {
+    int functions = !skip_functions;
+    Dispatch *dispatch = node->dispatch;
+    if (!functions || strpbrk(name, "/\\") || (dispatch && strcmp(dispatch->name, name) != 0)) {
+        target_resolve(name, functions, scratch);
+        return scratch;
+    }
+
+    if (!dispatch) {
+        size_t length = strlen(name);
+        dispatch = xmalloc(sizeof(Dispatch) + length + 1);
+        memcpy(dispatch->name, name, length + 1);
+        dispatch->generation = 0;
+        node->dispatch = dispatch;
+    }
+    if (dispatch->generation != dispatch_generation) {
+        target_resolve(name, 1, &dispatch->target);
+        dispatch->generation = dispatch_generation;
+    }
+    return &dispatch->target;
+}
+
 static HANDLE spawn_process(char *command_line, IoSet *io, int *status) {
     STARTUPINFOA si;
     PROCESS_INFORMATION pi;
@@ -838,7 +889,8 @@ static HANDLE spawn_process(char *command_line, IoSet *io, int *status) {
     fflush(stdout);
     fflush(stderr);
 
-    if (!CreateProcessA(NULL, command_line, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+    if (!CreateProcessA(NULL, command_line, NULL, NULL, TRUE, 0, vars_environment(), NULL, &si,
+                        &pi)) {
         DWORD error = GetLastError();
         if (error == ERROR_ACCESS_DENIED) shell_error("permission denied");
         else shell_error("failed to start process (error %lu)", error);
@@ -877,6 +929,23 @@ static void assign_from_word(char *word) {
         char *close = memchr(open, ']', (size_t)(name_end - open));
         char *index = xstrndup(open + 1, close ? (size_t)(close - open - 1) : 0);
         char *resolved = expand_single(index);
+        char *end;
+        strtol(resolved, &end, 10);
+        if (var_kind(name) != VAR_ASSOC && (end == resolved || *end)) {
+            int ok = 1;
+            long number = eval_arith(resolved, &ok);
+            if (!ok) {
+                shell_error("%s[%s]: bad array subscript", name, resolved);
+                free(resolved);
+                free(index);
+                free(name);
+                return;
+            }
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%ld", number);
+            free(resolved);
+            resolved = xstrdup(buffer);
+        }
 
         if (append) {
             const char *previous = var_get_element(name, resolved);
@@ -1036,8 +1105,7 @@ static int substitute_processes(StrList *words, Substitution *pending, int max)
         pending[count].command = command;
         count++;
 
-        free(words->items[i]);
-        words->items[i] = xstrdup(file);
+        words->items[i] = expand_scratch_copy(file);
     }
     return count;
 }
@@ -1180,7 +1248,153 @@ static void background_preamble(StrBuf *out) {
     sl_free(&names);
 }
 
+typedef struct {
+    HANDLE source;
+    StrBuf *out;
+} Drain;
+
+static DWORD WINAPI drain_pipe(LPVOID parameter) {
+    Drain *drain = parameter;
+    char buffer[8192];
+    DWORD read = 0;
+
+    while (ReadFile(drain->source, buffer, sizeof(buffer), &read, NULL) && read > 0)
+        sb_putn(drain->out, buffer, read);
+    return 0;
+}
+
+typedef struct Capture {
+    Sink sink;
+    Drain drain;
+    HANDLE target;
+    HANDLE reader;
+    int saved_out;
+    struct Capture *outer;
+} Capture;
+
+static Capture *capture_top = NULL;
+
+static const char *REAL_STDOUT_COMMANDS[] = {"exec",  "builtin", "clear", "cmd",      "ps1",
+                                             "fresh", "theme",   "plugin", "describe", "help",
+                                             "jobs",  "fg",      "bg",    "stop",     "wait",
+                                             "admin", "open",    NULL};
+
+static void capture_drain(Sink *sink) {
+    Capture *capture = sink->context;
+    DWORD written = 0;
+    if (sink->buffer->len)
+        WriteFile(capture->target, sink->buffer->data, (DWORD)sink->buffer->len, &written, NULL);
+    sb_clear(sink->buffer);
+}
+
+static void capture_begin(Capture *capture, StrBuf *out, HANDLE target) {
+    memset(capture, 0, sizeof(*capture));
+    sink_buffer(&capture->sink, out);
+    capture->sink.context = capture;
+    if (target) {
+        capture->sink.limit = 65536;
+        capture->sink.drain = capture_drain;
+    }
+    capture->drain.out = out;
+    capture->target = target;
+    capture->saved_out = -1;
+    capture->outer = capture_top;
+    capture_top = capture;
+    out_push(&capture->sink);
+}
+
+static void capture_end(Capture *capture) {
+    if (capture->saved_out >= 0) {
+        fflush(stdout);
+        _dup2(capture->saved_out, 1);
+        _close(capture->saved_out);
+    }
+    if (capture->reader) {
+        WaitForSingleObject(capture->reader, INFINITE);
+        CloseHandle(capture->reader);
+    }
+    if (capture->drain.source) CloseHandle(capture->drain.source);
+    if (capture->target && capture->sink.buffer) capture_drain(&capture->sink);
+
+    capture_top = capture->outer;
+    out_pop(&capture->sink);
+}
+
+static int capture_inline(void) {
+    return capture_top && capture_top->saved_out < 0;
+}
+
+static void capture_spill(IoSet *io) {
+    Capture *capture = capture_top;
+    if (!capture || capture->saved_out >= 0) return;
+
+    HANDLE write_end = NULL;
+    if (capture->target) {
+        capture_drain(&capture->sink);
+        if (!DuplicateHandle(GetCurrentProcess(), capture->target, GetCurrentProcess(), &write_end,
+                             0, FALSE, DUPLICATE_SAME_ACCESS)) {
+            shell_error("cannot hand the capture to a command (error %lu)", GetLastError());
+            return;
+        }
+    } else {
+        SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+        if (!CreatePipe(&capture->drain.source, &write_end, &sa, 65536)) {
+            shell_error("cannot hand the capture to a command (error %lu)", GetLastError());
+            capture->drain.source = NULL;
+            return;
+        }
+    }
+
+    int fd = _open_osfhandle((intptr_t)write_end, _O_WRONLY | _O_BINARY);
+    if (fd < 0) {
+        shell_error("cannot hand the capture to a command");
+        CloseHandle(write_end);
+        return;
+    }
+
+    HANDLE before = GetStdHandle(STD_OUTPUT_HANDLE);
+    fflush(stdout);
+    capture->saved_out = _dup(1);
+    _dup2(fd, 1);
+    _close(fd);
+    Sink *outer = capture->sink.outer;
+    sink_file(&capture->sink, stdout);
+    capture->sink.outer = outer;
+
+    if (capture->drain.source)
+        capture->reader = CreateThread(NULL, 0, drain_pipe, &capture->drain, 0, NULL);
+
+    HANDLE after = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (io && io->out == before) io->out = after;
+    if (io && io->err == before) io->err = after;
+}
+
+void capture_use_pipe(void) {
+    capture_spill(NULL);
+}
+
+static int runs_inline(Node *node, const StrList *words, int background) {
+    if (node->redirs || background) return 0;
+
+    size_t first = 0;
+    while (first < words->len && is_assignment(words->items[first])) {
+        if (str_has_prefix(words->items[first], "PATH=")) return 0;
+        first++;
+    }
+    if (first == words->len) return 1;
+
+    const char *name = words->items[first];
+    Target scratch;
+    const Target *target = target_for(node, name, &scratch);
+    if (target->function) return 1;
+    for (int i = 0; REAL_STDOUT_COMMANDS[i]; i++) {
+        if (strcmp(REAL_STDOUT_COMMANDS[i], name) == 0) return 0;
+    }
+    return target->builtin || target->fallback;
+}
+
 static int exec_background_child(Node *node) {
+    capture_spill(NULL);
     StrBuf source;
     sb_init(&source);
     background_preamble(&source);
@@ -1228,7 +1442,8 @@ static int exec_background_child(Node *node) {
     memset(&pi, 0, sizeof(pi));
     si.cb = sizeof(si);
 
-    if (!CreateProcessA(NULL, command_line.data, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+    if (!CreateProcessA(NULL, command_line.data, NULL, NULL, TRUE, 0, vars_environment(), NULL,
+                        &si, &pi)) {
         shell_error("could not start the background job");
         sb_free(&command_line);
         return 1;
@@ -1244,13 +1459,16 @@ static int exec_simple(Node *node, IoSet io, int background, HANDLE *async_out)
     sl_init(&words);
     if (node->line > 0) shell.line = node->line;
     expand_forget_substitution_status();
-    expand_words(&node->words, &words);
+    size_t scratch = expand_scratch_mark();
+    expand_command(&node->words, node->info, &words);
 
     Substitution pending[8];
     int substitutions = substitute_processes(&words, pending, 8);
+    if (capture_inline() && !runs_inline(node, &words, background)) capture_spill(&io);
 
     if (!apply_redirs(node->redirs, &io)) {
-        sl_free(&words);
+        sl_free_borrowed(&words);
+        expand_scratch_reset(scratch);
         return 1;
     }
 
@@ -1259,7 +1477,8 @@ static int exec_simple(Node *node, IoSet io, int background, HANDLE *async_out)
 
     if (first == words.len) {
         for (size_t i = 0; i < words.len; i++) assign_from_word(words.items[i]);
-        sl_free(&words);
+        sl_free_borrowed(&words);
+        expand_scratch_reset(scratch);
         return expand_substitution_status();
     }
 
@@ -1300,25 +1519,22 @@ static int exec_simple(Node *node, IoSet io, int background, HANDLE *async_out)
         shell.trap_debug = handler;
     }
 
-    Node *f = skip_functions ? NULL : function_find(argv[0]);
+    Target lookup;
+    const Target *target = target_for(node, argv[0], &lookup);
     if (skip_functions) skip_functions--;
-    BuiltinFn builtin = f ? NULL : builtin_lookup(argv[0]);
-
-    char path[PATH_BUF] = "";
-    BuiltinFn fallback = NULL;
-    int resolved = 0;
-
-    if (!f && !builtin) {
-        resolved = coreutil_preferred(argv[0]) ? 0 : resolve_command(argv[0], path, sizeof(path));
-        fallback = resolved ? NULL : coreutil_lookup(argv[0]);
-    }
+    Node *f = target->function;
+    BuiltinFn builtin = target->builtin;
+    BuiltinFn fallback = target->fallback;
+    int resolved = target->resolved;
+    char path[PATH_BUF];
+    snprintf(path, sizeof(path), "%s", target->path);
 
     if (!f && !builtin && !fallback && !resolved && argc == 1 &&
         option_enabled("FRESH_AUTOCD", 1) && path_is_dir(argv[0])) {
         char *arguments[2] = {"cd", argv[0]};
         BuiltinFn enter = builtin_lookup("cd");
         status = enter(2, arguments);
-    } else if (resolved && !is_shell_script(path)) {
+    } else if (resolved && !target->script) {
         status = run_program(path, argv, argc, &io, background, async_out);
     } else if (background) {
         status = exec_background_child(node);
@@ -1366,7 +1582,8 @@ static int exec_simple(Node *node, IoSet io, int background, HANDLE *async_out)
     if (argv != argv_local) free(argv);
     sl_free(&saved_names);
     sl_free(&saved_values);
-    sl_free(&words);
+    sl_free_borrowed(&words);
+    expand_scratch_reset(scratch);
     finish_substitutions(pending, substitutions);
     return status;
 }
@@ -1376,6 +1593,7 @@ static int exec_switch(Node *node);
 static int exec_command(Node *node, IoSet io, int background, HANDLE *async_out) {
     if (node->kind == N_SIMPLE) return exec_simple(node, io, background, async_out);
 
+    if (node->redirs) capture_spill(&io);
     if (!apply_redirs(node->redirs, &io)) return 1;
 
     FdSave save;
@@ -1392,11 +1610,12 @@ static int stage_runs_in_process(Node *node) {
 
     const char *word = node->words.items[0];
     if (strpbrk(word, "$`\"'\\*?")) return 0;
-    if (function_find(word) || builtin_lookup(word)) return 1;
 
-    char path[PATH_BUF];
-    if (resolve_command(word, path, sizeof(path))) return is_shell_script(path);
-    return coreutil_lookup(word) != NULL;
+    Target scratch;
+    const Target *target = target_for(node, word, &scratch);
+    if (target->function || target->builtin) return 1;
+    if (target->resolved) return target->script;
+    return target->fallback != NULL;
 }
 
 typedef struct {
@@ -1514,7 +1733,6 @@ static int exec_pipeline(Node *node, int background) {
                     shell_error("cannot create pipeline buffer");
                     break;
                 }
-                io.out = spool->handle;
             } else {
                 if (!CreatePipe(&read_end, &write_end, &sa, 0)) {
                     shell_error("cannot create pipe");
@@ -1527,7 +1745,17 @@ static int exec_pipeline(Node *node, int background) {
         }
 
         HANDLE spawned = NULL;
-        status = exec_command(stages[i], io, 0, &spawned);
+        if (spool) {
+            StrBuf buffered;
+            sb_init(&buffered);
+            Capture capture;
+            capture_begin(&capture, &buffered, spool->handle);
+            status = exec_command(stages[i], io, 0, &spawned);
+            capture_end(&capture);
+            sb_free(&buffered);
+        } else {
+            status = exec_command(stages[i], io, 0, &spawned);
+        }
         stage_status[i] = status;
         if (spawned) {
             proc_stage[process_count] = i;
@@ -2034,7 +2262,7 @@ int pattern_match(const char *pattern, const char *text) {
         if (*pattern == '*') {
             pattern++;
             if (!*pattern) return 1;
-            for (const char *p = text; *p || !*pattern; p++) {
+            for (const char *p = text;; p++) {
                 if (pattern_match(pattern, p)) return 1;
                 if (!*p) break;
             }
@@ -2298,25 +2526,26 @@ static int exec_switch(Node *node) {
     }
 
     case N_SELECT: {
+        capture_spill(NULL);
         StrList values;
         sl_init(&values);
         expand_words(&node->words, &values);
+        StrBuf line;
+        sb_init(&line);
 
         while (shell.running && !shell.returning) {
             for (size_t i = 0; i < values.len; i++)
-                printf("%2zu) %s\n", i + 1, values.items[i]);
-            printf("#? ");
-            fflush(stdout);
+                out_printf("%2zu) %s\n", i + 1, values.items[i]);
+            out_printf("#? ");
+            out_flush();
 
-            char line[256];
-            if (!fgets(line, sizeof(line), stdin)) break;
-            line[strcspn(line, "\r\n")] = '\0';
-            if (!*line) continue;
+            if (!read_line_fd(0, &line)) break;
+            if (!line.len) continue;
 
-            int choice = atoi(line);
+            int choice = atoi(line.data);
             if (choice < 1 || (size_t)choice > values.len) continue;
             var_set(node->name, values.items[choice - 1]);
-            var_set("REPLY", line);
+            var_set("REPLY", line.data);
 
             status = exec_node(node->right);
             if (shell.continue_level) shell.continue_level--;
@@ -2325,6 +2554,7 @@ static int exec_switch(Node *node) {
                 break;
             }
         }
+        sb_free(&line);
         sl_free(&values);
         break;
     }
@@ -2464,6 +2694,30 @@ int exec_subshell(const char *text) {
     return status;
 }
 
+static char *script_enter(const char *path) {
+    const char *leaf = strrchr(path, '/');
+    const char *back = strrchr(path, '\\');
+    if (back > leaf) leaf = back;
+    char *saved_name = shell.script_name;
+    shell.script_name = xstrdup(leaf ? leaf + 1 : path);
+    shell.depth++;
+    return saved_name;
+}
+
+static void script_leave(char *saved_name) {
+    shell.depth--;
+    shell.returning = 0;
+    free(shell.script_name);
+    shell.script_name = saved_name;
+}
+
+int exec_script_node(const char *path, Node *node) {
+    char *saved_name = script_enter(path);
+    int status = exec_node(node);
+    script_leave(saved_name);
+    return status;
+}
+
 int exec_script_file(const char *path, const StrList *args) {
     FILE *f = fopen(path, "rb");
     if (!f) {
@@ -2489,20 +2743,10 @@ int exec_script_file(const char *path, const StrList *args) {
         for (size_t i = 0; i < args->len; i++) sl_push_copy(&shell.params, args->items[i]);
     }
 
-    const char *leaf = strrchr(path, '/');
-    const char *back = strrchr(path, '\\');
-    if (back > leaf) leaf = back;
-    char *saved_name = shell.script_name;
-    shell.script_name = xstrdup(leaf ? leaf + 1 : path);
-
     int was_running = shell.running;
-    shell.depth++;
+    char *saved_name = script_enter(path);
     int status = exec_text(text);
-    shell.depth--;
-    shell.returning = 0;
-
-    free(shell.script_name);
-    shell.script_name = saved_name;
+    script_leave(saved_name);
 
     if (args) {
         if (!shell.running) {
@@ -2516,41 +2760,9 @@ int exec_script_file(const char *path, const StrList *args) {
     return status;
 }
 
-typedef struct {
-    HANDLE source;
-    StrBuf *out;
-} Drain;
-
-static DWORD WINAPI drain_pipe(LPVOID parameter) {
-    Drain *drain = parameter;
-    char buffer[8192];
-    DWORD read = 0;
-
-    while (ReadFile(drain->source, buffer, sizeof(buffer), &read, NULL) && read > 0)
-        sb_putn(drain->out, buffer, read);
-    return 0;
-}
-
 int capture_command(const char *command, StrBuf *out) {
-    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
-    HANDLE read_end = NULL;
-    HANDLE write_end = NULL;
-    if (!CreatePipe(&read_end, &write_end, &sa, 65536)) return 1;
-
-    int fd = _open_osfhandle((intptr_t)write_end, _O_WRONLY | _O_BINARY);
-    if (fd < 0) {
-        CloseHandle(read_end);
-        CloseHandle(write_end);
-        return 1;
-    }
-
-    fflush(stdout);
-    int saved_out = _dup(1);
-    _dup2(fd, 1);
-    _close(fd);
-
-    Drain drain = {read_end, out};
-    HANDLE reader = CreateThread(NULL, 0, drain_pipe, &drain, 0, NULL);
+    Capture capture;
+    capture_begin(&capture, out, NULL);
 
     char cwd[PATH_BUF];
     GetCurrentDirectoryA(sizeof(cwd), cwd);
@@ -2566,14 +2778,6 @@ int capture_command(const char *command, StrBuf *out) {
     vars_restore(snapshot);
     SetCurrentDirectoryA(cwd);
 
-    fflush(stdout);
-    _dup2(saved_out, 1);
-    _close(saved_out);
-
-    if (reader) {
-        WaitForSingleObject(reader, INFINITE);
-        CloseHandle(reader);
-    }
-    CloseHandle(read_end);
+    capture_end(&capture);
     return status;
 }
@@ -20,13 +20,18 @@ int exec_subshell(const char *text);
 void exec_keep_redirections(void);
 int exec_node(Node *node);
 int exec_script_file(const char *path, const StrList *args);
+int exec_script_node(const char *path, Node *node);
 int capture_command(const char *command, StrBuf *out);
+void quote_argument(StrBuf *sb, const char *arg);
+void capture_use_pipe(void);
 
 int resolve_command(const char *name, char *out, size_t out_size);
 void path_commands(StrList *out);
 int path_command_exists(const char *name);
 int path_command_prefix(const char *prefix);
+unsigned long command_generation(void);
 void path_command_complete(const char *prefix, StrList *out);
+void path_commands_prepare(void);
 void function_complete(const char *prefix, size_t length, StrList *out);
 void path_rehash(void);
 void path_reload_environment(void);
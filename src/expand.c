@@ -16,6 +16,8 @@
 #include "shell.h"
 #include "vars.h"
 
+#define ARENA_BLOCK 65536
+
 typedef struct {
     StrBuf field;
     int has_content;
@@ -23,11 +25,56 @@ typedef struct {
     int meta;
     int bracket;
     StrList *out;
+    int borrow;
     int split;
     int glob;
     int escape_meta;
 } Expander;
 
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t base;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+static ArenaBlock *arena = NULL;
+
+size_t expand_scratch_mark(void) {
+    return arena ? arena->base + arena->used : 0;
+}
+
+void expand_scratch_reset(size_t mark) {
+    while (arena && arena->next && arena->base >= mark) {
+        ArenaBlock *block = arena;
+        arena = block->next;
+        free(block);
+    }
+    if (arena) arena->used = mark - arena->base;
+}
+
+static char *arena_store(const char *text, size_t length) {
+    if (!arena || arena->size - arena->used < length + 1) {
+        size_t size = length + 1 > ARENA_BLOCK ? length + 1 : ARENA_BLOCK;
+        ArenaBlock *block = xmalloc(sizeof(ArenaBlock) + size);
+        block->next = arena;
+        block->base = expand_scratch_mark();
+        block->used = 0;
+        block->size = size;
+        arena = block;
+    }
+    char *copy = arena->data + arena->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    arena->used += length + 1;
+    return copy;
+}
+
+char *expand_scratch_copy(const char *text) {
+    return arena_store(text, strlen(text));
+}
+
 static const char *param_get(int index) {
     if (index < 0 || (size_t)index >= shell.params.len) return NULL;
     return shell.params.items[index];
@@ -35,15 +82,17 @@ static const char *param_get(int index) {
 
 static void field_flush(Expander *ex) {
     if (!ex->has_content) return;
-    char *value = xstrdup(ex->field.data);
-    if (ex->glob && ex->meta) {
-        if (glob_expand(value, ex->out)) {
-            free(value);
-        } else {
-            sl_push(ex->out, value);
+    size_t before = ex->out->len;
+    if (ex->glob && ex->meta && glob_expand(ex->field.data, ex->out)) {
+        for (size_t i = before; ex->borrow && i < ex->out->len; i++) {
+            char *match = ex->out->items[i];
+            ex->out->items[i] = expand_scratch_copy(match);
+            free(match);
         }
+    } else if (ex->borrow) {
+        sl_push(ex->out, arena_store(ex->field.data, ex->field.len));
     } else {
-        sl_push(ex->out, value);
+        sl_push(ex->out, xstrdup(ex->field.data));
     }
     sb_clear(&ex->field);
     ex->has_content = 0;
@@ -271,24 +320,203 @@ static int expand_array_body(const char *body, StrList *out) {
     return 1;
 }
 
-static int pattern_is_literal(const char *pattern) {
-    return !shell.nocasematch && pattern[strcspn(pattern, "*?[\\(")] == '\0';
+static char *pattern_literal(const char *pattern) {
+    if (shell.nocasematch) return NULL;
+    StrBuf sb;
+    sb_init(&sb);
+    for (const char *p = pattern; *p; p++) {
+        if (*p == '\\' && p[1]) p++;
+        else if (strchr("*?[", *p) || (strchr("+@!", *p) && p[1] == '(')) {
+            sb_free(&sb);
+            return NULL;
+        }
+        sb_putc(&sb, *p);
+    }
+    return sb_take(&sb);
+}
+
+enum { GLOB_SET, GLOB_ANY, GLOB_STAR };
+
+typedef struct {
+    int kind;
+    unsigned char set[32];
+} GlobToken;
+
+typedef struct {
+    GlobToken *tokens;
+    size_t count;
+    long *live;
+    long *next;
+} Glob;
+
+static int folded_equal(char a, char b) {
+    if (a == b) return 1;
+    return shell.nocasematch && tolower((unsigned char)a) == tolower((unsigned char)b);
+}
+
+static int class_contains(const char *start, char c, const char **end) {
+    const char *p = start;
+    int negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    int matched = 0;
+    while (*p && (*p != ']' || p == start)) {
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            if (c >= p[0] && c <= p[2]) matched = 1;
+            if (shell.nocasematch) {
+                char folded = (char)(isupper((unsigned char)c) ? tolower((unsigned char)c)
+                                                               : toupper((unsigned char)c));
+                if (folded >= p[0] && folded <= p[2]) matched = 1;
+            }
+            p += 3;
+        } else {
+            if (folded_equal(*p, c)) matched = 1;
+            p++;
+        }
+    }
+    if (*p == ']') p++;
+    *end = p;
+    return matched != negate;
+}
+
+static void glob_set(GlobToken *token, int byte) {
+    token->set[byte >> 3] |= (unsigned char)(1u << (byte & 7));
+}
+
+static int glob_compile(Glob *glob, const char *pattern, int reverse) {
+    for (const char *p = pattern; *p; p++) {
+        if (*p == '\\' && p[1]) p++;
+        else if (strchr("?*+@!", *p) && p[1] == '(') return 0;
+    }
+
+    size_t cap = strlen(pattern) + 1;
+    glob->tokens = xmalloc(cap * sizeof(GlobToken));
+    glob->count = 0;
+    for (const char *p = pattern; *p;) {
+        GlobToken *token = &glob->tokens[glob->count];
+        memset(token, 0, sizeof(*token));
+        if (*p == '*') {
+            p++;
+            if (glob->count > 0 && glob->tokens[glob->count - 1].kind == GLOB_STAR) continue;
+            token->kind = GLOB_STAR;
+        } else if (*p == '?') {
+            p++;
+            token->kind = GLOB_ANY;
+        } else if (*p == '[') {
+            const char *end = p + 1;
+            for (int byte = 1; byte < 256; byte++)
+                if (class_contains(p + 1, (char)byte, &end)) glob_set(token, byte);
+            p = end;
+        } else {
+            char c = *p == '\\' && p[1] ? *++p : *p;
+            p++;
+            for (int byte = 1; byte < 256; byte++)
+                if (folded_equal(c, (char)byte)) glob_set(token, byte);
+        }
+        glob->count++;
+    }
+
+    for (size_t i = 0; reverse && i < glob->count / 2; i++) {
+        GlobToken swap = glob->tokens[i];
+        glob->tokens[i] = glob->tokens[glob->count - 1 - i];
+        glob->tokens[glob->count - 1 - i] = swap;
+    }
+    glob->live = xmalloc((glob->count + 1) * sizeof(long));
+    glob->next = xmalloc((glob->count + 1) * sizeof(long));
+    return 1;
+}
+
+static void glob_free(Glob *glob) {
+    free(glob->tokens);
+    free(glob->live);
+    free(glob->next);
+}
+
+static void glob_close(Glob *glob, long *states) {
+    for (size_t i = 0; i < glob->count; i++) {
+        if (states[i] < 0 || glob->tokens[i].kind != GLOB_STAR) continue;
+        if (states[i + 1] < 0 || states[i] < states[i + 1]) states[i + 1] = states[i];
+    }
+}
+
+static int glob_step(Glob *glob, unsigned char c) {
+    int alive = 0;
+    for (size_t i = 0; i <= glob->count; i++) glob->next[i] = -1;
+    for (size_t i = 0; i < glob->count; i++) {
+        long start = glob->live[i];
+        if (start < 0) continue;
+        const GlobToken *token = &glob->tokens[i];
+        size_t to = i + 1;
+        if (token->kind == GLOB_STAR) to = i;
+        else if (token->kind == GLOB_SET && !(token->set[c >> 3] & (1u << (c & 7)))) continue;
+        if (glob->next[to] < 0 || start < glob->next[to]) glob->next[to] = start;
+        alive = 1;
+    }
+    long *swap = glob->live;
+    glob->live = glob->next;
+    glob->next = swap;
+    glob_close(glob, glob->live);
+    return alive;
+}
+
+static int glob_anchored(Glob *glob, const char *text, size_t total, int backward, int longest,
+                         size_t *length) {
+    for (size_t i = 0; i <= glob->count; i++) glob->live[i] = -1;
+    glob->live[0] = 0;
+    glob_close(glob, glob->live);
+
+    int found = 0;
+    for (size_t taken = 0;; taken++) {
+        if (glob->live[glob->count] >= 0) {
+            found = 1;
+            *length = taken;
+            if (!longest) return 1;
+        }
+        if (taken == total) break;
+        unsigned char c = (unsigned char)(backward ? text[total - 1 - taken] : text[taken]);
+        if (!glob_step(glob, c)) break;
+    }
+    return found;
+}
+
+static int glob_search(Glob *glob, const char *text, size_t from, size_t total, size_t *start,
+                       size_t *length) {
+    for (size_t i = 0; i <= glob->count; i++) glob->live[i] = -1;
+    long best = -1;
+    size_t best_end = 0;
+
+    for (size_t at = from;; at++) {
+        if (best < 0 && glob->live[0] < 0) {
+            glob->live[0] = (long)at;
+            glob_close(glob, glob->live);
+        }
+        long accepted = glob->live[glob->count];
+        if (accepted >= 0 && (size_t)accepted < at &&
+            (best < 0 || accepted < best || (accepted == best && at > best_end))) {
+            best = accepted;
+            best_end = at;
+        }
+
+        int alive = 0;
+        for (size_t i = 0; i <= glob->count; i++) {
+            if (best >= 0 && glob->live[i] > best) glob->live[i] = -1;
+            if (glob->live[i] >= 0) alive = 1;
+        }
+        if (at == total || (best >= 0 && !alive)) break;
+        glob_step(glob, (unsigned char)text[at]);
+    }
+    if (best < 0) return 0;
+    *start = (size_t)best;
+    *length = best_end - (size_t)best;
+    return 1;
 }
 
 static int match_at(const char *pattern, const char *text, size_t start, size_t limit,
                     int longest, size_t *length) {
     int found = 0;
     size_t best = 0;
-    size_t available = strlen(text) - start;
+    size_t available = strlen(text + start);
     if (limit < available) available = limit;
 
-    if (pattern_is_literal(pattern)) {
-        size_t want = strlen(pattern);
-        if (want > available || strncmp(text + start, pattern, want) != 0) return 0;
-        *length = want;
-        return 1;
-    }
-
     char *piece = xstrndup(text + start, available);
     for (size_t take = 0; take <= available; take++) {
         char saved = piece[take];
@@ -306,19 +534,42 @@ static int match_at(const char *pattern, const char *text, size_t start, size_t
 }
 
 static char *strip_prefix(const char *text, const char *pattern, int longest) {
+    size_t total = strlen(text);
     size_t length = 0;
-    if (match_at(pattern, text, 0, strlen(text), longest, &length)) return xstrdup(text + length);
-    return xstrdup(text);
+    int matched = 0;
+
+    char *literal = pattern_literal(pattern);
+    Glob glob;
+    if (literal) {
+        length = strlen(literal);
+        matched = strncmp(text, literal, length) == 0;
+        free(literal);
+    } else if (glob_compile(&glob, pattern, 0)) {
+        matched = glob_anchored(&glob, text, total, 0, longest, &length);
+        glob_free(&glob);
+    } else {
+        matched = match_at(pattern, text, 0, total, longest, &length);
+    }
+    return xstrdup(matched ? text + length : text);
 }
 
 static char *strip_suffix(const char *text, const char *pattern, int longest) {
     size_t total = strlen(text);
 
-    if (pattern_is_literal(pattern)) {
-        size_t want = strlen(pattern);
-        if (want <= total && strcmp(text + total - want, pattern) == 0)
-            return xstrndup(text, total - want);
-        return xstrdup(text);
+    char *literal = pattern_literal(pattern);
+    if (literal) {
+        size_t want = strlen(literal);
+        int matched = want <= total && strcmp(text + total - want, literal) == 0;
+        free(literal);
+        return matched ? xstrndup(text, total - want) : xstrdup(text);
+    }
+
+    Glob glob;
+    if (glob_compile(&glob, pattern, 1)) {
+        size_t length = 0;
+        int matched = glob_anchored(&glob, text, total, 1, longest, &length);
+        glob_free(&glob);
+        return matched ? xstrndup(text, total - length) : xstrdup(text);
     }
 
     size_t best = total;
@@ -336,32 +587,72 @@ static char *strip_suffix(const char *text, const char *pattern, int longest) {
     return xstrndup(text, best);
 }
 
+static int find_pattern(const char *text, size_t total, size_t from, const char *literal,
+                        Glob *glob, const char *pattern, int anchor_start, int anchor_end,
+                        size_t *start, size_t *length) {
+    if (anchor_start) {
+        *start = 0;
+        if (literal) {
+            *length = strlen(literal);
+            return *length > 0 && strncmp(text, literal, *length) == 0;
+        }
+        if (glob) return glob_anchored(glob, text, total, 0, 1, length) && *length > 0;
+        return match_at(pattern, text, 0, total, 1, length) && *length > 0;
+    }
+    if (anchor_end) {
+        if (literal) {
+            *length = strlen(literal);
+            *start = total - *length;
+            return *length > 0 && *length <= total && strcmp(text + *start, literal) == 0;
+        }
+        if (glob) {
+            if (!glob_anchored(glob, text, total, 1, 1, length) || *length == 0) return 0;
+            *start = total - *length;
+            return 1;
+        }
+    }
+    if (literal) {
+        const char *hit = *literal ? strstr(text + from, literal) : NULL;
+        if (!hit) return 0;
+        *start = (size_t)(hit - text);
+        *length = strlen(literal);
+        return 1;
+    }
+    if (glob) return glob_search(glob, text, from, total, start, length);
+
+    for (size_t cursor = from; cursor < total; cursor++) {
+        if (!match_at(pattern, text, cursor, total - cursor, 1, length) || *length == 0)
+            continue;
+        if (anchor_end && cursor + *length != total) continue;
+        *start = cursor;
+        return 1;
+    }
+    return 0;
+}
+
 static char *replace_pattern(const char *text, const char *pattern, const char *replacement,
                              int all, int anchor_start, int anchor_end) {
+    size_t total = strlen(text);
+    char *literal = pattern_literal(pattern);
+    Glob compiled;
+    Glob *glob = !literal && glob_compile(&compiled, pattern, anchor_end) ? &compiled : NULL;
+
     StrBuf out;
     sb_init(&out);
-    size_t total = strlen(text);
     size_t cursor = 0;
-    int replaced = 0;
-
-    while (cursor <= total) {
-        size_t length = 0;
-        int matched = 0;
-
-        if (!(replaced && !all) && !(anchor_start && cursor > 0))
-            matched = match_at(pattern, text, cursor, total - cursor, 1, &length);
-        if (matched && anchor_end && cursor + length != total) matched = 0;
-
-        if (matched && length > 0) {
-            sb_puts(&out, replacement);
-            cursor += length;
-            replaced = 1;
-            continue;
-        }
-        if (cursor == total) break;
-        sb_putc(&out, text[cursor]);
-        cursor++;
+    size_t start = 0;
+    size_t length = 0;
+    while (cursor < total && find_pattern(text, total, cursor, literal, glob, pattern,
+                                          anchor_start, anchor_end, &start, &length)) {
+        sb_putn(&out, text + cursor, start - cursor);
+        sb_puts(&out, replacement);
+        cursor = start + length;
+        if (!all || anchor_start || anchor_end) break;
     }
+    sb_puts(&out, text + cursor);
+
+    free(literal);
+    if (glob) glob_free(glob);
     return sb_take(&out);
 }
 
@@ -894,88 +1185,103 @@ static void expand_tilde(Expander *ex, const char **p) {
     (*p)++;
 }
 
-static void expand_into(const char *word, Expander *ex) {
-    const char *p = word;
-    int at_start = 1;
-
-    while (*p) {
-        char c = *p;
-        if (c == '~' && at_start) {
-            expand_tilde(ex, &p);
-            at_start = 0;
-            continue;
-        }
-        at_start = 0;
+static void expand_backquote(Expander *ex, const char **p, int in_quotes) {
+    const char *end = strchr(*p + 1, '`');
+    if (!end) end = *p + strlen(*p);
+    char *command = xstrndup(*p + 1, (size_t)(end - *p - 1));
+    char *result = capture_trimmed(command);
+    free(command);
+    if (in_quotes) field_add_quoted(ex, result, strlen(result));
+    else field_add_split(ex, result);
+    free(result);
+    *p = *end ? end + 1 : end;
+}
 
-        if (c == '\\') {
-            p++;
-            if (*p) {
-                field_add_quoted(ex, p, 1);
-                ex->quoted = 1;
-                p++;
-            }
-            continue;
-        }
-        if (c == '\'') {
-            p++;
+static void expand_step(Expander *ex, const char **p, int at_start) {
+    char c = **p;
+    if (c == '~' && at_start) {
+        expand_tilde(ex, p);
+        return;
+    }
+    if (c == '\\') {
+        (*p)++;
+        if (**p) {
+            field_add_quoted(ex, *p, 1);
             ex->quoted = 1;
-            ex->has_content = 1;
-            while (*p && *p != '\'') {
-                field_add_quoted(ex, p, 1);
-                p++;
-            }
-            if (*p) p++;
-            continue;
+            (*p)++;
         }
-        if (c == '"') {
-            p++;
-            ex->quoted = 1;
-            ex->has_content = 1;
-            while (*p && *p != '"') {
-                if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) {
-                    field_add_quoted(ex, p + 1, 1);
-                    p += 2;
-                    continue;
-                }
-                if (*p == '$') {
-                    expand_dollar(ex, &p, 1);
-                    continue;
-                }
-                if (*p == '`') {
-                    const char *end = strchr(p + 1, '`');
-                    if (!end) end = p + strlen(p);
-                    char *command = xstrndup(p + 1, (size_t)(end - p - 1));
-                    char *result = capture_trimmed(command);
-                    free(command);
-                    field_add_quoted(ex, result, strlen(result));
-                    free(result);
-                    p = *end ? end + 1 : end;
-                    continue;
-                }
-                field_add_quoted(ex, p, 1);
-                p++;
+        return;
+    }
+    if (c == '\'') {
+        (*p)++;
+        ex->quoted = 1;
+        ex->has_content = 1;
+        const char *end = strchr(*p, '\'');
+        if (!end) end = *p + strlen(*p);
+        field_add_quoted(ex, *p, (size_t)(end - *p));
+        *p = *end ? end + 1 : end;
+        return;
+    }
+    if (c == '"') {
+        (*p)++;
+        ex->quoted = 1;
+        ex->has_content = 1;
+        while (**p && **p != '"') {
+            if (**p == '\\' && (*p)[1] && strchr("\"\\$`", (*p)[1])) {
+                field_add_quoted(ex, *p + 1, 1);
+                *p += 2;
+            } else if (**p == '$') {
+                expand_dollar(ex, p, 1);
+            } else if (**p == '`') {
+                expand_backquote(ex, p, 1);
+            } else {
+                field_add_quoted(ex, *p, 1);
+                (*p)++;
             }
-            if (*p) p++;
-            continue;
         }
-        if (c == '`') {
-            const char *end = strchr(p + 1, '`');
-            if (!end) end = p + strlen(p);
-            char *command = xstrndup(p + 1, (size_t)(end - p - 1));
-            char *result = capture_trimmed(command);
-            free(command);
-            field_add_split(ex, result);
-            free(result);
-            p = *end ? end + 1 : end;
+        if (**p) (*p)++;
+        return;
+    }
+    if (c == '`') {
+        expand_backquote(ex, p, 0);
+        return;
+    }
+    if (c == '$') {
+        expand_dollar(ex, p, 0);
+        return;
+    }
+    note_meta(ex, *p, 1);
+    field_add(ex, *p, 1);
+    (*p)++;
+}
+
+static void expand_span(const char *p, int at_start, Expander *ex) {
+    while (*p) {
+        expand_step(ex, &p, at_start);
+        at_start = 0;
+    }
+}
+
+static void expand_into(const char *word, Expander *ex) {
+    expand_span(word, 1, ex);
+}
+
+static void expand_segments(const char *word, const WordInfo *info, Expander *ex) {
+    for (size_t i = 0; i < info->count; i++) {
+        const Segment *segment = &info->segments[i];
+        const char *p = word + segment->start;
+        const char *end = p + segment->length;
+
+        if (segment->kind == SEG_LITERAL) {
+            if (info->flags & WORD_GLOB) note_meta(ex, p, segment->length);
+            field_add(ex, p, segment->length);
             continue;
         }
-        if (c == '$') {
-            expand_dollar(ex, &p, 0);
-            continue;
+        expand_step(ex, &p, segment->start == info->prefix);
+        if (p != end) {
+            expand_span(p, 0, ex);
+            return;
         }
-        note_meta(ex, p, 1);
-        field_add(ex, p, 1);
-        p++;
     }
 }
 
@@ -1112,44 +1418,6 @@ void brace_expand_word(const char *word, StrList *out) {
     free(body);
 }
 
-static size_t assignment_prefix(const char *word) {
-    if (!isalpha((unsigned char)word[0]) && word[0] != '_') return 0;
-
-    size_t i = 1;
-    while (isalnum((unsigned char)word[i]) || word[i] == '_') i++;
-    if (word[i] == '[') {
-        const char *close = strchr(word + i, ']');
-        if (!close) return 0;
-        i = (size_t)(close - word) + 1;
-    }
-    if (word[i] == '+' && word[i + 1] == '=') return i + 2;
-    return word[i] == '=' ? i + 1 : 0;
-}
-
-static void expand_assignment(const char *word, size_t prefix, StrList *out) {
-    Expander ex;
-    sb_init(&ex.field);
-    ex.has_content = 1;
-    ex.quoted = 0;
-    ex.meta = 0;
-    ex.out = out;
-    ex.split = 0;
-    ex.glob = 0;
-    ex.escape_meta = 0;
-
-    sb_putn(&ex.field, word, prefix);
-    expand_into(word + prefix, &ex);
-    ex.has_content = 1;
-    field_flush(&ex);
-    sb_free(&ex.field);
-}
-
-static int declaration_command(const char *word) {
-    return strcmp(word, "local") == 0 || strcmp(word, "export") == 0 ||
-           strcmp(word, "declare") == 0 || strcmp(word, "typeset") == 0 ||
-           strcmp(word, "readonly") == 0;
-}
-
 static int word_is_plain(const char *word) {
     for (const char *p = word; *p; p++) {
         switch (*p) {
@@ -1174,45 +1442,84 @@ static int word_is_plain(const char *word) {
     return 1;
 }
 
-void expand_words(const StrList *in, StrList *out) {
+static void expand_list(const StrList *in, const WordInfo *info, StrList *out, int borrow) {
+    Expander ex;
+    sb_init(&ex.field);
+    ex.has_content = 0;
+    ex.out = out;
+    ex.borrow = borrow;
+    ex.escape_meta = 0;
     int leading = 1;
 
     sl_borrow(in);
     for (size_t i = 0; i < in->len; i++) {
-        size_t prefix = leading ? assignment_prefix(in->items[i]) : 0;
-        if (!prefix && !(i == 0 && declaration_command(in->items[i]))) leading = 0;
+        const char *word = in->items[i];
+        const WordInfo *word_info = info ? &info[i] : NULL;
+        size_t prefix;
+        if (word_info) {
+            prefix = word_info->prefix;
+        } else {
+            prefix = leading ? assignment_prefix(word) : 0;
+            if (!prefix && !(i == 0 && declaration_command(word))) leading = 0;
+        }
 
-        if (prefix) {
-            expand_assignment(in->items[i], prefix, out);
+        if (word_info ? (word_info->flags & WORD_PLAIN) != 0 : !prefix && word_is_plain(word)) {
+            if (borrow) sl_push(out, (char *)word);
+            else sl_push_copy(out, word);
+            continue;
+        }
+        if (word_info && word_info->text) {
+            if (borrow) sl_push(out, word_info->text);
+            else sl_push_copy(out, word_info->text);
             continue;
         }
 
-        if (word_is_plain(in->items[i])) {
-            sl_push_copy(out, in->items[i]);
+        ex.quoted = 0;
+        ex.meta = 0;
+        ex.bracket = 0;
+        ex.split = !prefix;
+        ex.glob = !prefix;
+        if (prefix) {
+            sb_putn(&ex.field, word, prefix);
+            if (word_info) expand_segments(word, word_info, &ex);
+            else expand_into(word + prefix, &ex);
+            ex.has_content = 1;
+            field_flush(&ex);
+            continue;
+        }
+        if (word_info && !(word_info->flags & WORD_BRACE)) {
+            expand_segments(word, word_info, &ex);
+            field_flush(&ex);
+            continue;
+        }
+        if (!word_info && !strchr(word, '{')) {
+            expand_into(word, &ex);
+            field_flush(&ex);
             continue;
         }
 
         StrList braced;
         sl_init(&braced);
-        brace_expand_word(in->items[i], &braced);
-
+        brace_expand_word(word, &braced);
         for (size_t b = 0; b < braced.len; b++) {
-            Expander ex;
-            sb_init(&ex.field);
-            ex.has_content = 0;
             ex.quoted = 0;
             ex.meta = 0;
-            ex.out = out;
-            ex.split = 1;
-            ex.glob = 1;
-            ex.escape_meta = 0;
+            ex.bracket = 0;
             expand_into(braced.items[b], &ex);
             field_flush(&ex);
-            sb_free(&ex.field);
         }
         sl_free(&braced);
     }
     sl_release(in);
+    sb_free(&ex.field);
+}
+
+void expand_words(const StrList *in, StrList *out) {
+    expand_list(in, NULL, out, 0);
+}
+
+void expand_command(const StrList *in, const WordInfo *info, StrList *out) {
+    expand_list(in, info, out, 1);
 }
 
 char *expand_heredoc(const char *body) {
@@ -1225,6 +1532,7 @@ char *expand_heredoc(const char *body) {
     ex.quoted = 0;
     ex.meta = 0;
     ex.out = &fields;
+    ex.borrow = 0;
     ex.split = 0;
     ex.glob = 0;
     ex.escape_meta = 0;
@@ -1259,6 +1567,7 @@ static char *expand_joined(const char *word, int escape_meta) {
     ex.quoted = 0;
     ex.meta = 0;
     ex.out = &fields;
+    ex.borrow = 0;
     ex.split = 0;
     ex.glob = 0;
     ex.escape_meta = escape_meta;
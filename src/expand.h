@@ -7,9 +7,14 @@
 #ifndef FRESH_EXPAND_H
 #define FRESH_EXPAND_H
 
+#include "parser.h"
 #include "util.h"
 
 void expand_words(const StrList *in, StrList *out);
+void expand_command(const StrList *in, const WordInfo *info, StrList *out);
+size_t expand_scratch_mark(void);
+void expand_scratch_reset(size_t mark);
+char *expand_scratch_copy(const char *text);
 char *expand_single(const char *word);
 char *expand_pattern(const char *word);
 char *expand_heredoc(const char *body);
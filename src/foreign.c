@@ -101,7 +101,8 @@ static int run_through(const char *program, const char *arguments) {
     fflush(stdout);
     fflush(stderr);
 
-    if (!CreateProcessA(NULL, command_line.data, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+    if (!CreateProcessA(NULL, command_line.data, NULL, NULL, TRUE, 0, vars_environment(), NULL,
+                        &si, &pi)) {
         shell_error("cannot start %s", program);
         sb_free(&command_line);
         return 127;
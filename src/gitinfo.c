@@ -6,14 +6,66 @@
 
 #include "gitinfo.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <windows.h>
 
 #include "util.h"
+#include "vars.h"
 
 #define DIRTY_REFRESH_MS 1500
+#define STAT_WORKERS 8
+#define STAT_CHUNK 256
+#define VERIFIED_PAIRS 16
+#define WATCH_BUFFER 16384
+#define WATCH_MAX 2
+
+#define ENTRY_ASSUME_VALID 0x8000
+#define ENTRY_EXTENDED 0x4000
+#define ENTRY_SKIP_WORKTREE 0x4000
+#define ENTRY_INTENT_TO_ADD 0x2000
+#define MODE_GITLINK 0160000
+
+typedef struct {
+    unsigned mtime_sec;
+    unsigned mtime_nsec;
+    unsigned mode;
+    unsigned size;
+    unsigned flags;
+    unsigned extended;
+    size_t path;
+} IndexEntry;
+
+typedef struct {
+    char path[PATH_BUF];
+    unsigned long long stamp;
+    unsigned long long length;
+    unsigned stamp_sec;
+    unsigned stamp_nsec;
+    IndexEntry *entries;
+    size_t count;
+    StrBuf paths;
+    int tree_valid;
+    char tree[41];
+} IndexCache;
+
+typedef struct {
+    const IndexCache *index;
+    const char *root;
+    volatile LONG next;
+    volatile LONG dirty;
+    volatile LONG racy;
+} StatWalk;
+
+typedef struct {
+    HANDLE dir;
+    HANDLE event;
+    OVERLAPPED overlapped;
+    DWORD buffer[WATCH_BUFFER / sizeof(DWORD)];
+    int git_only;
+} Watch;
 
 static char cached_cwd[PATH_BUF];
 static char cached_root[PATH_BUF];
@@ -29,6 +81,18 @@ static volatile LONG dirty_running = 0;
 static volatile LONG dirty_state = 0;
 static DWORD dirty_stamp = 0;
 
+static IndexCache index_cache;
+static char staged_key[PATH_BUF + 64];
+static int staged_state = 0;
+static char verified_pairs[VERIFIED_PAIRS][82];
+static int verified_next = 0;
+
+static Watch watches[WATCH_MAX];
+static int watch_count = 0;
+static char watch_root[PATH_BUF];
+static int head_stale = 1;
+static int tree_stale = 1;
+
 void git_invalidate(void) {
     cached_cwd[0] = '\0';
     cached_root[0] = '\0';
@@ -37,6 +101,19 @@ void git_invalidate(void) {
     cached_repo[0] = '\0';
 }
 
+static void watch_stop(void) {
+    for (int i = 0; i < watch_count; i++) {
+        DWORD bytes;
+        CancelIo(watches[i].dir);
+        GetOverlappedResult(watches[i].dir, &watches[i].overlapped, &bytes, TRUE);
+        CloseHandle(watches[i].event);
+        CloseHandle(watches[i].dir);
+    }
+    watch_count = 0;
+    head_stale = 1;
+    tree_stale = 1;
+}
+
 static int find_root(const char *start, char *out, size_t out_size) {
     char dir[PATH_BUF];
     snprintf(dir, sizeof(dir), "%s", start);
@@ -63,13 +140,18 @@ int git_repo_root(char *out, size_t out_size) {
         cached_is_repo = find_root(cwd, cached_root, sizeof(cached_root));
         cached_branch[0] = '\0';
         cached_repo[0] = '\0';
+        if (!cached_is_repo) {
+            watch_stop();
+            watch_root[0] = '\0';
+        }
     }
     if (!cached_is_repo) return 0;
     snprintf(out, out_size, "%s", cached_root);
     return 1;
 }
 
-static int run_git(const char *arguments, const char *working_dir, char *out, size_t out_size) {
+static int run_git(const char *arguments, const char *working_dir, char *environment, char *out,
+                   size_t out_size) {
     SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
     HANDLE read_end, write_end;
     if (!CreatePipe(&read_end, &write_end, &sa, 0)) return 0;
@@ -89,11 +171,11 @@ static int run_git(const char *arguments, const char *working_dir, char *out, si
     char command_line[512];
     snprintf(command_line, sizeof(command_line), "git.exe %s", arguments);
 
-    if (!CreateProcessA(NULL, command_line, NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, working_dir,
-                        &si, &pi)) {
+    if (!CreateProcessA(NULL, command_line, NULL, NULL, TRUE, CREATE_NO_WINDOW, environment,
+                        working_dir, &si, &pi)) {
         CloseHandle(read_end);
         CloseHandle(write_end);
-        return 0;
+        return -1;
     }
     CloseHandle(write_end);
 
@@ -113,26 +195,165 @@ static int run_git(const char *arguments, const char *working_dir, char *out, si
 
     char *end = out + strlen(out);
     while (end > out && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ')) *--end = '\0';
-    return exit_code == 0;
+    return (int)exit_code;
+}
+
+static char *read_small_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    StrBuf text;
+    sb_init(&text);
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) sb_putn(&text, chunk, n);
+    fclose(f);
+    return sb_take(&text);
+}
+
+static int git_dir(const char *root, char *out, size_t out_size) {
+    char marker[PATH_BUF];
+    snprintf(marker, sizeof(marker), "%s\\.git", root);
+    if (!path_is_file(marker)) {
+        snprintf(out, out_size, "%s", marker);
+        return 1;
+    }
+
+    char *text = read_small_file(marker);
+    if (!text) return 0;
+    char *gitdir = strstr(text, "gitdir:");
+    if (!gitdir) {
+        free(text);
+        return 0;
+    }
+    char *value = str_trim(gitdir + 7);
+    if (path_is_absolute(value)) snprintf(out, out_size, "%s", value);
+    else snprintf(out, out_size, "%s\\%s", root, value);
+    path_to_backslashes(out);
+    free(text);
+    return 1;
+}
+
+static void common_dir(const char *gitdir, char *out, size_t out_size) {
+    char marker[PATH_BUF];
+    snprintf(marker, sizeof(marker), "%s\\commondir", gitdir);
+    char *text = read_small_file(marker);
+    if (!text) {
+        snprintf(out, out_size, "%s", gitdir);
+        return;
+    }
+    char *value = str_trim(text);
+    if (path_is_absolute(value)) snprintf(out, out_size, "%s", value);
+    else snprintf(out, out_size, "%s\\%s", gitdir, value);
+    path_to_backslashes(out);
+    free(text);
+}
+
+static int watch_issue(Watch *watch) {
+    memset(&watch->overlapped, 0, sizeof(watch->overlapped));
+    watch->overlapped.hEvent = watch->event;
+    return ReadDirectoryChangesW(watch->dir, watch->buffer, sizeof(watch->buffer), TRUE,
+                                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                                     FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                 NULL, &watch->overlapped, NULL);
+}
+
+static void watch_open(const char *dir, int git_only) {
+    Watch *watch = &watches[watch_count];
+    watch->dir = CreateFileA(dir, FILE_LIST_DIRECTORY,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                             OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (watch->dir == INVALID_HANDLE_VALUE) return;
+    watch->event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    watch->git_only = git_only;
+    if (watch->event && watch_issue(watch)) {
+        watch_count++;
+        return;
+    }
+    if (watch->event) CloseHandle(watch->event);
+    CloseHandle(watch->dir);
+}
+
+static int name_starts(const WCHAR *name, size_t length, const char *prefix) {
+    size_t n = strlen(prefix);
+    if (length < n) return 0;
+    for (size_t i = 0; i < n; i++) {
+        if (name[i] >= 0x80 || tolower(name[i]) != prefix[i]) return 0;
+    }
+    return length == n || prefix[n - 1] == '\\' || name[n] == '\\';
+}
+
+static void watch_note(const Watch *watch, const FILE_NOTIFY_INFORMATION *info) {
+    const WCHAR *name = info->FileName;
+    size_t length = info->FileNameLength / sizeof(WCHAR);
+    if (!watch->git_only) {
+        if (!name_starts(name, length, ".git")) {
+            tree_stale = 1;
+            return;
+        }
+        if (length > 5) {
+            name += 5;
+            length -= 5;
+        }
+    }
+    if (name_starts(name, length, "objects\\") || name_starts(name, length, "logs\\")) return;
+    head_stale = 1;
+    tree_stale = 1;
+}
+
+static void watch_poll(void) {
+    for (int i = 0; i < watch_count; i++) {
+        Watch *watch = &watches[i];
+        DWORD bytes = 0;
+        while (GetOverlappedResult(watch->dir, &watch->overlapped, &bytes, FALSE)) {
+            if (bytes == 0) {
+                head_stale = 1;
+                tree_stale = 1;
+            }
+            const unsigned char *p = (const unsigned char *)watch->buffer;
+            while (bytes) {
+                const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION *)p;
+                watch_note(watch, info);
+                if (!info->NextEntryOffset) break;
+                p += info->NextEntryOffset;
+            }
+            if (!watch_issue(watch)) {
+                watch_stop();
+                return;
+            }
+        }
+        if (GetLastError() != ERROR_IO_INCOMPLETE) {
+            watch_stop();
+            return;
+        }
+    }
+}
+
+static void watch_sync(const char *root) {
+    if (strcmp(root, watch_root) == 0) {
+        watch_poll();
+        return;
+    }
+    watch_stop();
+    snprintf(watch_root, sizeof(watch_root), "%s", root);
+
+    char gitdir[PATH_BUF];
+    char common[PATH_BUF];
+    watch_open(root, 0);
+    if (watch_count && !git_dir(root, gitdir, sizeof(gitdir))) watch_stop();
+    if (!watch_count) return;
+
+    common_dir(gitdir, common, sizeof(common));
+    size_t length = strlen(root);
+    if (_strnicmp(common, root, length) == 0 && common[length] == '\\') return;
+    watch_open(common, 1);
+    if (watch_count < 2) watch_stop();
 }
 
 static int read_head_file(const char *root, char *out, size_t out_size) {
+    char gitdir[PATH_BUF];
     char head_path[PATH_BUF];
-    snprintf(head_path, sizeof(head_path), "%s\\.git", root);
-
-    if (path_is_file(head_path)) {
-        FILE *f = fopen(head_path, "r");
-        if (!f) return 0;
-        char line[PATH_BUF];
-        char *read = fgets(line, sizeof(line), f);
-        fclose(f);
-        if (!read) return 0;
-        char *gitdir = strstr(line, "gitdir:");
-        if (!gitdir) return 0;
-        snprintf(head_path, sizeof(head_path), "%s\\HEAD", str_trim(gitdir + 7));
-    } else {
-        snprintf(head_path, sizeof(head_path), "%s\\.git\\HEAD", root);
-    }
+    if (!git_dir(root, gitdir, sizeof(gitdir))) return 0;
+    snprintf(head_path, sizeof(head_path), "%s\\HEAD", gitdir);
 
     FILE *f = fopen(head_path, "r");
     if (!f) return 0;
@@ -152,10 +373,72 @@ static int read_head_file(const char *root, char *out, size_t out_size) {
     return 1;
 }
 
+static int object_id(const char *text) {
+    for (int i = 0; i < 40; i++) {
+        if (!isxdigit((unsigned char)text[i])) return 0;
+    }
+    return 1;
+}
+
+static int packed_ref(const char *common, const char *ref, char *out) {
+    char path[PATH_BUF];
+    snprintf(path, sizeof(path), "%s\\packed-refs", common);
+    char *text = read_small_file(path);
+    if (!text) return 0;
+
+    int found = 0;
+    size_t ref_length = strlen(ref);
+    char *cursor = text;
+    char *line;
+    while (!found && (line = str_next_field(&cursor, '\n')) != NULL) {
+        if (!object_id(line) || line[40] != ' ') continue;
+        char *name = line + 41;
+        size_t length = strcspn(name, "\r");
+        if (length == ref_length && strncmp(name, ref, length) == 0) {
+            memcpy(out, line, 40);
+            out[40] = '\0';
+            found = 1;
+        }
+    }
+    free(text);
+    return found;
+}
+
+static int resolve_head(const char *gitdir, char *out) {
+    char common[PATH_BUF];
+    char path[PATH_BUF];
+    common_dir(gitdir, common, sizeof(common));
+    snprintf(path, sizeof(path), "%s\\HEAD", gitdir);
+
+    for (int depth = 0; depth < 5; depth++) {
+        char *text = read_small_file(path);
+        if (!text) return 0;
+        char *value = str_trim(text);
+        if (strncmp(value, "ref:", 4) != 0) {
+            int valid = object_id(value);
+            if (valid) snprintf(out, 41, "%.40s", value);
+            free(text);
+            return valid;
+        }
+
+        char ref[PATH_BUF];
+        snprintf(ref, sizeof(ref), "%s", str_trim(value + 4));
+        free(text);
+        snprintf(path, sizeof(path), "%s\\%s", common, ref);
+        path_to_backslashes(path);
+        if (!path_is_file(path)) return packed_ref(common, ref, out);
+    }
+    return 0;
+}
+
 const char *git_branch(void) {
     char root[PATH_BUF];
     if (!git_repo_root(root, sizeof(root))) return NULL;
-    if (!read_head_file(root, cached_branch, sizeof(cached_branch))) return NULL;
+    watch_sync(root);
+    if (!watch_count || head_stale || !cached_branch[0]) {
+        head_stale = 0;
+        if (!read_head_file(root, cached_branch, sizeof(cached_branch))) cached_branch[0] = '\0';
+    }
     return cached_branch[0] ? cached_branch : NULL;
 }
 
@@ -169,22 +452,347 @@ const char *git_repo_name(void) {
     return cached_repo;
 }
 
+static void config_user(const char *path, char *out, size_t out_size) {
+    char *text = read_small_file(path);
+    if (!text) return;
+
+    int in_user = 0;
+    char *cursor = text;
+    char *line;
+    while ((line = str_next_field(&cursor, '\n')) != NULL) {
+        line = str_trim(line);
+        if (*line == '[') {
+            char *end = strchr(line, ']');
+            if (end) *end = '\0';
+            in_user = str_ieq(str_trim(line + 1), "user");
+            continue;
+        }
+        if (!in_user || *line == '#' || *line == ';') continue;
+
+        char *eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = '\0';
+        if (!str_ieq(str_trim(line), "name")) continue;
+        char *value = str_trim(eq + 1);
+        size_t length = strlen(value);
+        if (length >= 2 && value[0] == '"' && value[length - 1] == '"') {
+            value[length - 1] = '\0';
+            value++;
+        }
+        snprintf(out, out_size, "%s", value);
+    }
+    free(text);
+}
+
 const char *git_user(void) {
     if (!user_loaded) {
         user_loaded = 1;
-        if (!run_git("config user.name", NULL, cached_user, sizeof(cached_user)))
-            cached_user[0] = '\0';
+        cached_user[0] = '\0';
+
+        char path[PATH_BUF];
+        snprintf(path, sizeof(path), "%s\\.config\\git\\config", home_dir());
+        config_user(path, cached_user, sizeof(cached_user));
+        snprintf(path, sizeof(path), "%s\\.gitconfig", home_dir());
+        config_user(path, cached_user, sizeof(cached_user));
+
+        char root[PATH_BUF];
+        char gitdir[PATH_BUF];
+        if (git_repo_root(root, sizeof(root)) && git_dir(root, gitdir, sizeof(gitdir))) {
+            char common[PATH_BUF];
+            common_dir(gitdir, common, sizeof(common));
+            snprintf(path, sizeof(path), "%s\\config", common);
+            config_user(path, cached_user, sizeof(cached_user));
+        }
     }
     return cached_user[0] ? cached_user : NULL;
 }
 
+static unsigned read_u32(const unsigned char *p) {
+    return (unsigned)p[0] << 24 | (unsigned)p[1] << 16 | (unsigned)p[2] << 8 | p[3];
+}
+
+static void index_reset(IndexCache *index) {
+    free(index->entries);
+    index->entries = NULL;
+    index->count = 0;
+    if (index->paths.data) sb_free(&index->paths);
+    index->path[0] = '\0';
+    index->tree_valid = 0;
+}
+
+static void unix_time(const FILETIME *time, unsigned *sec, unsigned *nsec) {
+    unsigned long long ticks = ((unsigned long long)time->dwHighDateTime << 32) | time->dwLowDateTime;
+    *sec = (unsigned)(ticks / 10000000ULL - 11644473600ULL);
+    *nsec = (unsigned)(ticks % 10000000ULL) * 100;
+}
+
+static void read_tree_extension(IndexCache *index, const unsigned char *p, size_t size) {
+    const unsigned char *end = p + size;
+    const unsigned char *name_end = memchr(p, '\0', size);
+    if (!name_end || name_end != p) return;
+
+    char *count_end;
+    long entries = strtol((const char *)p + 1, &count_end, 10);
+    const unsigned char *newline = memchr(count_end, '\n', (size_t)(end - (const unsigned char *)count_end));
+    if (!newline || entries < 0 || end - newline - 1 < 20) return;
+
+    for (int i = 0; i < 20; i++) sprintf(index->tree + i * 2, "%02x", newline[1 + i]);
+    index->tree_valid = 1;
+}
+
+static int index_parse(IndexCache *index, const unsigned char *data, size_t length) {
+    if (length < 32 || memcmp(data, "DIRC", 4) != 0) return 0;
+    unsigned version = read_u32(data + 4);
+    unsigned count = read_u32(data + 8);
+    if (version < 2 || version > 4) return 0;
+
+    size_t end = length - 20;
+    size_t at = 12;
+    if (count > (end - at) / 62) return 0;
+    index->entries = xmalloc((count ? count : 1) * sizeof(IndexEntry));
+    sb_init(&index->paths);
+
+    for (unsigned i = 0; i < count; i++) {
+        if (at + 62 > end) return 0;
+        const unsigned char *p = data + at;
+        IndexEntry *entry = &index->entries[index->count];
+        entry->mtime_sec = read_u32(p + 8);
+        entry->mtime_nsec = read_u32(p + 12);
+        entry->mode = read_u32(p + 24);
+        entry->size = read_u32(p + 36);
+        entry->flags = (unsigned)p[60] << 8 | p[61];
+        entry->extended = 0;
+        size_t header = 62;
+        if (entry->flags & ENTRY_EXTENDED) {
+            if (version < 3 || at + 64 > end) return 0;
+            entry->extended = (unsigned)p[62] << 8 | p[63];
+            header = 64;
+        }
+
+        size_t previous = index->count ? index->entries[index->count - 1].path : 0;
+        size_t previous_length = index->count ? strlen(index->paths.data + previous) : 0;
+        const unsigned char *name = p + header;
+        if (version == 4) {
+            size_t strip = 0;
+            unsigned char byte;
+            do {
+                if (name >= data + end) return 0;
+                byte = *name++;
+                strip = (strip << 7) | (byte & 0x7F);
+                if (byte & 0x80) strip++;
+            } while (byte & 0x80);
+            if (strip > previous_length) return 0;
+            const unsigned char *name_end = memchr(name, '\0', (size_t)(data + end - name));
+            if (!name_end) return 0;
+
+            StrBuf full;
+            sb_init(&full);
+            sb_putn(&full, index->paths.data + previous, previous_length - strip);
+            sb_putn(&full, (const char *)name, (size_t)(name_end - name));
+            entry->path = index->paths.len;
+            sb_putn(&index->paths, full.data, full.len + 1);
+            sb_free(&full);
+            at = (size_t)(name_end + 1 - data);
+        } else {
+            const unsigned char *name_end = memchr(name, '\0', end - at - header);
+            if (!name_end) return 0;
+            size_t name_length = (size_t)(name_end - name);
+            entry->path = index->paths.len;
+            sb_putn(&index->paths, (const char *)name, name_length + 1);
+            at += (header + name_length + 8) & ~(size_t)7;
+        }
+        index->count++;
+    }
+
+    while (at + 8 <= end) {
+        unsigned size = read_u32(data + at + 4);
+        if (at + 8 + size > end) break;
+        if (memcmp(data + at, "link", 4) == 0) return 0;
+        if (memcmp(data + at, "TREE", 4) == 0) read_tree_extension(index, data + at + 8, size);
+        at += 8 + size;
+    }
+    return 1;
+}
+
+static int index_load(IndexCache *index, const char *path) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) {
+        index_reset(index);
+        snprintf(index->path, sizeof(index->path), "%s", path);
+        index->stamp = 0;
+        return 1;
+    }
+    unsigned long long stamp = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) |
+                               info.ftLastWriteTime.dwLowDateTime;
+    unsigned long long length = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    if (strcmp(index->path, path) == 0 && index->stamp == stamp && index->length == length) return 1;
+
+    index_reset(index);
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    unsigned char *data = xmalloc((size_t)length + 1);
+    size_t got = fread(data, 1, (size_t)length, f);
+    fclose(f);
+
+    int parsed = got == length && index_parse(index, data, (size_t)length);
+    free(data);
+    if (!parsed) {
+        index_reset(index);
+        return 0;
+    }
+    snprintf(index->path, sizeof(index->path), "%s", path);
+    index->stamp = stamp;
+    index->length = length;
+    unix_time(&info.ftLastWriteTime, &index->stamp_sec, &index->stamp_nsec);
+    return 1;
+}
+
+static int entry_state(const StatWalk *walk, const IndexEntry *entry) {
+    if ((entry->flags >> 12) & 3) return 1;
+    if (entry->flags & ENTRY_ASSUME_VALID) return 0;
+    if (entry->extended & ENTRY_SKIP_WORKTREE) return 0;
+    if (entry->extended & ENTRY_INTENT_TO_ADD) return 1;
+    if ((entry->mode & 0170000) == MODE_GITLINK) return 0;
+
+    char path[PATH_BUF];
+    snprintf(path, sizeof(path), "%s\\%s", walk->root, walk->index->paths.data + entry->path);
+    path_to_backslashes(path);
+
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) return 1;
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) return 1;
+    if (info.nFileSizeLow != entry->size) return 1;
+
+    unsigned sec, nsec;
+    unix_time(&info.ftLastWriteTime, &sec, &nsec);
+    if (sec != entry->mtime_sec) return 1;
+    if (entry->mtime_nsec && nsec / 100 != entry->mtime_nsec / 100) return 1;
+
+    const IndexCache *index = walk->index;
+    if (sec > index->stamp_sec || (sec == index->stamp_sec && nsec >= index->stamp_nsec)) return 2;
+    return 0;
+}
+
+static DWORD WINAPI stat_worker(LPVOID parameter) {
+    StatWalk *walk = parameter;
+    size_t count = walk->index->count;
+    size_t start;
+    while (!walk->dirty && (start = (size_t)(InterlockedIncrement(&walk->next) - 1) * STAT_CHUNK) < count) {
+        size_t end = start + STAT_CHUNK < count ? start + STAT_CHUNK : count;
+        for (size_t i = start; i < end && !walk->dirty; i++) {
+            int state = entry_state(walk, &walk->index->entries[i]);
+            if (state == 1) InterlockedExchange(&walk->dirty, 1);
+            else if (state == 2) InterlockedExchange(&walk->racy, 1);
+        }
+    }
+    return 0;
+}
+
+static int worktree_dirty(const char *root, const IndexCache *index, int *racy) {
+    StatWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.index = index;
+    walk.root = root;
+
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    size_t workers = system.dwNumberOfProcessors;
+    size_t chunks = (index->count + STAT_CHUNK - 1) / STAT_CHUNK;
+    if (workers > STAT_WORKERS) workers = STAT_WORKERS;
+    if (workers > chunks) workers = chunks;
+
+    HANDLE threads[STAT_WORKERS];
+    size_t started = 0;
+    for (size_t i = 1; i < workers; i++) {
+        threads[started] = CreateThread(NULL, 0, stat_worker, &walk, 0, NULL);
+        if (threads[started]) started++;
+    }
+    stat_worker(&walk);
+    if (started) WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
+    for (size_t i = 0; i < started; i++) CloseHandle(threads[i]);
+
+    *racy = (int)walk.racy;
+    return (int)walk.dirty;
+}
+
+static int pair_verified(const char *pair) {
+    for (int i = 0; i < VERIFIED_PAIRS; i++) {
+        if (strcmp(verified_pairs[i], pair) == 0) return 1;
+    }
+    return 0;
+}
+
+static int index_staged(const char *root, const char *gitdir, char *environment,
+                        const IndexCache *index) {
+    char head[41];
+    if (!resolve_head(gitdir, head)) return index->count > 0;
+
+    char pair[82] = "";
+    if (index->tree_valid) {
+        snprintf(pair, sizeof(pair), "%s:%s", head, index->tree);
+        if (pair_verified(pair)) return 0;
+    }
+
+    char key[sizeof(staged_key)];
+    snprintf(key, sizeof(key), "%s:%llu:%llu:%s", index->path, index->stamp, index->length, head);
+    if (strcmp(key, staged_key) == 0) return staged_state;
+
+    char output[64];
+    int status = run_git("diff --cached --quiet", root, environment, output, sizeof(output));
+    if (status < 0) return -1;
+    staged_state = status == 1;
+    snprintf(staged_key, sizeof(staged_key), "%s", key);
+    if (status == 0 && pair[0]) {
+        snprintf(verified_pairs[verified_next], sizeof(verified_pairs[0]), "%s", pair);
+        verified_next = (verified_next + 1) % VERIFIED_PAIRS;
+    }
+    return staged_state;
+}
+
+static int sha256_repository(const char *gitdir) {
+    char common[PATH_BUF];
+    char path[PATH_BUF];
+    common_dir(gitdir, common, sizeof(common));
+    snprintf(path, sizeof(path), "%s\\config", common);
+    char *text = read_small_file(path);
+    int sha256 = text && strstr(text, "sha256") != NULL;
+    free(text);
+    return sha256;
+}
+
+static int native_dirty(const char *root, char *environment) {
+    char gitdir[PATH_BUF];
+    char path[PATH_BUF];
+    if (!git_dir(root, gitdir, sizeof(gitdir)) || sha256_repository(gitdir)) return -1;
+    snprintf(path, sizeof(path), "%s\\index", gitdir);
+    if (!index_load(&index_cache, path)) return -1;
+
+    int racy = 0;
+    if (worktree_dirty(root, &index_cache, &racy)) return 1;
+    int staged = index_staged(root, gitdir, environment, &index_cache);
+    if (staged) return staged;
+    return racy ? -1 : 0;
+}
+
+typedef struct {
+    char root[PATH_BUF];
+    char *environment;
+} DirtyJob;
+
 static DWORD WINAPI dirty_worker(LPVOID parameter) {
-    char *root = (char *)parameter;
-    char output[512];
-    run_git("status --porcelain --untracked-files=no", root, output, sizeof(output));
-    InterlockedExchange(&dirty_state, output[0] != '\0');
+    DirtyJob *job = parameter;
+    int dirty = native_dirty(job->root, job->environment);
+    if (dirty < 0) {
+        char output[512];
+        output[0] = '\0';
+        run_git("status --porcelain --untracked-files=no", job->root, job->environment, output,
+                sizeof(output));
+        dirty = output[0] != '\0';
+    }
+    InterlockedExchange(&dirty_state, dirty);
     dirty_stamp = GetTickCount();
-    free(root);
+    free(job->environment);
+    free(job);
     InterlockedExchange(&dirty_running, 0);
     return 0;
 }
@@ -203,18 +811,28 @@ int git_dirty(void) {
         dirty_stamp = 0;
     }
 
-    DWORD now = GetTickCount();
-    int stale = dirty_stamp == 0 || now - dirty_stamp > DIRTY_REFRESH_MS;
+    watch_sync(root);
+    int stale = watch_count ? tree_stale
+                            : dirty_stamp == 0 || GetTickCount() - dirty_stamp > DIRTY_REFRESH_MS;
 
     if (stale && InterlockedCompareExchange(&dirty_running, 1, 0) == 0) {
-        char *copy = xstrdup(root);
-        HANDLE thread = CreateThread(NULL, 0, dirty_worker, copy, 0, NULL);
+        tree_stale = 0;
+        DirtyJob *job = xmalloc(sizeof(*job));
+        snprintf(job->root, sizeof(job->root), "%s", root);
+        job->environment = vars_environment_copy();
+        HANDLE thread = CreateThread(NULL, 0, dirty_worker, job, 0, NULL);
         if (thread) {
             CloseHandle(thread);
         } else {
-            free(copy);
+            free(job->environment);
+            free(job);
+            tree_stale = 1;
             InterlockedExchange(&dirty_running, 0);
         }
     }
     return (int)dirty_state;
 }
+
+int git_busy(void) {
+    return (int)dirty_running;
+}
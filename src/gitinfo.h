@@ -14,6 +14,7 @@ const char *git_branch(void);
 const char *git_repo_name(void);
 const char *git_user(void);
 int git_dirty(void);
+int git_busy(void);
 void git_invalidate(void);
 
 #endif
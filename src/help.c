@@ -160,8 +160,9 @@ static const HelpEntry ENTRIES[] = {
      "With no argument it lists everything.\n"
      "  help cd     what cd does and the arguments it takes"},
 
-    {"history", "history [-c] [<count>]", "commands you have run",
+    {"history", "history [-c|-r] [<count>]", "commands you have run",
      "  -c        forget them all\n"
+     "  -r        read the history file again\n"
      "  history 20   the last twenty"},
 
     {"if", "if <command>; then <commands>; [elif ...] [else ...] fi", "run commands when one succeeds",
@@ -171,8 +172,13 @@ static const HelpEntry ENTRIES[] = {
 
     {"jobs", "jobs", "background jobs, running or stopped", NULL},
 
-    {"mapfile", "mapfile [-t] [<name>]", "read the input into an array",
+    {"mapfile", "mapfile [-t] [-n <count>] [-s <count>] [-C <command> [-c <quantum>]] [<name>]",
+     "read the input into an array",
      "  -t   drop the newline from each line\n"
+     "  -n   read at most this many lines\n"
+     "  -s   skip this many lines first\n"
+     "  -C   run the command with the index and the line every quantum lines\n"
+     "  -c   the quantum for -C, 5000 by default\n"
      "readarray is the same command. The default name is MAPFILE."},
 
     {"paste", "paste", "print what is on the clipboard", NULL},
@@ -294,10 +300,19 @@ static const HelpEntry ENTRIES[] = {
     {"cmp", "cmp <file> <file>", "report the first byte where two files differ", NULL},
     {"column", "column [<file> ...]", "lay lines out in columns", NULL},
     {"comm", "comm <file> <file>", "compare two sorted files line by line", NULL},
-    {"cp", "cp [-r] <source> ... <destination>", "copy files",
-     "  -r   copy directories and what is inside them"},
-    {"cut", "cut -d <char> -f <field> [<file> ...]", "take one field from each line",
-     "  cut -d : -f 2 pairs.txt"},
+    {"cp", "cp [-rpua] <source> ... <destination>", "copy files",
+     "  -r   copy directories and what is inside them\n"
+     "  -p   keep the times of the originals\n"
+     "  -u   skip files whose copy is the same size and not older\n"
+     "  -a   the same as -rp"},
+    {"cut", "cut -f <list> [-d <char>] [-s] | -b <list> | -c <list> [<file> ...]",
+     "take fields or characters from each line",
+     "  -f <list>                fields, lists look like 1,3-5,7-\n"
+     "  -b <list>, -c <list>     bytes or characters\n"
+     "  -s                       skip lines without the delimiter\n"
+     "  --complement             everything except the list\n"
+     "  --output-delimiter=<s>   join the pieces with s\n"
+     "  cut -d : -f 1,3 pairs.txt"},
     {"date", "date [+<format>]", "the date and time",
      "  date +%Y-%m-%d"},
     {"df", "df", "drives with their size, used and free space", NULL},
@@ -320,7 +335,8 @@ static const HelpEntry ENTRIES[] = {
      "  -F   plain text, no pattern\n"
      "Basic regular expressions by default, the same as grep elsewhere."},
     {"groups", "groups", "the groups you belong to", NULL},
-    {"head", "head [-n <count>] [<file> ...]", "the first lines, ten by default", NULL},
+    {"head", "head [-n <count>] [-c <bytes>] [<file> ...]", "the first lines, ten by default",
+     "  -c <bytes>   the first bytes instead of lines"},
     {"hostname", "hostname", "the name of this computer", NULL},
     {"id", "id", "your user and whether the shell is elevated", NULL},
     {"kill", "kill <pid> ...", "end a process", NULL},
@@ -331,13 +347,15 @@ static const HelpEntry ENTRIES[] = {
      "  -p   make the parents too, and do not complain if it exists"},
     {"mktemp", "mktemp [-d]", "make a temporary file and print its path",
      "  -d   a directory instead"},
-    {"mv", "mv <source> ... <destination>", "move or rename", NULL},
+    {"mv", "mv [-u] <source> ... <destination>", "move or rename",
+     "  -u   leave a destination alone when it is not older than the source"},
     {"nl", "nl [<file> ...]", "number the lines", NULL},
     {"open", "open [<path>]", "open a file or folder with its usual program", NULL},
     {"paste", "paste <file> ...", "join files side by side", NULL},
     {"pkill", "pkill <name>", "end processes whose name matches", NULL},
-    {"printf", "printf <format> [<argument> ...]", "print with a format",
-     "Understands %s %d %i %c %% and \\n \\t \\r"},
+    {"printf", "printf [-v <var>] <format> [<argument> ...]", "print with a format",
+     "Understands %s %d %i %c %% and \\n \\t \\r\n"
+     "  -v   store the result in a variable instead of printing it"},
     {"ps", "ps", "processes with their id and name", NULL},
     {"realpath", "realpath <path> ...", "the full path", NULL},
     {"rev", "rev [<file> ...]", "reverse each line", NULL},
@@ -345,13 +363,17 @@ static const HelpEntry ENTRIES[] = {
      "  -r   delete directories and what is inside\n"
      "  -f   do not complain when something is missing"},
     {"rmdir", "rmdir <directory> ...", "remove empty directories", NULL},
-    {"sed", "sed [-n] [-E] '<script>' [<file> ...]", "edit a stream of lines",
-     "  s/pattern/replacement/     replace the first match on each line\n"
-     "  s/pattern/replacement/g    replace every match\n"
-     "  d                          delete the lines\n"
-     "  -n   only print what changed      -E   extended expressions\n"
+    {"sed", "sed [-n] [-E] [-i[<suffix>]] [-e '<script>'] ... ['<script>'] [<file> ...]",
+     "edit a stream of lines",
+     "  s/pattern/replacement/[g|N][p]  replace the first, every or the Nth match\n"
+     "  d p = a i c y q Q               delete, print, number, add text, transliterate, quit\n"
+     "  h H g G x n N D P z             the hold space and multi line editing\n"
+     "  { } ! : b t T                   blocks, negation, labels and branches\n"
+     "Addresses are N, $, /re/, first~step, and ranges a,b or a,+N.\n"
+     "  -n   only print what is asked      -E   extended expressions\n"
+     "  -e   add a script, several allowed -i   edit the files in place\n"
      "& is the whole match and \\1 the first group.\n"
-     "  sed 's/\\(a\\) \\(b\\)/\\2 \\1/' file"},
+     "  sed -i.bak -e 's/old/new/g' -e '/^#/d' file"},
     {"seq", "seq [<first> [<step>]] <last>", "count", NULL},
     {"sha1sum", "sha1sum <file> ...", "the SHA1 of each file", NULL},
     {"sha256sum", "sha256sum <file> ...", "the SHA256 of each file", NULL},
@@ -361,13 +383,22 @@ static const HelpEntry ENTRIES[] = {
      "  -r   reverse   -n   compare as numbers   -u   drop duplicates"},
     {"stat", "stat <file> ...", "size, type and when it changed", NULL},
     {"tac", "tac [<file> ...]", "print the lines last first", NULL},
-    {"tail", "tail [-n <count>] [<file> ...]", "the last lines, ten by default", NULL},
+    {"tail", "tail [-f|-F] [-n [+]<count>] [-c [+]<bytes>] [<file> ...]",
+     "the last lines, ten by default",
+     "  -c <bytes>   the last bytes instead of lines\n"
+     "  -n +<line>   everything from that line on\n"
+     "  -f           keep printing what is added, until Ctrl+C\n"
+     "  -F           the same, and reopen the file when it is replaced or recreated\n"
+     "A file is read backwards from its end, so its size does not matter."},
     {"tee", "tee [-a] <file> ...", "copy input to files and on through",
      "  -a   add to the files instead of replacing them"},
     {"touch", "touch <file> ...", "make a file, or update its time", NULL},
-    {"tr", "tr [-d] <set> [<set>]", "swap or drop characters",
-     "  tr a-z A-Z        upper case\n"
-     "  tr -d '\\r'        drop carriage returns"},
+    {"tr", "tr [-cds] <set> [<set>]", "swap, drop or squeeze characters",
+     "  tr a-z A-Z                  upper case\n"
+     "  tr '[:lower:]' '[:upper:]'  the same with classes\n"
+     "  tr -d '\\r'                  drop carriage returns\n"
+     "  tr -s ' '                   squeeze runs of spaces\n"
+     "  tr -cd '[:alnum:]'          keep only letters and digits"},
     {"uname", "uname [-a]", "the system name", NULL},
     {"until", "until <command>; do <commands>; done", "loop while a command keeps failing",
      "  until test -f ready; do sleep 1; done"},
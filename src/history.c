@@ -6,17 +6,84 @@
 
 #include "history.h"
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <windows.h>
 
+#include "table.h"
 #include "util.h"
 #include "vars.h"
 
-#define HISTORY_MAX 5000
+#define HISTORY_MAX 100000
+#define HISTORY_TAIL (256 * 1024)
+#define ARENA_BLOCK 65536
+#define FUZZY_SHOWN 64
 
-static char *entries[HISTORY_MAX];
-static int entry_count = 0;
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    const char *text;
+    unsigned long long signature;
+    int status;
+    int cwd;
+} Entry;
+
+typedef struct {
+    unsigned key;
+    int *ids;
+    int len;
+    int cap;
+} Posting;
+
+typedef struct {
+    char *text;
+    char *cwd;
+    int status;
+} Record;
+
+typedef struct {
+    char *path;
+    HANDLE handle;
+    long long boundary;
+    int limit;
+    int tail_count;
+    char *data;
+    Record *records;
+    int count;
+    volatile LONG done;
+} LoadJob;
+
+static ArenaBlock *arena = NULL;
+static Entry *entries = NULL;
+static int entry_first = 0;
+static int entry_end = 0;
+static int entry_cap = 0;
+static int status_entry = -1;
+
+static long long started_time = 0;
+static unsigned long long started_tick = 0;
+static LoadJob *loading = NULL;
+
+static Posting *postings = NULL;
+static size_t posting_size = 0;
+static size_t posting_count = 0;
+
+static Table cwd_ids;
+static StrList cwd_names;
+
+static StrBuf fuzzy_query;
+static int *fuzzy_ids = NULL;
+static int fuzzy_len = 0;
+static int fuzzy_end = -1;
 
 static char *history_file(void) {
     const char *custom = var_get("HISTFILE");
@@ -31,71 +98,644 @@ static int history_limit(void) {
     return n;
 }
 
+static const char *arena_store(const char *text) {
+    size_t length = strlen(text) + 1;
+    if (!arena || arena->size - arena->used < length) {
+        size_t size = length > ARENA_BLOCK ? length : ARENA_BLOCK;
+        ArenaBlock *block = xmalloc(sizeof(ArenaBlock) + size);
+        block->next = arena;
+        block->used = 0;
+        block->size = size;
+        arena = block;
+    }
+    char *copy = arena->data + arena->used;
+    memcpy(copy, text, length);
+    arena->used += length;
+    return copy;
+}
+
+static void arena_free(ArenaBlock *block) {
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static unsigned long long text_signature(const char *text) {
+    unsigned long long signature = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+        signature |= 1ULL << (tolower(*p) & 63);
+    return signature;
+}
+
+static unsigned trigram_key(const char *p) {
+    return ((unsigned)(unsigned char)tolower((unsigned char)p[0]) << 16 |
+            (unsigned)(unsigned char)tolower((unsigned char)p[1]) << 8 |
+            (unsigned)(unsigned char)tolower((unsigned char)p[2])) + 1;
+}
+
+static Posting *posting_slot(unsigned key) {
+    size_t mask = posting_size - 1;
+    size_t slot = (key * 2654435761u) & mask;
+    while (postings[slot].key && postings[slot].key != key) slot = (slot + 1) & mask;
+    return &postings[slot];
+}
+
+static Posting *posting_find(unsigned key) {
+    if (!postings) return NULL;
+    Posting *posting = posting_slot(key);
+    return posting->key ? posting : NULL;
+}
+
+static void postings_grow(void) {
+    Posting *old = postings;
+    size_t old_size = posting_size;
+    posting_size = posting_size ? posting_size * 2 : 4096;
+    postings = xmalloc(posting_size * sizeof(Posting));
+    memset(postings, 0, posting_size * sizeof(Posting));
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].key) *posting_slot(old[i].key) = old[i];
+    }
+    free(old);
+}
+
+static void postings_clear(void) {
+    for (size_t i = 0; i < posting_size; i++) free(postings[i].ids);
+    free(postings);
+    postings = NULL;
+    posting_size = 0;
+    posting_count = 0;
+}
+
+static void index_entry(int id) {
+    const char *text = entries[id].text;
+    size_t length = strlen(text);
+    for (size_t i = 0; i + 3 <= length; i++) {
+        if ((posting_count + 1) * 4 > posting_size * 3) postings_grow();
+        unsigned key = trigram_key(text + i);
+        Posting *posting = posting_slot(key);
+        if (!posting->key) {
+            posting->key = key;
+            posting_count++;
+        }
+        if (posting->len > 0 && posting->ids[posting->len - 1] == id) continue;
+        if (posting->len == posting->cap) {
+            posting->cap = posting->cap ? posting->cap * 2 : 4;
+            posting->ids = xrealloc(posting->ids, (size_t)posting->cap * sizeof(int));
+        }
+        posting->ids[posting->len++] = id;
+    }
+}
+
+static void fuzzy_forget(void) {
+    fuzzy_end = -1;
+    fuzzy_len = 0;
+}
+
+static void history_compact(void) {
+    ArenaBlock *old = arena;
+    arena = NULL;
+    int count = entry_end - entry_first;
+    for (int i = 0; i < count; i++) {
+        entries[i] = entries[entry_first + i];
+        entries[i].text = arena_store(entries[i].text);
+    }
+    arena_free(old);
+    if (status_entry >= 0) status_entry -= entry_first;
+    entry_first = 0;
+    entry_end = count;
+
+    postings_clear();
+    for (int i = 0; i < count; i++) index_entry(i);
+    fuzzy_forget();
+}
+
+static void entry_append(const char *line, int cwd, int status) {
+    if (entry_end > entry_first && strcmp(entries[entry_end - 1].text, line) == 0) {
+        entries[entry_end - 1].cwd = cwd;
+        entries[entry_end - 1].status = status;
+        status_entry = entry_end - 1;
+        return;
+    }
+
+    int limit = history_limit();
+    if (entry_end - entry_first >= limit) entry_first = entry_end - limit + 1;
+    if (entry_end == entry_cap) {
+        if (entry_first >= entry_end / 2 && entry_first > 0) {
+            history_compact();
+        } else {
+            entry_cap = entry_cap ? entry_cap * 2 : 1024;
+            entries = xrealloc(entries, (size_t)entry_cap * sizeof(Entry));
+        }
+    }
+
+    Entry *entry = &entries[entry_end];
+    entry->text = arena_store(line);
+    entry->signature = text_signature(line);
+    entry->status = status;
+    entry->cwd = cwd;
+    status_entry = entry_end;
+    index_entry(entry_end++);
+}
+
+static void entries_reset(void) {
+    arena_free(arena);
+    arena = NULL;
+    free(entries);
+    entries = NULL;
+    entry_first = entry_end = entry_cap = 0;
+    status_entry = -1;
+    postings_clear();
+    fuzzy_forget();
+}
+
+static int cwd_id(const char *cwd) {
+    if (!cwd || !*cwd) return -1;
+    if (!cwd_ids.buckets) {
+        table_init(&cwd_ids, 32, 1, NULL);
+        sl_init(&cwd_names);
+    }
+    void *id = table_get(&cwd_ids, cwd);
+    if (id) return (int)(intptr_t)id - 1;
+    sl_push_copy(&cwd_names, cwd);
+    table_put(&cwd_ids, cwd, (void *)(intptr_t)cwd_names.len);
+    return (int)cwd_names.len - 1;
+}
+
+static int current_cwd(void) {
+    char cwd[PATH_BUF];
+    if (!GetCurrentDirectoryA(sizeof(cwd), cwd)) return -1;
+    return cwd_id(cwd);
+}
+
+static void escape_field(StrBuf *out, const char *text, int separator) {
+    for (const char *p = text; *p; p++) {
+        if (*p == '\\') sb_puts(out, "\\\\");
+        else if (*p == '\n') sb_puts(out, "\\n");
+        else if (*p == '\r') sb_puts(out, "\\r");
+        else if (*p == ';' && separator) sb_puts(out, "\\;");
+        else sb_putc(out, *p);
+    }
+}
+
+static char *unescape_field(char **cursor, int separator) {
+    char *start = *cursor;
+    char *out = start;
+    char *p = start;
+    while (*p && !(separator && *p == ';')) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            *out++ = *p == 'n' ? '\n' : *p == 'r' ? '\r' : *p;
+            p++;
+        } else {
+            *out++ = *p++;
+        }
+    }
+    *cursor = *p ? p + 1 : p;
+    *out = '\0';
+    return start;
+}
+
+static int parse_record(char *line, Record *record) {
+    record->cwd = NULL;
+    record->status = 0;
+    record->text = line;
+    if (line[0] != ':' || line[1] != ' ') return *line != '\0';
+
+    char *p = line + 2;
+    strtoll(p, &p, 10);
+    if (*p != ':') return 1;
+    strtoull(p + 1, &p, 10);
+    if (*p != ':') return 1;
+    long status = strtol(p + 1, &p, 10);
+    if (*p != ':') return 1;
+
+    p++;
+    record->cwd = unescape_field(&p, 1);
+    record->status = (int)status;
+    record->text = unescape_field(&p, 0);
+    return *record->text != '\0';
+}
+
+static HANDLE journal_open(const char *path, DWORD access, DWORD disposition) {
+    return CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                       disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void journal_lock(HANDLE handle, int lock) {
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = 0xFFFFFFFF;
+    overlapped.OffsetHigh = 0x7FFFFFFF;
+    if (lock) LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+    else UnlockFileEx(handle, 0, 1, 0, &overlapped);
+}
+
+static void journal_append(const Entry *entry, long long when, unsigned long long duration) {
+    StrBuf record;
+    sb_init(&record);
+    sb_printf(&record, ": %lld:%llu:%d:", when, duration, entry->status);
+    if (entry->cwd >= 0) escape_field(&record, cwd_names.items[entry->cwd], 1);
+    sb_putc(&record, ';');
+    escape_field(&record, entry->text, 0);
+    sb_putc(&record, '\n');
+
+    char *path = history_file();
+    for (int attempt = 0; attempt < 3; attempt++) {
+        HANDLE handle = journal_open(path, GENERIC_READ | FILE_APPEND_DATA, OPEN_ALWAYS);
+        if (handle == INVALID_HANDLE_VALUE) break;
+        journal_lock(handle, 1);
+        BY_HANDLE_FILE_INFORMATION info;
+        int replaced = GetFileInformationByHandle(handle, &info) && info.nNumberOfLinks == 0;
+        DWORD written;
+        if (!replaced) WriteFile(handle, record.data, (DWORD)record.len, &written, NULL);
+        journal_lock(handle, 0);
+        CloseHandle(handle);
+        if (!replaced) break;
+    }
+    free(path);
+    sb_free(&record);
+}
+
+static char *read_range(HANDLE handle, long long offset, size_t length) {
+    LARGE_INTEGER position;
+    position.QuadPart = offset;
+    if (!SetFilePointerEx(handle, position, NULL, FILE_BEGIN)) return NULL;
+
+    char *data = xmalloc(length + 1);
+    size_t got = 0;
+    while (got < length) {
+        DWORD chunk = 0;
+        DWORD want = length - got > (1u << 20) ? (1u << 20) : (DWORD)(length - got);
+        if (!ReadFile(handle, data + got, want, &chunk, NULL) || chunk == 0) break;
+        got += chunk;
+    }
+    data[got] = '\0';
+    return data;
+}
+
+static void split_records(char *data, Record **records, int *count) {
+    int cap = 0;
+    *records = NULL;
+    *count = 0;
+    char *line = data;
+    while (*line) {
+        char *end = strchr(line, '\n');
+        char *next = end ? end + 1 : line + strlen(line);
+        if (end) *end = '\0';
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\r') line[length - 1] = '\0';
+
+        Record record;
+        if (parse_record(line, &record)) {
+            if (*count == cap) {
+                cap = cap ? cap * 2 : 256;
+                *records = xrealloc(*records, (size_t)cap * sizeof(Record));
+            }
+            (*records)[(*count)++] = record;
+        }
+        line = next;
+    }
+}
+
+static void journal_compact(const char *path, int limit) {
+    HANDLE handle = journal_open(path, GENERIC_READ, OPEN_EXISTING);
+    if (handle == INVALID_HANDLE_VALUE) return;
+    journal_lock(handle, 1);
+
+    LARGE_INTEGER size;
+    char *data = GetFileSizeEx(handle, &size) ? read_range(handle, 0, (size_t)size.QuadPart) : NULL;
+    if (data) {
+        size_t length = strlen(data);
+        size_t keep = 0;
+        int lines = 0;
+        for (size_t i = length; i > 0 && !keep; i--) {
+            if (data[i - 1] == '\n' && i < length && ++lines == limit) keep = i;
+        }
+        if (keep > 0) {
+            char temporary[PATH_BUF];
+            snprintf(temporary, sizeof(temporary), "%s.%lu", path,
+                     (unsigned long)GetCurrentProcessId());
+            HANDLE out = journal_open(temporary, GENERIC_WRITE, CREATE_ALWAYS);
+            if (out != INVALID_HANDLE_VALUE) {
+                DWORD written = 0;
+                int failed = !WriteFile(out, data + keep, (DWORD)(length - keep), &written, NULL) ||
+                             written != length - keep || !FlushFileBuffers(out);
+                CloseHandle(out);
+                if (failed || !MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING))
+                    DeleteFileA(temporary);
+            }
+        }
+        free(data);
+    }
+    journal_lock(handle, 0);
+    CloseHandle(handle);
+}
+
+static DWORD WINAPI load_worker(LPVOID parameter) {
+    LoadJob *job = parameter;
+    job->data = read_range(job->handle, 0, (size_t)job->boundary);
+    CloseHandle(job->handle);
+    if (job->data) split_records(job->data, &job->records, &job->count);
+    if (job->count + job->tail_count > 2 * job->limit) journal_compact(job->path, job->limit);
+    InterlockedExchange(&job->done, 1);
+    return 0;
+}
+
+static void load_release(LoadJob *job) {
+    free(job->path);
+    free(job->data);
+    free(job->records);
+    free(job);
+}
+
+void history_sync(void) {
+    if (!loading || !loading->done) return;
+    LoadJob *job = loading;
+    loading = NULL;
+
+    int count = entry_end - entry_first;
+    int pending = status_entry >= entry_first && status_entry < entry_end;
+    Entry *current = xmalloc((size_t)(count ? count : 1) * sizeof(Entry));
+    for (int i = 0; i < count; i++) {
+        current[i] = entries[entry_first + i];
+        current[i].text = xstrdup(current[i].text);
+    }
+
+    entries_reset();
+    for (int i = 0; i < job->count; i++)
+        entry_append(job->records[i].text, cwd_id(job->records[i].cwd), job->records[i].status);
+    for (int i = 0; i < count; i++) {
+        entry_append(current[i].text, current[i].cwd, current[i].status);
+        free((char *)current[i].text);
+    }
+    free(current);
+    status_entry = pending ? entry_end - 1 : -1;
+    load_release(job);
+}
+
+static void load_abandon(void) {
+    while (loading && !loading->done) Sleep(1);
+    if (loading) load_release(loading);
+    loading = NULL;
+    entries_reset();
+}
+
+void history_read(void) {
+    load_abandon();
+    history_load();
+    while (loading && !loading->done) Sleep(1);
+    history_sync();
+}
+
 void history_clear(void) {
-    for (int i = 0; i < entry_count; i++) free(entries[i]);
-    entry_count = 0;
+    load_abandon();
+
+    char *path = history_file();
+    HANDLE handle = journal_open(path, GENERIC_READ | GENERIC_WRITE, OPEN_EXISTING);
+    free(path);
+    if (handle == INVALID_HANDLE_VALUE) return;
+    journal_lock(handle, 1);
+    LARGE_INTEGER start;
+    start.QuadPart = 0;
+    if (SetFilePointerEx(handle, start, NULL, FILE_BEGIN)) SetEndOfFile(handle);
+    journal_lock(handle, 0);
+    CloseHandle(handle);
 }
 
 void history_add(const char *line) {
     if (!line || !*line) return;
+    status_entry = -1;
     if (line[0] == ' ') return;
-    if (entry_count > 0 && strcmp(entries[entry_count - 1], line) == 0) return;
+    entry_append(line, current_cwd(), 0);
+    started_time = (long long)time(NULL);
+    started_tick = GetTickCount64();
+}
 
-    int limit = history_limit();
-    if (entry_count >= limit) {
-        int drop = entry_count - limit + 1;
-        for (int i = 0; i < drop; i++) free(entries[i]);
-        memmove(entries, entries + drop, (size_t)(entry_count - drop) * sizeof(char *));
-        entry_count -= drop;
+void history_finish(int status) {
+    if (status_entry >= entry_first && status_entry < entry_end) {
+        Entry *entry = &entries[status_entry];
+        entry->status = status;
+        journal_append(entry, started_time, GetTickCount64() - started_tick);
     }
-    entries[entry_count++] = xstrdup(line);
+    status_entry = -1;
 }
 
 int history_count(void) {
-    return entry_count;
+    return entry_end - entry_first;
 }
 
 const char *history_get(int index) {
-    if (index < 0 || index >= entry_count) return NULL;
-    return entries[index];
+    if (index < 0 || index >= entry_end - entry_first) return NULL;
+    return entries[entry_first + index].text;
+}
+
+static const Posting *rarest_posting(const char *text, size_t length, int *missing) {
+    const Posting *best = NULL;
+    *missing = 0;
+    for (size_t i = 0; i + 3 <= length; i++) {
+        const Posting *posting = posting_find(trigram_key(text + i));
+        if (!posting) {
+            *missing = 1;
+            return NULL;
+        }
+        if (!best || posting->len < best->len) best = posting;
+    }
+    return best;
+}
+
+static int posting_position(const Posting *posting, int id) {
+    int low = 0, high = posting->len;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (posting->ids[mid] <= id) low = mid + 1;
+        else high = mid;
+    }
+    return low;
 }
 
 int history_search_prefix(const char *prefix, int from, int direction) {
     size_t n = strlen(prefix);
-    for (int i = from; i >= 0 && i < entry_count; i += direction) {
-        if (strncmp(entries[i], prefix, n) == 0) return i;
+    int missing;
+    const Posting *posting = rarest_posting(prefix, n, &missing);
+    if (missing) return -1;
+    if (!posting) {
+        for (int i = from; i >= 0 && i < entry_end - entry_first; i += direction) {
+            if (strncmp(entries[entry_first + i].text, prefix, n) == 0) return i;
+        }
+        return -1;
+    }
+
+    if (from < 0 || from >= entry_end - entry_first) return -1;
+    int id = entry_first + from;
+    int at = posting_position(posting, id);
+    if (direction < 0) {
+        for (int k = at - 1; k >= 0 && posting->ids[k] >= entry_first; k--) {
+            if (strncmp(entries[posting->ids[k]].text, prefix, n) == 0) return posting->ids[k] - entry_first;
+        }
+    } else {
+        for (int k = at > 0 && posting->ids[at - 1] == id ? at - 1 : at; k < posting->len; k++) {
+            if (posting->ids[k] < entry_first) continue;
+            if (strncmp(entries[posting->ids[k]].text, prefix, n) == 0) return posting->ids[k] - entry_first;
+        }
     }
     return -1;
 }
 
-int history_search_substring(const char *needle, int from) {
-    if (!*needle) return -1;
-    for (int i = from; i >= 0 && i < entry_count; i--) {
-        if (strstr(entries[i], needle)) return i;
+static int boundary(const char *text, size_t index) {
+    return index == 0 || strchr(" /\\-_.|;:=", text[index - 1]) != NULL;
+}
+
+static int fuzzy_score(const char *text, const char *query) {
+    int best = -1;
+    int first = tolower((unsigned char)query[0]);
+    for (size_t start = 0; text[start]; start++) {
+        if (tolower((unsigned char)text[start]) != first) continue;
+
+        int score = 16 + (boundary(text, start) ? 12 : 0) - (start < 10 ? (int)start : 10);
+        size_t at = start + 1;
+        for (const char *q = query + 1; *q; q++) {
+            size_t from = at;
+            while (text[at] && tolower((unsigned char)text[at]) != tolower((unsigned char)*q)) at++;
+            if (!text[at]) {
+                score = -1;
+                break;
+            }
+            size_t gap = at - from;
+            score += 16 + (gap == 0 ? 24 : 0) + (boundary(text, at) ? 12 : 0) - (gap < 12 ? (int)gap : 12);
+            at++;
+        }
+        if (score < 0) break;
+        if (score > best) best = score;
     }
-    return -1;
+    return best;
 }
 
-void history_load(void) {
-    char *path = history_file();
-    FILE *f = fopen(path, "r");
-    free(path);
-    if (!f) return;
+static int fuzzy_rank(int id, int score, int cwd) {
+    const Entry *entry = &entries[id];
+    int count = entry_end - entry_first;
+    int rank = score + (int)((long long)(id - entry_first + 1) * 32 / count);
+    if (entry->status > 0) rank -= 20;
+    if (cwd >= 0 && entry->cwd == cwd) rank += 16;
+    return rank;
+}
+
+int history_search_fuzzy(const char *query, int *out, int max) {
+    if (!*query || max <= 0) return 0;
+    if (!fuzzy_query.data) sb_init(&fuzzy_query);
+
+    int narrowing = fuzzy_end == entry_end && fuzzy_query.len > 0 && str_has_prefix(query, fuzzy_query.data);
+    unsigned long long signature = text_signature(query);
+    int *survivors = NULL;
+    int survivor_len = 0, survivor_cap = 0;
+    int ranks[FUZZY_SHOWN];
+    int found = 0;
+    if (max > FUZZY_SHOWN) max = FUZZY_SHOWN;
+    int cwd = current_cwd();
+
+    int total = narrowing ? fuzzy_len : entry_end - entry_first;
+    for (int k = total - 1; k >= 0; k--) {
+        int id = narrowing ? fuzzy_ids[k] : entry_first + k;
+        if (id < entry_first) continue;
+        const Entry *entry = &entries[id];
+        if ((entry->signature & signature) != signature) continue;
+        int score = fuzzy_score(entry->text, query);
+        if (score < 0) continue;
 
-    char line[4096];
-    while (fgets(line, sizeof(line), f)) {
-        line[strcspn(line, "\r\n")] = '\0';
-        if (*line) history_add(line);
+        if (survivor_len == survivor_cap) {
+            survivor_cap = survivor_cap ? survivor_cap * 2 : 256;
+            survivors = xrealloc(survivors, (size_t)survivor_cap * sizeof(int));
+        }
+        survivors[survivor_len++] = id;
+
+        int duplicate = 0;
+        for (int i = 0; i < found && !duplicate; i++)
+            duplicate = strcmp(entries[out[i] + entry_first].text, entry->text) == 0;
+        if (duplicate) continue;
+
+        int rank = fuzzy_rank(id, score, cwd);
+        if (found == max && rank <= ranks[found - 1]) continue;
+        int at = found < max ? found++ : max - 1;
+        while (at > 0 && ranks[at - 1] < rank) {
+            ranks[at] = ranks[at - 1];
+            out[at] = out[at - 1];
+            at--;
+        }
+        ranks[at] = rank;
+        out[at] = id - entry_first;
     }
-    fclose(f);
+
+    for (int i = 0, j = survivor_len - 1; i < j; i++, j--) {
+        int swap = survivors[i];
+        survivors[i] = survivors[j];
+        survivors[j] = swap;
+    }
+    free(fuzzy_ids);
+    fuzzy_ids = survivors;
+    fuzzy_len = survivor_len;
+    fuzzy_end = entry_end;
+    sb_clear(&fuzzy_query);
+    sb_puts(&fuzzy_query, query);
+    return found;
 }
 
-void history_save(void) {
+void history_load(void) {
     char *path = history_file();
-    FILE *f = fopen(path, "w");
+    HANDLE handle = journal_open(path, GENERIC_READ, OPEN_EXISTING);
+    LARGE_INTEGER size;
+    if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size)) {
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        free(path);
+        return;
+    }
+
+    long long start = size.QuadPart > HISTORY_TAIL ? size.QuadPart - HISTORY_TAIL : 0;
+    char *data = read_range(handle, start, (size_t)(size.QuadPart - start));
+    if (!data || start == 0) CloseHandle(handle);
+    if (!data) {
+        free(path);
+        return;
+    }
+
+    char *tail = data;
+    if (start > 0) {
+        char *newline = strchr(data, '\n');
+        tail = newline ? newline + 1 : data + strlen(data);
+    }
+    long long boundary = start + (tail - data);
+
+    Record *records;
+    int count;
+    split_records(tail, &records, &count);
+    for (int i = 0; i < count; i++)
+        entry_append(records[i].text, cwd_id(records[i].cwd), records[i].status);
+    status_entry = -1;
+    free(records);
+    free(data);
+
+    int limit = history_limit();
+    if (start == 0) {
+        if (count > 2 * limit) journal_compact(path, limit);
+    } else if (loading) {
+        CloseHandle(handle);
+    } else {
+        LoadJob *job = xmalloc(sizeof(LoadJob));
+        memset(job, 0, sizeof(*job));
+        job->path = path;
+        job->handle = handle;
+        job->boundary = boundary;
+        job->limit = limit;
+        job->tail_count = count;
+        loading = job;
+        HANDLE thread = CreateThread(NULL, 0, load_worker, job, 0, NULL);
+        if (thread) CloseHandle(thread);
+        else load_worker(job);
+        return;
+    }
     free(path);
-    if (!f) return;
+}
 
-    for (int i = 0; i < entry_count; i++) fprintf(f, "%s\n", entries[i]);
-    fclose(f);
+void history_save(void) {
+    if (status_entry >= entry_first && status_entry < entry_end) history_finish(-1);
 }
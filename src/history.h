@@ -10,10 +10,13 @@
 void history_load(void);
 void history_save(void);
 void history_add(const char *line);
+void history_finish(int status);
+void history_sync(void);
 void history_clear(void);
+void history_read(void);
 int history_count(void);
 const char *history_get(int index);
 int history_search_prefix(const char *prefix, int from, int direction);
-int history_search_substring(const char *needle, int from);
+int history_search_fuzzy(const char *query, int *out, int max);
 
 #endif
@@ -22,6 +22,7 @@
 #include "prompt.h"
 #include "shell.h"
 #include "style.h"
+#include "table.h"
 #include "term.h"
 #include "util.h"
 #include "vars.h"
@@ -37,6 +38,13 @@
 #define HL_SUGGEST "\x1b[90m"
 #define HL_RESET "\x1b[0m"
 
+typedef struct {
+    size_t start;
+    size_t end;
+    const char *color;
+    int expect;
+} Token;
+
 typedef struct {
     StrBuf buffer;
     size_t cursor;
@@ -51,6 +59,17 @@ typedef struct {
     size_t menu_index;
     size_t menu_start;
     int menu_active;
+    Token *tokens;
+    size_t token_count;
+    StrBuf lexed;
+    Table commands;
+    unsigned long generation;
+    StrBuf shown;
+    StrBuf shown_prompt;
+    char *shown_suggestion;
+    int shown_width;
+    int shown_colored;
+    int drawn;
 } Editor;
 
 static size_t prev_char(const char *text, size_t index) {
@@ -121,73 +140,169 @@ static int assignment_word(const char *word) {
     return *p == '=';
 }
 
-static void highlight(const char *text, StrBuf *out) {
-    const char *p = text;
-    int expect_command = 1;
+static const char *command_color(Editor *editor, const char *word) {
+    if (strchr(word, '(')) return HL_COMMAND;
 
-    while (*p) {
-        if (isspace((unsigned char)*p)) {
-            sb_putc(out, *p++);
-            continue;
-        }
-        if (*p == '|' || *p == '&' || *p == ';' || *p == '<' || *p == '>') {
-            int redirect = *p == '<' || *p == '>';
-            sb_puts(out, HL_OPERATOR);
-            while (*p == '|' || *p == '&' || *p == ';' || *p == '<' || *p == '>') sb_putc(out, *p++);
-            sb_puts(out, HL_RESET);
-            expect_command = !redirect;
-            continue;
-        }
-        if (*p == '\'' || *p == '"') {
-            char quote = *p;
-            sb_puts(out, HL_STRING);
-            sb_putc(out, *p++);
-            while (*p && *p != quote) sb_putc(out, *p++);
-            if (*p) sb_putc(out, *p++);
-            sb_puts(out, HL_RESET);
-            continue;
-        }
-        if (*p == '$') {
-            sb_puts(out, HL_VARIABLE);
-            sb_putc(out, *p++);
-            while (*p && (isalnum((unsigned char)*p) || *p == '_' || *p == '{' || *p == '}'))
-                sb_putc(out, *p++);
-            sb_puts(out, HL_RESET);
-            continue;
-        }
+    const char *color = table_get(&editor->commands, word);
+    if (!color) {
+        if (command_known(word)) color = HL_COMMAND;
+        else if (command_pending(word)) color = "";
+        else color = HL_UNKNOWN;
+        table_put(&editor->commands, word, (void *)color);
+    }
+    return *color ? color : NULL;
+}
 
-        const char *start = p;
-        while (*p && !isspace((unsigned char)*p) && !strchr("|&;<>'\"$", *p)) p++;
-        char *word = xstrndup(start, (size_t)(p - start));
+static int operator_char(char c) {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>';
+}
 
-        if (expect_command && assignment_word(word)) {
-            sb_puts(out, HL_ASSIGN);
-            sb_puts(out, word);
-            sb_puts(out, HL_RESET);
+static size_t lex_token(Editor *editor, const char *text, size_t at, int *expect, Token *token) {
+    const char *p = text + at;
+    token->start = at;
+    token->color = NULL;
+
+    if (operator_char(*p)) {
+        int redirect = *p == '<' || *p == '>';
+        while (operator_char(*p)) p++;
+        token->color = HL_OPERATOR;
+        *expect = !redirect;
+    } else if (*p == '\'' || *p == '"') {
+        char quote = *p++;
+        while (*p && *p != quote) p++;
+        if (*p) p++;
+        token->color = HL_STRING;
+    } else if (*p == '$') {
+        p++;
+        while (*p && (isalnum((unsigned char)*p) || *p == '_' || *p == '{' || *p == '}')) p++;
+        token->color = HL_VARIABLE;
+    } else {
+        while (*p && !isspace((unsigned char)*p) && !strchr("|&;<>'\"$", *p)) p++;
+        char *word = xstrndup(text + at, (size_t)(p - text - at));
+        if (*expect && assignment_word(word)) {
+            token->color = HL_ASSIGN;
         } else if (keyword_known(word)) {
-            sb_puts(out, HL_KEYWORD);
-            sb_puts(out, word);
-            sb_puts(out, HL_RESET);
-            expect_command = 1;
-        } else if (expect_command) {
-            int func_def = strchr(word, '(') != NULL;
-            const char *color;
-            if (func_def || command_known(word)) color = HL_COMMAND;
-            else if (command_pending(word)) color = NULL;
-            else color = HL_UNKNOWN;
-            if (color) sb_puts(out, color);
-            sb_puts(out, word);
-            if (color) sb_puts(out, HL_RESET);
-            expect_command = 0;
+            token->color = HL_KEYWORD;
+            *expect = 1;
+        } else if (*expect) {
+            token->color = command_color(editor, word);
+            *expect = 0;
         } else if (word[0] == '-') {
-            sb_puts(out, HL_OPTION);
-            sb_puts(out, word);
-            sb_puts(out, HL_RESET);
-        } else {
-            sb_puts(out, word);
+            token->color = HL_OPTION;
         }
         free(word);
     }
+
+    token->end = (size_t)(p - text);
+    token->expect = *expect;
+    return token->end;
+}
+
+static void token_push(Token **tokens, size_t *count, size_t *cap, Token token) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 32;
+        *tokens = xrealloc(*tokens, *cap * sizeof(Token));
+    }
+    (*tokens)[(*count)++] = token;
+}
+
+static size_t token_at(const Editor *editor, size_t offset) {
+    size_t low = 0, high = editor->token_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (editor->tokens[mid].end < offset) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+static int lex_update(Editor *editor) {
+    unsigned long generation = command_generation();
+    int relexed = generation != editor->generation;
+    if (relexed) {
+        table_free(&editor->commands);
+        table_init(&editor->commands, 64, 0, NULL);
+        editor->generation = generation;
+        editor->token_count = 0;
+        sb_clear(&editor->lexed);
+    }
+
+    const char *text = editor->buffer.data;
+    const char *old = editor->lexed.data;
+    size_t length = editor->buffer.len;
+    size_t old_length = editor->lexed.len;
+
+    size_t prefix = 0;
+    while (prefix < length && prefix < old_length && text[prefix] == old[prefix]) prefix++;
+    if (prefix == length && prefix == old_length && !relexed) return 0;
+
+    size_t suffix = 0;
+    while (suffix < length - prefix && suffix < old_length - prefix &&
+           text[length - suffix - 1] == old[old_length - suffix - 1])
+        suffix++;
+
+    size_t first = token_at(editor, prefix);
+    size_t at = first < editor->token_count && editor->tokens[first].start < prefix
+                    ? editor->tokens[first].start
+                    : prefix;
+    int expect = first > 0 ? editor->tokens[first - 1].expect : 1;
+
+    Token *tokens = NULL;
+    size_t count = 0, cap = 0;
+    for (size_t i = 0; i < first; i++) token_push(&tokens, &count, &cap, editor->tokens[i]);
+
+    size_t tail = length - suffix;
+    size_t old_index = first;
+    while (1) {
+        while (text[at] && isspace((unsigned char)text[at])) at++;
+        if (!text[at]) break;
+
+        if (at >= tail) {
+            size_t old_at = at - length + old_length;
+            while (old_index < editor->token_count && editor->tokens[old_index].start < old_at)
+                old_index++;
+            if (old_index < editor->token_count && editor->tokens[old_index].start == old_at &&
+                (old_index > 0 ? editor->tokens[old_index - 1].expect : 1) == expect) {
+                for (size_t i = old_index; i < editor->token_count; i++) {
+                    Token token = editor->tokens[i];
+                    token.start = token.start + length - old_length;
+                    token.end = token.end + length - old_length;
+                    token_push(&tokens, &count, &cap, token);
+                }
+                break;
+            }
+        }
+
+        Token token;
+        at = lex_token(editor, text, at, &expect, &token);
+        token_push(&tokens, &count, &cap, token);
+    }
+
+    free(editor->tokens);
+    editor->tokens = tokens;
+    editor->token_count = count;
+    sb_clear(&editor->lexed);
+    sb_puts(&editor->lexed, text);
+    return relexed;
+}
+
+static void paint(const Editor *editor, size_t from, int colored, StrBuf *out) {
+    const char *text = editor->buffer.data;
+    if (!colored) {
+        sb_puts(out, text + from);
+        return;
+    }
+
+    size_t at = from;
+    for (size_t i = token_at(editor, from + 1); i < editor->token_count; i++) {
+        const Token *token = &editor->tokens[i];
+        sb_putn(out, text + at, token->start - at);
+        if (token->color) sb_puts(out, token->color);
+        sb_putn(out, text + token->start, token->end - token->start);
+        if (token->color) sb_puts(out, HL_RESET);
+        at = token->end;
+    }
+    sb_puts(out, text + at);
 }
 
 static void update_suggestion(Editor *editor) {
@@ -214,39 +329,98 @@ static void prompt_metrics(Editor *editor) {
     editor->prompt_width = display_width(last);
 }
 
+static void move_cursor(StrBuf *frame, int from_row, int to_row, int col) {
+    if (from_row > to_row) sb_printf(frame, "\x1b[%dA", from_row - to_row);
+    if (to_row > from_row) sb_printf(frame, "\x1b[%dB", to_row - from_row);
+    sb_puts(frame, "\r");
+    if (col > 0) sb_printf(frame, "\x1b[%dC", col);
+}
+
+static int cell_at(const Editor *editor, size_t offset) {
+    char *prefix = xstrndup(editor->buffer.data, offset);
+    int cell = editor->prompt_width + display_width(prefix);
+    free(prefix);
+    return cell;
+}
+
+static int same_text(const char *a, const char *b) {
+    return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
 static void render(Editor *editor) {
     StrBuf frame;
     sb_init(&frame);
 
-    if (editor->rows_up > 0) sb_printf(&frame, "\x1b[%dA", editor->rows_up);
-    sb_puts(&frame, "\r\x1b[J");
-    sb_puts(&frame, editor->prompt.data);
-    if (option_enabled("FRESH_HIGHLIGHT", 1)) highlight(editor->buffer.data, &frame);
-    else sb_puts(&frame, editor->buffer.data);
+    int colored = option_enabled("FRESH_HIGHLIGHT", 1);
+    if (colored && lex_update(editor)) editor->drawn = 0;
 
-    int width = term_width();
-    int total = editor->prompt_width + display_width(editor->buffer.data);
-
-    if (editor->suggestion) {
-        sb_puts(&frame, HL_SUGGEST);
-        sb_puts(&frame, editor->suggestion);
-        sb_puts(&frame, HL_RESET);
-        total += display_width(editor->suggestion);
+    if (strcmp(editor->prompt.data, editor->shown_prompt.data) != 0) {
+        prompt_metrics(editor);
+        editor->drawn = 0;
     }
 
-    char *prefix = xstrndup(editor->buffer.data, editor->cursor);
-    int cursor_cell = editor->prompt_width + display_width(prefix);
-    free(prefix);
+    int width = term_width();
+    if (width != editor->shown_width || colored != editor->shown_colored) editor->drawn = 0;
+
+    size_t from = 0;
+    int repaint = 1;
+    if (editor->drawn) {
+        const char *text = editor->buffer.data;
+        const char *shown = editor->shown.data;
+        while (from < editor->buffer.len && from < editor->shown.len && text[from] == shown[from])
+            from++;
+        if (from == editor->buffer.len && from == editor->shown.len) {
+            repaint = !same_text(editor->suggestion, editor->shown_suggestion);
+        } else {
+            while (from > 0 && ((unsigned char)text[from] & 0xC0) == 0x80) from--;
+            if (colored) {
+                size_t index = token_at(editor, from);
+                if (index < editor->token_count && editor->tokens[index].start < from)
+                    from = editor->tokens[index].start;
+            }
+        }
+    }
 
+    int total = editor->prompt_width + display_width(editor->buffer.data);
+    if (editor->suggestion) total += display_width(editor->suggestion);
+    int cursor_cell = cell_at(editor, editor->cursor);
     int end_row = editor->prompt_rows + total / width;
     int cursor_row = editor->prompt_rows + cursor_cell / width;
     int cursor_col = cursor_cell % width;
+    int row = editor->rows_up;
 
-    if (end_row > cursor_row) sb_printf(&frame, "\x1b[%dA", end_row - cursor_row);
-    sb_puts(&frame, "\r");
-    if (cursor_col > 0) sb_printf(&frame, "\x1b[%dC", cursor_col);
+    if (!editor->drawn) {
+        if (editor->rows_up > 0) sb_printf(&frame, "\x1b[%dA", editor->rows_up);
+        sb_puts(&frame, "\r\x1b[J");
+        sb_puts(&frame, editor->prompt.data);
+    } else if (repaint) {
+        int from_cell = cell_at(editor, from);
+        move_cursor(&frame, row, editor->prompt_rows + from_cell / width, from_cell % width);
+        sb_puts(&frame, "\x1b[J");
+    }
+
+    if (repaint) {
+        paint(editor, from, colored, &frame);
+        if (editor->suggestion) {
+            sb_puts(&frame, HL_SUGGEST);
+            sb_puts(&frame, editor->suggestion);
+            sb_puts(&frame, HL_RESET);
+        }
+        row = end_row;
+    }
+    move_cursor(&frame, row, cursor_row, cursor_col);
 
     editor->rows_up = cursor_row;
+    editor->shown_width = width;
+    editor->shown_colored = colored;
+    editor->drawn = 1;
+    sb_clear(&editor->shown);
+    sb_puts(&editor->shown, editor->buffer.data);
+    sb_clear(&editor->shown_prompt);
+    sb_puts(&editor->shown_prompt, editor->prompt.data);
+    free(editor->shown_suggestion);
+    editor->shown_suggestion = editor->suggestion ? xstrdup(editor->suggestion) : NULL;
+
     term_write(frame.data);
     sb_free(&frame);
 }
@@ -258,6 +432,7 @@ static void finish_line(Editor *editor) {
     render(editor);
     term_write("\r\n");
     editor->rows_up = 0;
+    editor->drawn = 0;
 }
 
 static void editor_set_text(Editor *editor, const char *text) {
@@ -305,6 +480,7 @@ static void print_matches(Editor *editor, const StrList *matches) {
     term_write(out.data);
     sb_free(&out);
     editor->rows_up = 0;
+    editor->drawn = 0;
 }
 
 static void apply_match(Editor *editor, size_t start, const char *match, int single) {
@@ -330,7 +506,14 @@ static void complete(Editor *editor) {
 
     sl_clear(&editor->menu);
     size_t start = 0;
-    complete_at(editor->buffer.data, editor->cursor, &editor->menu, &start);
+    CompleteJob *job = complete_start(editor->buffer.data, editor->cursor);
+    while (!complete_wait(job, 15)) {
+        if (term_input_pending()) {
+            complete_cancel(job);
+            return;
+        }
+    }
+    complete_finish(job, &editor->menu, &start);
     editor->menu_start = start;
 
     if (editor->menu.len == 0) return;
@@ -365,10 +548,12 @@ static void complete(Editor *editor) {
 static void search_history(Editor *editor) {
     StrBuf query;
     sb_init(&query);
-    int index = history_count() - 1;
-    int found = -1;
+    int results[32];
+    int count = 0;
+    int shown = 0;
 
     while (1) {
+        int found = shown < count ? results[shown] : -1;
         StrBuf frame;
         sb_init(&frame);
         if (editor->rows_up > 0) sb_printf(&frame, "\x1b[%dA", editor->rows_up);
@@ -376,6 +561,7 @@ static void search_history(Editor *editor) {
         sb_printf(&frame, HL_OPERATOR "search:" HL_RESET " %s", query.data);
         if (found >= 0) sb_printf(&frame, HL_SUGGEST "  %s" HL_RESET, history_get(found));
         editor->rows_up = 0;
+        editor->drawn = 0;
         term_write(frame.data);
         sb_free(&frame);
 
@@ -384,21 +570,24 @@ static void search_history(Editor *editor) {
             if (key == KEY_ENTER && found >= 0) editor_set_text(editor, history_get(found));
             break;
         }
+        if (key == KEY_CTRL_R) {
+            if (shown + 1 < count) shown++;
+            continue;
+        }
         if (key == KEY_BACKSPACE) {
             if (query.len > 0) query.data[--query.len] = '\0';
-        } else if (key == KEY_CTRL_R) {
-            if (found > 0) index = found - 1;
         } else if (key >= 32 && key < 256) {
             sb_putc(&query, (char)key);
-            index = history_count() - 1;
         } else {
             continue;
         }
-        found = history_search_substring(query.data, index);
+        count = history_search_fuzzy(query.data, results, 32);
+        shown = 0;
     }
 
     sb_free(&query);
     editor->rows_up = 0;
+    editor->drawn = 0;
     term_write("\r\x1b[J");
 }
 
@@ -456,9 +645,13 @@ char *line_read(int continuation) {
     memset(&editor, 0, sizeof(editor));
     sb_init(&editor.buffer);
     sb_init(&editor.prompt);
+    sb_init(&editor.lexed);
+    sb_init(&editor.shown);
+    sb_init(&editor.shown_prompt);
     sl_init(&editor.menu);
     editor.history_index = -1;
     shell.interrupted = 0;
+    history_sync();
 
     if (continuation) {
         prompt_build_continuation(&editor.prompt);
@@ -472,6 +665,9 @@ char *line_read(int continuation) {
 
     char *result = NULL;
     while (1) {
+        while (!continuation && prompt_pending() && !term_wait_input(15)) {
+            if (prompt_refresh(&editor.prompt)) render(&editor);
+        }
         int key = term_read_key();
         int pasting = term_input_pending();
         int was_tab = key == KEY_TAB;
@@ -513,7 +709,7 @@ char *line_read(int continuation) {
             break;
         }
         if (key == KEY_CTRL_D) {
-            if (editor.buffer.len == 0) {
+            if (editor.buffer.len == 0 || term_input_ended()) {
                 finish_line(&editor);
                 result = NULL;
                 break;
@@ -564,6 +760,7 @@ char *line_read(int continuation) {
         } else if (key == KEY_CTRL_L) {
             term_clear_screen();
             editor.rows_up = 0;
+            editor.drawn = 0;
         } else if (key == KEY_CTRL_R) {
             search_history(&editor);
         } else if (key == KEY_ESC) {
@@ -590,5 +787,11 @@ char *line_read(int continuation) {
     sl_free(&editor.menu);
     free(editor.suggestion);
     free(editor.stashed);
+    free(editor.tokens);
+    sb_free(&editor.lexed);
+    sb_free(&editor.shown);
+    sb_free(&editor.shown_prompt);
+    free(editor.shown_suggestion);
+    table_free(&editor.commands);
     return result;
 }
@@ -19,6 +19,7 @@
 #include "line.h"
 #include "parser.h"
 #include "shell.h"
+#include "startup.h"
 #include "style.h"
 #include "term.h"
 #include "theme.h"
@@ -60,6 +61,7 @@ static const char *DEFAULT_RC =
     "#   %? exit code   %e exit code only when it failed   %# prompt character\n"
     "#   %F{green} colour on   %f colour off   %K{blue} background   %k off\n"
     "#   %S bold on   %s bold off   \\n new line\n"
+    "#   %(command) output of command, filled in from the background\n"
     "# FRESH_PROMPT='%F{cyan}%~%f%g\\n%# '\n"
     "# FRESH_RPROMPT='%t'\n"
     "\n"
@@ -115,14 +117,25 @@ static const char *DEFAULT_RC =
 
 void shell_error(const char *fmt, ...) {
     int colored = _isatty(_fileno(stderr));
-    fflush(stdout);
-    fputs(colored ? "\x1b[31mFreSH: " : "FreSH: ", stderr);
+    StrBuf message;
+    sb_init(&message);
+    sb_puts(&message, colored ? "\x1b[31mFreSH: " : "FreSH: ");
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
     va_end(ap);
-    fputs(colored ? "\x1b[0m\n" : "\n", stderr);
+    if (n > 0) {
+        sb_reserve(&message, (size_t)n);
+        va_start(ap, fmt);
+        vsnprintf(message.data + message.len, (size_t)n + 1, fmt, ap);
+        va_end(ap);
+        message.len += (size_t)n;
+    }
+    sb_puts(&message, colored ? "\x1b[0m\n" : "\n");
+    fflush(stdout);
+    fwrite(message.data, 1, message.len, stderr);
     fflush(stderr);
+    sb_free(&message);
 }
 
 void shell_handle_signal(int which) {
@@ -187,7 +200,7 @@ static void load_rc(void) {
             fclose(f);
         }
     }
-    if (path_is_file(rc)) exec_script_file(rc, NULL);
+    startup_source(rc);
     free(rc);
     timing_mark("freshrc");
 
@@ -197,6 +210,8 @@ static void load_rc(void) {
     timing_mark("theme");
     plugins_load_configured();
     timing_mark("plugins");
+    startup_image_finish();
+    timing_mark("startup image");
 }
 
 static void binary_when_not_a_console(void) {
@@ -208,8 +223,7 @@ static void binary_when_not_a_console(void) {
         if (GetConsoleMode(GetStdHandle(STREAMS[i]), &mode)) continue;
         _setmode(_fileno(files[i]), _O_BINARY);
     }
-    setvbuf(stdout, NULL, _IOFBF, 8192);
-    setvbuf(stderr, NULL, _IONBF, 0);
+    out_init();
 }
 
 void shell_init(int interactive) {
@@ -266,10 +280,7 @@ static const char *history_match(const char *reference, size_t length) {
         int index = atoi(wanted) - 1;
         return index >= 0 && index < history_count() ? history_get(index) : NULL;
     }
-    for (int i = history_count() - 1; i >= 0; i--) {
-        if (strncmp(history_get(i), wanted, length) == 0) return history_get(i);
-    }
-    return NULL;
+    return history_get(history_search_prefix(wanted, history_count() - 1, -1));
 }
 
 static char *expand_history(const char *line, int *changed) {
@@ -387,16 +398,17 @@ static void interactive_loop(void) {
             if (expanded) {
                 if (changed) printf("%s\n", expanded);
                 history_add(expanded);
-                history_save();
                 exec_text(expanded);
+                history_finish(shell.last_status);
                 free(expanded);
             }
         } else if (*trimmed) {
             history_add(trimmed);
-            history_save();
             exec_text(trimmed);
+            history_finish(shell.last_status);
         }
         sb_free(&command);
+        out_flush();
     }
 }
 
@@ -512,6 +524,7 @@ int main(int argc, char *argv[]) {
     } else {
         if (read_rc) load_rc();
         history_load();
+        path_commands_prepare();
         interactive_loop();
         history_save();
         status = shell.last_status;
@@ -21,12 +21,13 @@
 #include "awk.h"
 #include "exec.h"
 #include "expand.h"
-#include "regex.h"
+#include "sed.h"
 #include "shell.h"
 #include "table.h"
 #include "update.h"
 #include "style.h"
 #include "util.h"
+#include "vars.h"
 
 #define LINE_MAX_LEN 8192
 
@@ -76,7 +77,7 @@ static int more_nl(int argc, char **argv) {
     StrList lines;
     sl_init(&lines);
     read_lines(argc, argv, first_operand(argc, argv), &lines);
-    for (size_t i = 0; i < lines.len; i++) printf("%6zu\t%s\n", i + 1, lines.items[i]);
+    for (size_t i = 0; i < lines.len; i++) out_printf("%6zu\t%s\n", i + 1, lines.items[i]);
     sl_free(&lines);
     return 0;
 }
@@ -85,7 +86,7 @@ static int more_tac(int argc, char **argv) {
     StrList lines;
     sl_init(&lines);
     read_lines(argc, argv, first_operand(argc, argv), &lines);
-    for (size_t i = lines.len; i > 0; i--) printf("%s\n", lines.items[i - 1]);
+    for (size_t i = lines.len; i > 0; i--) out_printf("%s\n", lines.items[i - 1]);
     sl_free(&lines);
     return 0;
 }
@@ -97,8 +98,8 @@ static int more_rev(int argc, char **argv) {
     for (size_t i = 0; i < lines.len; i++) {
         char *line = lines.items[i];
         size_t length = strlen(line);
-        for (size_t c = length; c > 0; c--) putchar(line[c - 1]);
-        putchar('\n');
+        for (size_t c = length; c > 0; c--) out_putc(line[c - 1]);
+        out_putc('\n');
     }
     sl_free(&lines);
     return 0;
@@ -107,146 +108,11 @@ static int more_rev(int argc, char **argv) {
 static int more_yes(int argc, char **argv) {
     const char *text = argc > 1 ? argv[1] : "y";
     for (long i = 0; i < 100000; i++) {
-        if (printf("%s\n", text) < 0) break;
+        if (out_printf("%s\n", text) < 0) break;
     }
     return 0;
 }
 
-static int replace_once(const char *line, const char *pattern, const char *replacement, int global,
-                        StrBuf *out) {
-    const char *cursor = line;
-    size_t pattern_length = strlen(pattern);
-    int replaced = 0;
-
-    while (*cursor) {
-        const char *hit = pattern_length ? strstr(cursor, pattern) : NULL;
-        if (!hit || (replaced && !global)) {
-            sb_puts(out, cursor);
-            break;
-        }
-        sb_putn(out, cursor, (size_t)(hit - cursor));
-        sb_puts(out, replacement);
-        cursor = hit + pattern_length;
-        replaced = 1;
-    }
-    return replaced;
-}
-
-static int more_sed(int argc, char **argv) {
-    int quiet = flag_set(argc, argv, 'n');
-    int extended = flag_set(argc, argv, 'E') || flag_set(argc, argv, 'r');
-    int index = first_operand(argc, argv);
-    if (index >= argc) {
-        shell_error("sed: usage: sed [-n] '[/address/]s/pattern/replacement/[g]' [file...]");
-        return 2;
-    }
-
-    char *script = xstrdup(argv[index++]);
-
-    StrList lines;
-    sl_init(&lines);
-    read_lines(argc, argv, index, &lines);
-
-    char *cursor = script;
-    StrBuf address;
-    sb_init(&address);
-    long address_line = 0;
-    int addressed = 0;
-
-    if (*cursor == '/') {
-        char *close = strchr(cursor + 1, '/');
-        if (!close) {
-            shell_error("sed: unterminated address");
-            sb_free(&address);
-            sl_free(&lines);
-            free(script);
-            return 2;
-        }
-        *close = '\0';
-        if (extended) sb_puts(&address, cursor + 1);
-        else regex_bre_to_ere(cursor + 1, &address);
-        addressed = 1;
-        cursor = close + 1;
-    } else if (isdigit((unsigned char)*cursor)) {
-        address_line = strtol(cursor, &cursor, 10);
-        addressed = 1;
-    }
-
-    char command = *cursor;
-    char *pattern = NULL;
-    char *replacement = NULL;
-    int global = 0;
-
-    if (command == 's' && cursor[1]) {
-        char separator = cursor[1];
-        pattern = cursor + 2;
-        char *middle = strchr(pattern, separator);
-        if (!middle) {
-            shell_error("sed: unterminated s command");
-            sb_free(&address);
-            sl_free(&lines);
-            free(script);
-            return 2;
-        }
-        *middle = '\0';
-        replacement = middle + 1;
-        char *end = strchr(replacement, separator);
-        if (end) {
-            *end = '\0';
-            global = strchr(end + 1, 'g') != NULL;
-        }
-    } else if (command != 'd' && command != 'p') {
-        shell_error("sed: %c: only s, d and p are supported, with an optional /address/", command);
-        sb_free(&address);
-        sl_free(&lines);
-        free(script);
-        return 2;
-    }
-
-    StrBuf expression;
-    sb_init(&expression);
-    if (pattern) {
-        if (extended) sb_puts(&expression, pattern);
-        else regex_bre_to_ere(pattern, &expression);
-    }
-
-    for (size_t i = 0; i < lines.len; i++) {
-        const char *line = lines.items[i];
-        int selected = 1;
-        if (addressed) {
-            selected = address_line ? (long)(i + 1) == address_line
-                                    : regex_search(address.data, line, NULL);
-        }
-
-        if (command == 'd') {
-            if (!selected && !quiet) printf("%s\n", line);
-            continue;
-        }
-        if (command == 'p') {
-            if (!quiet) printf("%s\n", line);
-            if (selected) printf("%s\n", line);
-            continue;
-        }
-
-        if (!selected) {
-            if (!quiet) printf("%s\n", line);
-            continue;
-        }
-
-        StrBuf out;
-        sb_init(&out);
-        int replaced = regex_replace(expression.data, replacement, line, global, &out);
-        if (!quiet || replaced) printf("%s\n", out.data);
-        sb_free(&out);
-    }
-
-    sb_free(&expression);
-    sb_free(&address);
-    sl_free(&lines);
-    free(script);
-    return 0;
-}
-
 static int more_paste(int argc, char **argv) {
     int start = first_operand(argc, argv);
     int count = argc - start;
@@ -269,7 +135,7 @@ static int more_paste(int argc, char **argv) {
             sb_puts(&row, line.data);
         }
         sb_free(&line);
-        if (active) printf("%s\n", row.data);
+        if (active) out_printf("%s\n", row.data);
         sb_free(&row);
     }
 
@@ -304,10 +170,10 @@ static int more_comm(int argc, char **argv) {
         int compared = i >= left.len ? 1
                        : j >= right.len ? -1
                                         : strcmp(left.items[i], right.items[j]);
-        if (compared < 0) printf("%s\n", left.items[i++]);
-        else if (compared > 0) printf("\t%s\n", right.items[j++]);
+        if (compared < 0) out_printf("%s\n", left.items[i++]);
+        else if (compared > 0) out_printf("\t%s\n", right.items[j++]);
         else {
-            printf("\t\t%s\n", left.items[i]);
+            out_printf("\t\t%s\n", left.items[i]);
             i++;
             j++;
         }
@@ -329,7 +195,7 @@ static int more_shuf(int argc, char **argv) {
         lines.items[i - 1] = lines.items[j];
         lines.items[j] = swap;
     }
-    for (size_t i = 0; i < lines.len; i++) printf("%s\n", lines.items[i]);
+    for (size_t i = 0; i < lines.len; i++) out_printf("%s\n", lines.items[i]);
     sl_free(&lines);
     return 0;
 }
@@ -363,11 +229,11 @@ static int more_fold(int argc, char **argv) {
         const char *line = lines.items[i];
         size_t length = strlen(line);
         if (length == 0) {
-            printf("\n");
+            out_printf("\n");
             continue;
         }
         for (size_t offset = 0; offset < length; offset += (size_t)width)
-            printf("%.*s\n", width, line + offset);
+            out_printf("%.*s\n", width, line + offset);
     }
     sl_free(&lines);
     return 0;
@@ -388,10 +254,10 @@ static int more_column(int argc, char **argv) {
     if (columns < 1) columns = 1;
 
     for (size_t i = 0; i < lines.len; i++) {
-        printf("%-*s", column_width, lines.items[i]);
-        if ((i + 1) % (size_t)columns == 0) printf("\n");
+        out_printf("%-*s", column_width, lines.items[i]);
+        if ((i + 1) % (size_t)columns == 0) out_printf("\n");
     }
-    if (lines.len % (size_t)columns) printf("\n");
+    if (lines.len % (size_t)columns) out_printf("\n");
     sl_free(&lines);
     return 0;
 }
@@ -418,7 +284,7 @@ static int more_cmp(int argc, char **argv) {
         int cb = fgetc(b);
         if (ca == EOF && cb == EOF) break;
         if (ca != cb) {
-            printf("%s %s differ: byte %ld, line %ld\n", argv[start], argv[start + 1], position,
+            out_printf("%s %s differ: byte %ld, line %ld\n", argv[start], argv[start + 1], position,
                    line);
             status = 1;
             break;
@@ -467,9 +333,9 @@ static int more_diff(int argc, char **argv) {
             continue;
         }
         status = 1;
-        printf("%s%zu%s\n", style(S_DIM), i + 1, style(S_RESET));
-        if (a) printf("%s< %s%s\n", style(S_ERROR), a, style(S_RESET));
-        if (b) printf("%s> %s%s\n", style(S_ACCENT), b, style(S_RESET));
+        out_printf("%s%zu%s\n", style(S_DIM), i + 1, style(S_RESET));
+        if (a) out_printf("%s< %s%s\n", style(S_ERROR), a, style(S_RESET));
+        if (b) out_printf("%s> %s%s\n", style(S_ACCENT), b, style(S_RESET));
         i++;
     }
     sl_free(&left);
@@ -491,7 +357,7 @@ static int more_expr(int argc, char **argv) {
         shell_error("expr: invalid expression");
         return 2;
     }
-    printf("%ld\n", value);
+    out_printf("%ld\n", value);
     return value != 0 ? 0 : 1;
 }
 
@@ -514,11 +380,11 @@ static int more_stat(int argc, char **argv) {
         FileTimeToLocalFileTime(&info.ftLastWriteTime, &local);
         FileTimeToSystemTime(&local, &modified);
 
-        printf("  %sfile%s     %s\n", style(S_LABEL), style(S_RESET), argv[i]);
-        printf("  %ssize%s     %llu\n", style(S_LABEL), style(S_RESET), size);
-        printf("  %stype%s     %s\n", style(S_LABEL), style(S_RESET),
+        out_printf("  %sfile%s     %s\n", style(S_LABEL), style(S_RESET), argv[i]);
+        out_printf("  %ssize%s     %llu\n", style(S_LABEL), style(S_RESET), size);
+        out_printf("  %stype%s     %s\n", style(S_LABEL), style(S_RESET),
                (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? "directory" : "file");
-        printf("  %smodified%s %04d-%02d-%02d %02d:%02d:%02d\n", style(S_LABEL), style(S_RESET),
+        out_printf("  %smodified%s %04d-%02d-%02d %02d:%02d:%02d\n", style(S_LABEL), style(S_RESET),
                modified.wYear, modified.wMonth, modified.wDay, modified.wHour, modified.wMinute,
                modified.wSecond);
     }
@@ -532,13 +398,13 @@ static int more_df(int argc, char **argv) {
     DWORD length = GetLogicalDriveStringsA(sizeof(drives), drives);
     if (!length) return 1;
 
-    printf("  %s%-6s %10s %10s %10s%s\n", style(S_LABEL), "drive", "size", "used", "free",
+    out_printf("  %s%-6s %10s %10s %10s%s\n", style(S_LABEL), "drive", "size", "used", "free",
            style(S_RESET));
     for (char *drive = drives; *drive; drive += strlen(drive) + 1) {
         ULARGE_INTEGER available, total, free_bytes;
         if (!GetDiskFreeSpaceExA(drive, &available, &total, &free_bytes)) continue;
         double gigabyte = 1024.0 * 1024.0 * 1024.0;
-        printf("  %-6s %9.1fG %9.1fG %9.1fG\n", drive, total.QuadPart / gigabyte,
+        out_printf("  %-6s %9.1fG %9.1fG %9.1fG\n", drive, total.QuadPart / gigabyte,
                (total.QuadPart - free_bytes.QuadPart) / gigabyte, free_bytes.QuadPart / gigabyte);
     }
     return 0;
@@ -552,11 +418,11 @@ static int more_ps(int argc, char **argv) {
 
     PROCESSENTRY32 entry;
     entry.dwSize = sizeof(entry);
-    printf("  %s%8s %8s  %s%s\n", style(S_LABEL), "pid", "threads", "name", style(S_RESET));
+    out_printf("  %s%8s %8s  %s%s\n", style(S_LABEL), "pid", "threads", "name", style(S_RESET));
 
     if (Process32First(snapshot, &entry)) {
         do {
-            printf("  %8lu %8lu  %s\n", entry.th32ProcessID, entry.cntThreads, entry.szExeFile);
+            out_printf("  %8lu %8lu  %s\n", entry.th32ProcessID, entry.cntThreads, entry.szExeFile);
         } while (Process32Next(snapshot, &entry));
     }
     CloseHandle(snapshot);
@@ -602,14 +468,14 @@ static int more_id(int argc, char **argv) {
     DWORD host_size = sizeof(host);
     if (!GetComputerNameA(host, &host_size)) snprintf(host, sizeof(host), "?");
 
-    printf("user=%s host=%s admin=%s\n", user, host, running_elevated() ? "yes" : "no");
+    out_printf("user=%s host=%s admin=%s\n", user, host, running_elevated() ? "yes" : "no");
     return 0;
 }
 
 static int more_groups(int argc, char **argv) {
     (void)argc;
     (void)argv;
-    printf("%s\n", running_elevated() ? "users administrators" : "users");
+    out_printf("%s\n", running_elevated() ? "users administrators" : "users");
     return 0;
 }
 
@@ -626,7 +492,7 @@ static int more_mktemp(int argc, char **argv) {
         if (!path_mkdirs(file)) return 1;
     }
     path_to_slashes(file);
-    printf("%s\n", file);
+    out_printf("%s\n", file);
     return 0;
 }
 
@@ -640,7 +506,7 @@ static int more_realpath(int argc, char **argv) {
             continue;
         }
         path_to_slashes(full);
-        printf("%s\n", full);
+        out_printf("%s\n", full);
     }
     return status;
 }
@@ -715,6 +581,7 @@ static int more_open(int argc, char **argv) {
         return 1;
     }
 
+    vars_sync_environment();
     HINSTANCE result = shell_open(NULL, "open", target, NULL, NULL, SW_SHOWNORMAL);
     if ((INT_PTR)result <= 32) {
         shell_error("open: %s: cannot open", target);
@@ -805,7 +672,7 @@ static int hash_command(int argc, char **argv, ALG_ID algorithm) {
             status = 1;
             continue;
         }
-        printf("%s  %s\n", digest, argv[i]);
+        out_printf("%s  %s\n", digest, argv[i]);
     }
     return status;
 }
@@ -826,7 +693,7 @@ static int more_file(int argc, char **argv) {
     int status = 0;
     for (int i = first_operand(argc, argv); i < argc; i++) {
         if (path_is_dir(argv[i])) {
-            printf("%s: directory\n", argv[i]);
+            out_printf("%s: directory\n", argv[i]);
             continue;
         }
         FILE *f = fopen(argv[i], "rb");
@@ -853,7 +720,7 @@ static int more_file(int argc, char **argv) {
             }
             kind = text ? "text" : "binary data";
         }
-        printf("%s: %s\n", argv[i], kind);
+        out_printf("%s: %s\n", argv[i], kind);
     }
     return status;
 }
@@ -878,7 +745,7 @@ static int more_wget(int argc, char **argv) {
         output = derived;
     }
 
-    printf("%s%s%s -> %s\n", style(S_DIM), url, style(S_RESET), output);
+    out_printf("%s%s%s -> %s\n", style(S_DIM), url, style(S_RESET), output);
     if (!http_download(url, output)) {
         shell_error("wget: could not fetch %s", url);
         return 1;
@@ -899,7 +766,7 @@ static const MoreUtil MOREUTILS[] = {
     {"md5sum", more_md5sum}, {"mktemp", more_mktemp},   {"nl", more_nl},
     {"open", more_open},     {"paste", more_paste},     {"pkill", more_pkill},
     {"ps", more_ps},         {"realpath", more_realpath}, {"rev", more_rev},
-    {"sed", more_sed},       {"sha1sum", more_sha1sum}, {"sha256sum", more_sha256sum},
+    {"sed", sed_main},       {"sha1sum", more_sha1sum}, {"sha256sum", more_sha256sum},
     {"shuf", more_shuf},     {"stat", more_stat},       {"tac", more_tac},
     {"wget", more_wget},     {"awk", awk_main},
     {"yes", more_yes},
@@ -589,6 +589,11 @@ static Node *node_new(NodeKind kind) {
 
 void node_free(Node *node) {
     if (!node) return;
+    for (size_t i = 0; node->info && i < node->words.len; i++) {
+        free(node->info[i].text);
+        free(node->info[i].segments);
+    }
+    free(node->info);
     sl_free(&node->words);
     Redir *r = node->redirs;
     while (r) {
@@ -601,6 +606,7 @@ void node_free(Node *node) {
     node_free(node->right);
     node_free(node->extra);
     free(node->name);
+    free(node->dispatch);
     free(node);
 }
 
@@ -750,6 +756,213 @@ int node_source(const Node *node, StrBuf *out) {
     return ok;
 }
 
+#define NODE_NONE 0xFFFFFFFFu
+#define NODE_DEPTH 10000
+
+typedef struct {
+    const char *at;
+    const char *end;
+    int failed;
+} NodeReader;
+
+static void encode_number(StrBuf *out, unsigned value) {
+    sb_putn(out, (const char *)&value, sizeof(value));
+}
+
+static void encode_text(StrBuf *out, const char *text) {
+    if (!text) {
+        encode_number(out, NODE_NONE);
+        return;
+    }
+    size_t length = strlen(text);
+    encode_number(out, (unsigned)length);
+    sb_putn(out, text, length);
+}
+
+static int seq_bare(const Node *node) {
+    return node && node->kind == N_SEQ && !node->name && !node->words.len && !node->info &&
+           !node->redirs && !node->extra && !node->background && !node->line;
+}
+
+static int encode_node(const Node *node, StrBuf *out, int depth) {
+    if (!node) {
+        encode_number(out, NODE_NONE);
+        return 1;
+    }
+    if (depth > NODE_DEPTH) return 0;
+    encode_number(out, (unsigned)node->kind);
+    encode_number(out, (unsigned)node->background);
+    encode_number(out, (unsigned)node->line);
+    encode_text(out, node->name);
+
+    encode_number(out, (unsigned)node->words.len);
+    for (size_t i = 0; i < node->words.len; i++) encode_text(out, node->words.items[i]);
+    encode_number(out, node->info ? 1u : 0u);
+    for (size_t i = 0; node->info && i < node->words.len; i++) {
+        const WordInfo *info = &node->info[i];
+        encode_number(out, info->flags);
+        encode_number(out, (unsigned)info->prefix);
+        encode_text(out, info->text);
+        encode_number(out, (unsigned)info->count);
+        for (size_t s = 0; s < info->count; s++) {
+            encode_number(out, (unsigned)info->segments[s].kind);
+            encode_number(out, (unsigned)info->segments[s].start);
+            encode_number(out, (unsigned)info->segments[s].length);
+        }
+    }
+
+    unsigned redirs = 0;
+    for (const Redir *r = node->redirs; r; r = r->next) redirs++;
+    encode_number(out, redirs);
+    for (const Redir *r = node->redirs; r; r = r->next) {
+        encode_number(out, (unsigned)r->fd);
+        encode_number(out, (unsigned)r->type);
+        encode_text(out, r->target);
+    }
+
+    if (node->kind != N_SEQ) {
+        return encode_node(node->left, out, depth + 1) &&
+               encode_node(node->right, out, depth + 1) &&
+               encode_node(node->extra, out, depth + 1);
+    }
+
+    size_t count = 2;
+    for (const Node *spine = node->left; seq_bare(spine); spine = spine->left) count++;
+    const Node **items = xmalloc(count * sizeof(Node *));
+    const Node *spine = node;
+    for (size_t i = count; i-- > 1; spine = spine->left) items[i] = spine->right;
+    items[0] = spine;
+    encode_number(out, (unsigned)count);
+    int ok = 1;
+    for (size_t i = 0; ok && i < count; i++) ok = encode_node(items[i], out, depth + 1);
+    free(items);
+    return ok && encode_node(node->extra, out, depth + 1);
+}
+
+int node_encode(const Node *node, StrBuf *out) {
+    return encode_node(node, out, 0);
+}
+
+static unsigned decode_number(NodeReader *in) {
+    unsigned value = 0;
+    if (in->failed || (size_t)(in->end - in->at) < sizeof(value)) {
+        in->failed = 1;
+        return 0;
+    }
+    memcpy(&value, in->at, sizeof(value));
+    in->at += sizeof(value);
+    return value;
+}
+
+static char *decode_text(NodeReader *in) {
+    unsigned length = decode_number(in);
+    if (in->failed || length == NODE_NONE) return NULL;
+    if ((size_t)(in->end - in->at) < length) {
+        in->failed = 1;
+        return NULL;
+    }
+    char *text = xstrndup(in->at, length);
+    in->at += length;
+    return text;
+}
+
+static Node *decode_node(NodeReader *in, int depth) {
+    unsigned kind = decode_number(in);
+    if (in->failed || kind == NODE_NONE) return NULL;
+    if (kind > N_TIME || depth > NODE_DEPTH) {
+        in->failed = 1;
+        return NULL;
+    }
+
+    Node *node = node_new((NodeKind)kind);
+    node->background = (int)decode_number(in);
+    node->line = (int)decode_number(in);
+    node->name = decode_text(in);
+
+    unsigned words = decode_number(in);
+    for (unsigned i = 0; !in->failed && i < words; i++) {
+        char *word = decode_text(in);
+        if (!word) in->failed = 1;
+        else sl_push(&node->words, word);
+    }
+    if (decode_number(in) && !in->failed) {
+        node->info = xmalloc((node->words.len ? node->words.len : 1) * sizeof(WordInfo));
+        memset(node->info, 0, (node->words.len ? node->words.len : 1) * sizeof(WordInfo));
+        for (size_t i = 0; !in->failed && i < node->words.len; i++) {
+            WordInfo *info = &node->info[i];
+            size_t length = strlen(node->words.items[i]);
+            info->flags = decode_number(in);
+            info->prefix = decode_number(in);
+            info->text = decode_text(in);
+            unsigned count = decode_number(in);
+            if (in->failed || info->prefix > length ||
+                (size_t)(in->end - in->at) / (3 * sizeof(unsigned)) < count) {
+                in->failed = 1;
+                break;
+            }
+            info->segments = count ? xmalloc(count * sizeof(Segment)) : NULL;
+            info->count = count;
+            for (unsigned s = 0; s < count; s++) {
+                unsigned segment = decode_number(in);
+                Segment *target = &info->segments[s];
+                target->kind = (SegmentKind)segment;
+                target->start = decode_number(in);
+                target->length = decode_number(in);
+                if (segment > SEG_BACKQUOTE || target->start > length ||
+                    target->length > length - target->start)
+                    in->failed = 1;
+            }
+        }
+    }
+
+    unsigned redirs = decode_number(in);
+    Redir **tail = &node->redirs;
+    for (unsigned i = 0; !in->failed && i < redirs; i++) {
+        Redir *r = xmalloc(sizeof(Redir));
+        r->fd = (int)decode_number(in);
+        unsigned type = decode_number(in);
+        r->type = (RedirType)type;
+        r->target = decode_text(in);
+        r->next = NULL;
+        *tail = r;
+        tail = &r->next;
+        if (type > R_HERESTRING) in->failed = 1;
+    }
+
+    if (kind != N_SEQ) {
+        if (!in->failed) node->left = decode_node(in, depth + 1);
+        if (!in->failed) node->right = decode_node(in, depth + 1);
+    } else {
+        unsigned count = decode_number(in);
+        if (count < 2 || (size_t)(in->end - in->at) / sizeof(unsigned) < count) in->failed = 1;
+        Node *list = in->failed ? NULL : decode_node(in, depth + 1);
+        for (unsigned i = 1; !in->failed && i < count; i++) {
+            Node *item = decode_node(in, depth + 1);
+            Node *seq = i + 1 == count ? node : node_new(N_SEQ);
+            seq->left = list;
+            seq->right = item;
+            list = seq;
+        }
+        if (in->failed && list != node) node_free(list);
+    }
+    if (!in->failed) node->extra = decode_node(in, depth + 1);
+    if (in->failed) {
+        node_free(node);
+        return NULL;
+    }
+    return node;
+}
+
+Node *node_decode(const char *data, size_t length) {
+    NodeReader in = {data, data + length, 0};
+    Node *node = decode_node(&in, 0);
+    if (node && in.at != in.end) {
+        node_free(node);
+        return NULL;
+    }
+    return node;
+}
+
 static Token *peek(Parser *ps) {
     return &ps->tokens.items[ps->pos];
 }
@@ -1165,6 +1378,171 @@ static Node *parse_function(Parser *ps, const char *name) {
     return node;
 }
 
+size_t assignment_prefix(const char *word) {
+    if (!isalpha((unsigned char)word[0]) && word[0] != '_') return 0;
+
+    size_t i = 1;
+    while (isalnum((unsigned char)word[i]) || word[i] == '_') i++;
+    if (word[i] == '[') {
+        const char *close = strchr(word + i, ']');
+        if (!close) return 0;
+        i = (size_t)(close - word) + 1;
+    }
+    if (word[i] == '+' && word[i + 1] == '=') return i + 2;
+    return word[i] == '=' ? i + 1 : 0;
+}
+
+int declaration_command(const char *word) {
+    return strcmp(word, "local") == 0 || strcmp(word, "export") == 0 ||
+           strcmp(word, "declare") == 0 || strcmp(word, "typeset") == 0 ||
+           strcmp(word, "readonly") == 0;
+}
+
+static void skip_dollar(const char **p) {
+    StrBuf inner;
+    sb_init(&inner);
+    int incomplete = 0;
+    const char *next = *p + 1;
+
+    if (next[0] == '(' && next[1] == '(') {
+        next++;
+        copy_until(&next, &inner, '(', ')', &incomplete);
+        if (*next == ')') next++;
+    } else if (next[0] == '(') {
+        copy_until(&next, &inner, '(', ')', &incomplete);
+    } else if (next[0] == '{') {
+        copy_until(&next, &inner, '{', '}', &incomplete);
+    } else if (isalpha((unsigned char)next[0]) || next[0] == '_') {
+        while (isalnum((unsigned char)*next) || *next == '_') next++;
+    } else if (next[0] && strchr("?$#*@!0123456789", next[0])) {
+        next++;
+    }
+    sb_free(&inner);
+    *p = next;
+}
+
+static SegmentKind dollar_kind(const char *p) {
+    if (p[1] == '(') return p[2] == '(' ? SEG_ARITH : SEG_COMMAND;
+    if (p[1] == '{') return SEG_BRACED;
+    if (isalpha((unsigned char)p[1]) || p[1] == '_') return SEG_PARAM;
+    if (p[1] && strchr("?$#*@!0123456789", p[1])) return SEG_PARAM;
+    return SEG_LITERAL;
+}
+
+static void segment_add(WordInfo *info, size_t *cap, SegmentKind kind, size_t start,
+                        size_t end) {
+    if (kind == SEG_LITERAL && info->count > 0) {
+        Segment *last = &info->segments[info->count - 1];
+        if (last->kind == SEG_LITERAL && last->start + last->length == start) {
+            last->length = end - last->start;
+            return;
+        }
+    }
+    if (info->count == *cap) {
+        *cap = *cap ? *cap * 2 : 4;
+        info->segments = xrealloc(info->segments, *cap * sizeof(Segment));
+    }
+    Segment *segment = &info->segments[info->count++];
+    segment->kind = kind;
+    segment->start = start;
+    segment->length = end - start;
+}
+
+static void classify_word(const char *word, size_t prefix, WordInfo *info) {
+    memset(info, 0, sizeof(*info));
+    info->prefix = prefix;
+    if (strchr(word, '{')) info->flags |= WORD_BRACE;
+    if (!prefix && !strpbrk(word, "\"'\\$`~*?[{(!=")) info->flags |= WORD_PLAIN;
+
+    StrBuf text;
+    sb_init(&text);
+    int constant = !prefix && !(info->flags & WORD_BRACE);
+    int content = 0;
+    size_t cap = 0;
+
+    const char *p = word + prefix;
+    while (*p) {
+        const char *start = p;
+        SegmentKind kind = SEG_LITERAL;
+        char c = *p;
+
+        if (c == '~' && p == word + prefix) {
+            kind = SEG_TILDE;
+            p++;
+        } else if (c == '\\') {
+            kind = SEG_ESCAPE;
+            p++;
+            if (*p) {
+                sb_putc(&text, *p);
+                content = 1;
+                p++;
+            }
+        } else if (c == '\'') {
+            kind = SEG_SINGLE;
+            p++;
+            while (*p && *p != '\'') sb_putc(&text, *p++);
+            if (*p) p++;
+            content = 1;
+        } else if (c == '"') {
+            kind = SEG_DOUBLE;
+            p++;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) {
+                    sb_putc(&text, p[1]);
+                    p += 2;
+                } else if (*p == '$' && dollar_kind(p) != SEG_LITERAL) {
+                    info->flags |= WORD_EXPANDS;
+                    skip_dollar(&p);
+                } else if (*p == '`') {
+                    info->flags |= WORD_EXPANDS;
+                    const char *end = strchr(p + 1, '`');
+                    p = end ? end + 1 : p + strlen(p);
+                } else {
+                    sb_putc(&text, *p++);
+                }
+            }
+            if (*p) p++;
+            content = 1;
+        } else if (c == '`') {
+            kind = SEG_BACKQUOTE;
+            const char *end = strchr(p + 1, '`');
+            p = end ? end + 1 : p + strlen(p);
+        } else if (c == '$' && dollar_kind(p) != SEG_LITERAL) {
+            kind = dollar_kind(p);
+            skip_dollar(&p);
+        } else {
+            if (strchr("*?[]", c)) info->flags |= WORD_GLOB;
+            sb_putc(&text, c);
+            content = 1;
+            p++;
+        }
+
+        if (kind == SEG_ESCAPE || kind == SEG_SINGLE || kind == SEG_DOUBLE)
+            info->flags |= WORD_QUOTED;
+        else if (kind != SEG_LITERAL)
+            info->flags |= WORD_EXPANDS;
+        segment_add(info, &cap, kind, (size_t)(start - word), (size_t)(p - word));
+    }
+
+    if (constant && content && !(info->flags & (WORD_GLOB | WORD_EXPANDS)))
+        info->text = sb_take(&text);
+    else
+        sb_free(&text);
+}
+
+static void classify_simple(Node *node) {
+    if (node->words.len == 0) return;
+    node->info = xmalloc(node->words.len * sizeof(WordInfo));
+
+    int leading = 1;
+    for (size_t i = 0; i < node->words.len; i++) {
+        const char *word = node->words.items[i];
+        size_t prefix = leading ? assignment_prefix(word) : 0;
+        if (!prefix && !(i == 0 && declaration_command(word))) leading = 0;
+        classify_word(word, prefix, &node->info[i]);
+    }
+}
+
 static Node *parse_simple(Parser *ps) {
     Node *node = node_new(N_SIMPLE);
     while (1) {
@@ -1256,6 +1634,7 @@ static Node *parse_simple(Parser *ps) {
         node_free(node);
         return NULL;
     }
+    classify_simple(node);
     return node;
 }
 
@@ -50,9 +50,45 @@ typedef enum {
     N_TIME
 } NodeKind;
 
+typedef enum {
+    SEG_LITERAL,
+    SEG_TILDE,
+    SEG_ESCAPE,
+    SEG_SINGLE,
+    SEG_DOUBLE,
+    SEG_PARAM,
+    SEG_BRACED,
+    SEG_COMMAND,
+    SEG_ARITH,
+    SEG_BACKQUOTE
+} SegmentKind;
+
+typedef struct {
+    SegmentKind kind;
+    size_t start;
+    size_t length;
+} Segment;
+
+#define WORD_PLAIN 1u
+#define WORD_GLOB 2u
+#define WORD_BRACE 4u
+#define WORD_QUOTED 8u
+#define WORD_EXPANDS 16u
+
+typedef struct {
+    unsigned flags;
+    size_t prefix;
+    char *text;
+    Segment *segments;
+    size_t count;
+} WordInfo;
+
+typedef struct Dispatch Dispatch;
+
 typedef struct Node {
     NodeKind kind;
     StrList words;
+    WordInfo *info;
     Redir *redirs;
     struct Node *left;
     struct Node *right;
@@ -60,11 +96,16 @@ typedef struct Node {
     char *name;
     int background;
     int line;
+    Dispatch *dispatch;
 } Node;
 
 Node *parse_string(const char *src, int *incomplete, char **error);
 void node_free(Node *node);
 int node_source(const Node *node, StrBuf *out);
+int node_encode(const Node *node, StrBuf *out);
+Node *node_decode(const char *data, size_t length);
+size_t assignment_prefix(const char *word);
+int declaration_command(const char *word);
 
 int keyword_known(const char *word);
 void keyword_names(StrList *out);
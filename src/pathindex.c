@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#include "pathindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "theme.h"
+
+#define INDEX_MAGIC "FRSHPATH"
+#define INDEX_VERSION 1u
+
+typedef struct {
+    char *dir;
+    unsigned long long stamp;
+    StrList names;
+    int verified;
+    int used;
+} PathDir;
+
+typedef struct {
+    char *dir;
+    unsigned long long stamp;
+    StrList names;
+    int changed;
+} Refresh;
+
+typedef struct {
+    Refresh *items;
+    size_t count;
+    StrList extensions;
+    char *signature;
+    unsigned long generation;
+    volatile LONG done;
+} RefreshJob;
+
+static PathDir *dirs = NULL;
+static size_t dir_count = 0;
+static size_t dir_cap = 0;
+static char *dir_signature = NULL;
+static int index_loaded = 0;
+static RefreshJob *refresh = NULL;
+static unsigned long refresh_generation = 0;
+
+static unsigned long long directory_stamp(const char *dir) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(dir, GetFileExInfoStandard, &data)) return 0;
+    return ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+           data.ftLastWriteTime.dwLowDateTime;
+}
+
+static int is_command_extension(const StrList *extensions, const char *ext) {
+    for (size_t i = 0; i < extensions->len; i++) {
+        if (str_ieq(extensions->items[i], ext)) return 1;
+    }
+    return 0;
+}
+
+static void scan_directory(const char *dir, const StrList *extensions, StrList *out) {
+    char *pattern = path_join(dir, "*");
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    free(pattern);
+    if (find == INVALID_HANDLE_VALUE) return;
+
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        const char *ext = path_ext(data.cFileName);
+        if (!*ext || !is_command_extension(extensions, ext)) continue;
+        sl_push(out, xstrndup(data.cFileName, strlen(data.cFileName) - strlen(ext)));
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+}
+
+static char *extension_signature(const StrList *extensions) {
+    StrBuf signature;
+    sb_init(&signature);
+    for (size_t i = 0; i < extensions->len; i++) {
+        if (i > 0) sb_putc(&signature, ';');
+        sb_puts(&signature, extensions->items[i]);
+    }
+    return sb_take(&signature);
+}
+
+static PathDir *dir_find(const char *dir) {
+    for (size_t i = 0; i < dir_count; i++) {
+        if (str_ieq(dirs[i].dir, dir)) return &dirs[i];
+    }
+    return NULL;
+}
+
+static PathDir *dir_add(const char *dir, unsigned long long stamp) {
+    if (dir_count == dir_cap) {
+        dir_cap = dir_cap ? dir_cap * 2 : 32;
+        dirs = xrealloc(dirs, dir_cap * sizeof(PathDir));
+    }
+    PathDir *entry = &dirs[dir_count++];
+    entry->dir = xstrdup(dir);
+    entry->stamp = stamp;
+    sl_init(&entry->names);
+    entry->verified = 0;
+    entry->used = 0;
+    return entry;
+}
+
+static void dirs_clear(void) {
+    for (size_t i = 0; i < dir_count; i++) {
+        free(dirs[i].dir);
+        sl_free(&dirs[i].names);
+    }
+    dir_count = 0;
+}
+
+static char *index_file(void) {
+    return fresh_home_path("commands.cache");
+}
+
+static int read_exact(FILE *f, void *data, size_t size) {
+    return fread(data, 1, size, f) == size;
+}
+
+static char *read_string(FILE *f) {
+    unsigned short length;
+    if (!read_exact(f, &length, sizeof(length))) return NULL;
+    char *text = xmalloc((size_t)length + 1);
+    if (!read_exact(f, text, length)) {
+        free(text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+static void write_string(FILE *f, const char *text) {
+    size_t length = strlen(text);
+    unsigned short stored = (unsigned short)(length > 0xFFFF ? 0xFFFF : length);
+    fwrite(&stored, sizeof(stored), 1, f);
+    fwrite(text, 1, stored, f);
+}
+
+static void index_load(const char *signature) {
+    char *path = index_file();
+    FILE *f = fopen(path, "rb");
+    free(path);
+    if (!f) return;
+
+    char magic[8];
+    unsigned version = 0;
+    unsigned count = 0;
+    char *stored = NULL;
+    if (!read_exact(f, magic, sizeof(magic)) || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !read_exact(f, &version, sizeof(version)) || version != INDEX_VERSION ||
+        !(stored = read_string(f)) || strcmp(stored, signature) != 0 ||
+        !read_exact(f, &count, sizeof(count))) {
+        free(stored);
+        fclose(f);
+        return;
+    }
+    free(stored);
+
+    int complete = 1;
+    for (unsigned i = 0; complete && i < count; i++) {
+        char *dir = read_string(f);
+        unsigned long long stamp;
+        unsigned names;
+        if (!dir || !read_exact(f, &stamp, sizeof(stamp)) || !read_exact(f, &names, sizeof(names))) {
+            free(dir);
+            complete = 0;
+            break;
+        }
+        PathDir *entry = dir_find(dir) ? NULL : dir_add(dir, stamp);
+        free(dir);
+
+        for (unsigned n = 0; n < names; n++) {
+            char *name = read_string(f);
+            if (!name) {
+                complete = 0;
+                break;
+            }
+            if (entry) sl_push(&entry->names, name);
+            else free(name);
+        }
+    }
+    fclose(f);
+    if (!complete) dirs_clear();
+}
+
+static void index_save(void) {
+    char *path = index_file();
+    char temporary[PATH_BUF];
+    snprintf(temporary, sizeof(temporary), "%s.%lu", path, (unsigned long)GetCurrentProcessId());
+
+    FILE *f = fopen(temporary, "wb");
+    if (!f) {
+        free(path);
+        return;
+    }
+
+    unsigned version = INDEX_VERSION;
+    unsigned count = 0;
+    for (size_t i = 0; i < dir_count; i++) count += dirs[i].used;
+    fwrite(INDEX_MAGIC, 1, 8, f);
+    fwrite(&version, sizeof(version), 1, f);
+    write_string(f, dir_signature);
+    fwrite(&count, sizeof(count), 1, f);
+
+    for (size_t i = 0; i < dir_count; i++) {
+        if (!dirs[i].used) continue;
+        unsigned names = (unsigned)dirs[i].names.len;
+        write_string(f, dirs[i].dir);
+        fwrite(&dirs[i].stamp, sizeof(dirs[i].stamp), 1, f);
+        fwrite(&names, sizeof(names), 1, f);
+        for (size_t n = 0; n < dirs[i].names.len; n++) write_string(f, dirs[i].names.items[n]);
+    }
+
+    int failed = ferror(f);
+    if (fclose(f) != 0) failed = 1;
+    if (failed || !MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING)) DeleteFileA(temporary);
+    free(path);
+}
+
+static DWORD WINAPI refresh_worker(LPVOID parameter) {
+    RefreshJob *job = parameter;
+    for (size_t i = 0; i < job->count; i++) {
+        Refresh *item = &job->items[i];
+        unsigned long long stamp = directory_stamp(item->dir);
+        if (stamp == item->stamp) continue;
+        item->stamp = stamp;
+        item->changed = 1;
+        sl_init(&item->names);
+        scan_directory(item->dir, &job->extensions, &item->names);
+    }
+    InterlockedExchange(&job->done, 1);
+    return 0;
+}
+
+static void refresh_start(const StrList *extensions) {
+    if (refresh) return;
+
+    RefreshJob *job = xmalloc(sizeof(RefreshJob));
+    memset(job, 0, sizeof(*job));
+    job->items = xmalloc((dir_count ? dir_count : 1) * sizeof(Refresh));
+    for (size_t i = 0; i < dir_count; i++) {
+        if (dirs[i].verified || !dirs[i].used) continue;
+        Refresh *item = &job->items[job->count++];
+        item->dir = xstrdup(dirs[i].dir);
+        item->stamp = dirs[i].stamp;
+        item->changed = 0;
+    }
+    sl_init(&job->extensions);
+    for (size_t i = 0; i < extensions->len; i++) sl_push_copy(&job->extensions, extensions->items[i]);
+    job->signature = xstrdup(dir_signature);
+    job->generation = refresh_generation;
+    refresh = job;
+
+    HANDLE thread = CreateThread(NULL, 0, refresh_worker, job, 0, NULL);
+    if (thread) CloseHandle(thread);
+    else refresh_worker(job);
+}
+
+int path_index_refreshed(void) {
+    if (!refresh || !refresh->done) return 0;
+
+    RefreshJob *job = refresh;
+    refresh = NULL;
+    int stale = job->generation != refresh_generation;
+    int current = !stale && dir_signature && strcmp(job->signature, dir_signature) == 0;
+    int changed = 0;
+    for (size_t i = 0; i < job->count; i++) {
+        Refresh *item = &job->items[i];
+        PathDir *entry = current ? dir_find(item->dir) : NULL;
+        if (entry && item->changed) {
+            sl_free(&entry->names);
+            entry->names = item->names;
+            entry->stamp = item->stamp;
+            changed = 1;
+        } else if (item->changed) {
+            sl_free(&item->names);
+        }
+        if (entry) entry->verified = 1;
+        free(item->dir);
+    }
+    free(job->items);
+    sl_free(&job->extensions);
+    free(job->signature);
+    free(job);
+
+    if (changed) index_save();
+    return changed || stale;
+}
+
+void path_index_commands(const char *path, const StrList *extensions, int background,
+                         StrList *out) {
+    char *signature = extension_signature(extensions);
+    if (!index_loaded) {
+        index_loaded = 1;
+        index_load(signature);
+        dir_signature = xstrdup(signature);
+    }
+    if (strcmp(signature, dir_signature) != 0) {
+        dirs_clear();
+        free(dir_signature);
+        dir_signature = signature;
+    } else {
+        free(signature);
+    }
+
+    for (size_t i = 0; i < dir_count; i++) dirs[i].used = 0;
+
+    int scanned = 0;
+    int pending = 0;
+    char *copy = xstrdup(path);
+    char *cursor = copy;
+    char *dir;
+    while ((dir = str_next_field(&cursor, ';')) != NULL) {
+        if (!*dir) continue;
+        PathDir *entry = dir_find(dir);
+        if (!entry && background) {
+            entry = dir_add(dir, 0);
+        } else if (!entry) {
+            entry = dir_add(dir, directory_stamp(dir));
+            scan_directory(dir, extensions, &entry->names);
+            entry->verified = 1;
+            scanned = 1;
+        }
+        entry->used = 1;
+        if (!entry->verified) pending = 1;
+        for (size_t i = 0; i < entry->names.len; i++) sl_push_copy(out, entry->names.items[i]);
+    }
+    free(copy);
+
+    if (scanned) index_save();
+    if (pending) refresh_start(extensions);
+}
+
+void path_index_invalidate(void) {
+    refresh_generation++;
+    for (size_t i = 0; i < dir_count; i++) dirs[i].verified = 0;
+}
+
+void path_index_release(void) {
+    if (refresh && refresh->done) path_index_refreshed();
+    dirs_clear();
+    free(dirs);
+    dirs = NULL;
+    dir_cap = 0;
+    free(dir_signature);
+    dir_signature = NULL;
+    index_loaded = 0;
+}
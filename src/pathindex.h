@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#ifndef FRESH_PATHINDEX_H
+#define FRESH_PATHINDEX_H
+
+#include "util.h"
+
+void path_index_commands(const char *path, const StrList *extensions, int background,
+                         StrList *out);
+int path_index_refreshed(void);
+void path_index_invalidate(void);
+void path_index_release(void);
+
+#endif
@@ -13,6 +13,7 @@
 #include <time.h>
 #include <windows.h>
 
+#include "exec.h"
 #include "gitinfo.h"
 #include "shell.h"
 #include "style.h"
@@ -28,6 +29,42 @@
 #define COLOR_PROMPT "\x1b[97m"
 #define COLOR_ERROR "\x1b[31m"
 
+#define PROMPT_COMMANDS 8
+#define COMMAND_OUTPUT 4096
+
+typedef struct {
+    char code;
+    const char *name;
+    int async;
+    void (*render)(StrBuf *out, const char *argument);
+} PromptSegment;
+
+typedef struct {
+    char *command_line;
+    char *cwd;
+    char *environment;
+    StrBuf output;
+    DWORD started;
+    DWORD elapsed;
+    volatile LONG done;
+} CommandJob;
+
+typedef struct {
+    char *command;
+    char *cwd;
+    char *text;
+    CommandJob *job;
+    DWORD elapsed;
+    unsigned long used;
+} CommandSlot;
+
+static CommandSlot command_slots[PROMPT_COMMANDS];
+static unsigned long command_clock = 0;
+static int refreshing = 0;
+static int git_waiting = 0;
+static int command_waiting = 0;
+static int timing = -1;
+
 static int code_point_width(unsigned long code) {
     if (code < 0x1100) return 1;
     if (code <= 0x115f) return 2;
@@ -158,7 +195,138 @@ static const char *read_brace(const char *p, char *name, size_t size) {
     return p;
 }
 
-static void append_git_segment(StrBuf *out) {
+static DWORD WINAPI command_worker(LPVOID parameter) {
+    CommandJob *job = parameter;
+    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+    HANDLE read_end, write_end;
+    if (CreatePipe(&read_end, &write_end, &sa, 0)) {
+        SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0);
+
+        STARTUPINFOA si;
+        PROCESS_INFORMATION pi;
+        memset(&si, 0, sizeof(si));
+        memset(&pi, 0, sizeof(pi));
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+        si.wShowWindow = SW_HIDE;
+        si.hStdOutput = write_end;
+
+        if (CreateProcessA(NULL, job->command_line, NULL, NULL, TRUE, CREATE_NO_WINDOW,
+                           job->environment, job->cwd, &si, &pi)) {
+            CloseHandle(write_end);
+            char chunk[512];
+            DWORD n = 0;
+            while (ReadFile(read_end, chunk, sizeof(chunk), &n, NULL) && n > 0) {
+                if (job->output.len < COMMAND_OUTPUT) sb_putn(&job->output, chunk, n);
+            }
+            WaitForSingleObject(pi.hProcess, INFINITE);
+            CloseHandle(pi.hProcess);
+            CloseHandle(pi.hThread);
+        } else {
+            CloseHandle(write_end);
+        }
+        CloseHandle(read_end);
+    }
+    job->elapsed = GetTickCount() - job->started;
+    InterlockedExchange(&job->done, 1);
+    return 0;
+}
+
+static void command_start(CommandSlot *slot, const char *cwd) {
+    char exe[PATH_BUF];
+    if (!GetModuleFileNameA(NULL, exe, sizeof(exe))) return;
+
+    CommandJob *job = xmalloc(sizeof(CommandJob));
+    memset(job, 0, sizeof(*job));
+    StrBuf line;
+    sb_init(&line);
+    quote_argument(&line, exe);
+    sb_puts(&line, " --norc -c ");
+    quote_argument(&line, slot->command);
+    job->command_line = sb_take(&line);
+    job->cwd = xstrdup(cwd);
+    job->environment = vars_environment_copy();
+    sb_init(&job->output);
+    job->started = GetTickCount();
+
+    HANDLE thread = CreateThread(NULL, 0, command_worker, job, 0, NULL);
+    if (!thread) {
+        free(job->command_line);
+        free(job->cwd);
+        free(job->environment);
+        sb_free(&job->output);
+        free(job);
+        return;
+    }
+    CloseHandle(thread);
+    slot->job = job;
+}
+
+static void command_harvest(CommandSlot *slot) {
+    CommandJob *job = slot->job;
+    char *text = job->output.data;
+    char *end = strpbrk(text, "\r\n");
+    if (end) *end = '\0';
+
+    free(slot->text);
+    slot->text = xstrdup(text);
+    free(slot->cwd);
+    slot->cwd = job->cwd;
+    slot->elapsed = job->elapsed;
+
+    free(job->command_line);
+    free(job->environment);
+    sb_free(&job->output);
+    free(job);
+    slot->job = NULL;
+}
+
+static int commands_collect(void) {
+    int collected = 0;
+    for (int i = 0; i < PROMPT_COMMANDS; i++) {
+        if (!command_slots[i].job || !command_slots[i].job->done) continue;
+        command_harvest(&command_slots[i]);
+        collected = 1;
+    }
+    return collected;
+}
+
+static CommandSlot *command_slot(const char *command) {
+    CommandSlot *oldest = NULL;
+    for (int i = 0; i < PROMPT_COMMANDS; i++) {
+        CommandSlot *slot = &command_slots[i];
+        if (slot->command && strcmp(slot->command, command) == 0) {
+            slot->used = ++command_clock;
+            return slot;
+        }
+        if (!slot->job && (!oldest || slot->used < oldest->used)) oldest = slot;
+    }
+    if (!oldest) return NULL;
+
+    free(oldest->command);
+    free(oldest->cwd);
+    free(oldest->text);
+    oldest->command = xstrdup(command);
+    oldest->cwd = NULL;
+    oldest->text = NULL;
+    oldest->elapsed = 0;
+    oldest->used = ++command_clock;
+    return oldest;
+}
+
+static void segment_command(StrBuf *out, const char *command) {
+    char cwd[PATH_BUF];
+    if (!*command || !GetCurrentDirectoryA(sizeof(cwd), cwd)) return;
+    CommandSlot *slot = command_slot(command);
+    if (!slot) return;
+
+    if (slot->job && slot->job->done) command_harvest(slot);
+    if (!slot->job && !refreshing) command_start(slot, cwd);
+    if (slot->job) command_waiting = 1;
+    if (slot->text && slot->cwd && strcmp(slot->cwd, cwd) == 0) sb_puts(out, slot->text);
+}
+
+static void segment_git(StrBuf *out, const char *argument) {
     if (!option_enabled("FRESH_SHOW_GIT", 1)) return;
     const char *branch = git_branch();
     if (!branch) return;
@@ -167,15 +335,144 @@ static void append_git_segment(StrBuf *out) {
     sb_puts(out, " (");
     sb_puts(out, style(COLOR_BRANCH));
     sb_puts(out, branch);
-    if (option_enabled("FRESH_SHOW_GIT_DIRTY", 1) && git_dirty()) {
-        sb_puts(out, style(COLOR_DIRTY));
-        sb_puts(out, "!");
+    if (option_enabled("FRESH_SHOW_GIT_DIRTY", 1)) {
+        if (git_dirty()) {
+            sb_puts(out, style(COLOR_DIRTY));
+            sb_puts(out, "!");
+        }
+        if (git_busy()) git_waiting = 1;
     }
     sb_puts(out, style(COLOR_GIT));
     sb_puts(out, ")");
     sb_puts(out, style(COLOR_RESET));
 }
 
+static void segment_user(StrBuf *out, const char *argument) {
+    char user[256];
+    DWORD size = sizeof(user);
+    if (win_user_name(user, &size)) sb_puts(out, user);
+}
+
+static void segment_host(StrBuf *out, const char *argument) {
+    char host[256];
+    DWORD size = sizeof(host);
+    if (GetComputerNameA(host, &size)) sb_puts(out, host);
+}
+
+static void segment_path(StrBuf *out, const char *argument) {
+    short_path(out);
+}
+
+static void segment_directory(StrBuf *out, const char *argument) {
+    char cwd[PATH_BUF];
+    if (GetCurrentDirectoryA(sizeof(cwd), cwd)) {
+        path_to_slashes(cwd);
+        sb_puts(out, cwd);
+    }
+}
+
+static void segment_branch(StrBuf *out, const char *argument) {
+    const char *branch = git_branch();
+    if (branch) sb_puts(out, branch);
+}
+
+static void append_time(StrBuf *out, const char *format) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    char buffer[64];
+    strftime(buffer, sizeof(buffer), format, local);
+    sb_puts(out, buffer);
+}
+
+static void segment_time(StrBuf *out, const char *argument) {
+    append_time(out, "%H:%M");
+}
+
+static void segment_date(StrBuf *out, const char *argument) {
+    append_time(out, "%Y-%m-%d");
+}
+
+static void segment_status(StrBuf *out, const char *argument) {
+    sb_printf(out, "%d", shell.last_status);
+}
+
+static void segment_error(StrBuf *out, const char *argument) {
+    if (shell.last_status == 0) return;
+    sb_puts(out, style(COLOR_ERROR));
+    sb_printf(out, "%d \xe2\x86\xb5", shell.last_status);
+    sb_puts(out, style(COLOR_RESET));
+}
+
+static void segment_character(StrBuf *out, const char *argument) {
+    const char *character = var_get("FRESH_PROMPT_CHAR");
+    sb_puts(out, character && *character ? character : "\xce\xbb");
+}
+
+static const PromptSegment SEGMENTS[] = {
+    {'n', "user", 0, segment_user},
+    {'m', "host", 0, segment_host},
+    {'~', "path", 0, segment_path},
+    {'d', "directory", 0, segment_directory},
+    {'g', "git", 1, segment_git},
+    {'b', "branch", 0, segment_branch},
+    {'t', "time", 0, segment_time},
+    {'D', "date", 0, segment_date},
+    {'?', "status", 0, segment_status},
+    {'e', "error", 0, segment_error},
+    {'#', "character", 0, segment_character},
+    {'(', "command", 1, segment_command},
+};
+
+#define SEGMENT_COUNT (sizeof(SEGMENTS) / sizeof(SEGMENTS[0]))
+
+static double segment_micros[SEGMENT_COUNT];
+static int segment_used[SEGMENT_COUNT];
+
+static const char *read_command(const char *p, StrBuf *command) {
+    int depth = 1;
+    for (; *p; p++) {
+        if (*p == '(') depth++;
+        else if (*p == ')' && --depth == 0) return p + 1;
+        sb_putc(command, *p);
+    }
+    return NULL;
+}
+
+static void render_segment(size_t index, const char *argument, StrBuf *out) {
+    if (timing < 0) timing = getenv("FRESH_TIMING") != NULL;
+    if (!timing) {
+        SEGMENTS[index].render(out, argument);
+        return;
+    }
+
+    LARGE_INTEGER start, end, frequency;
+    QueryPerformanceCounter(&start);
+    SEGMENTS[index].render(out, argument);
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    segment_micros[index] +=
+        (double)(end.QuadPart - start.QuadPart) * 1000000.0 / (double)frequency.QuadPart;
+    segment_used[index] = 1;
+}
+
+static void timing_report(void) {
+    for (size_t i = 0; i < SEGMENT_COUNT; i++) {
+        if (!segment_used[i]) continue;
+        fprintf(stderr, "  %8.0f us  prompt %s%s\n", segment_micros[i], SEGMENTS[i].name,
+                SEGMENTS[i].async ? " (async)" : "");
+        segment_micros[i] = 0;
+        segment_used[i] = 0;
+    }
+    for (int i = 0; i < PROMPT_COMMANDS; i++) {
+        CommandSlot *slot = &command_slots[i];
+        if (!slot->elapsed) continue;
+        fprintf(stderr, "  %8lu us  prompt %%(%s) in the background\n",
+                (unsigned long)slot->elapsed * 1000ul, slot->command);
+        slot->elapsed = 0;
+    }
+    fflush(stderr);
+}
+
 void prompt_expand(const char *format, StrBuf *out) {
     char name[64];
 
@@ -220,62 +517,23 @@ void prompt_expand(const char *format, StrBuf *out) {
         }
 
         p++;
-        switch (*p) {
-        case 'n': {
-            char user[256];
-            DWORD size = sizeof(user);
-            if (win_user_name(user, &size)) sb_puts(out, user);
-            break;
-        }
-        case 'm': {
-            char host[256];
-            DWORD size = sizeof(host);
-            if (GetComputerNameA(host, &size)) sb_puts(out, host);
-            break;
-        }
-        case '~':
-            short_path(out);
-            break;
-        case 'd': {
-            char cwd[PATH_BUF];
-            if (GetCurrentDirectoryA(sizeof(cwd), cwd)) {
-                path_to_slashes(cwd);
-                sb_puts(out, cwd);
-            }
-            break;
-        }
-        case 'g':
-            append_git_segment(out);
-            break;
-        case 'b': {
-            const char *branch = git_branch();
-            if (branch) sb_puts(out, branch);
-            break;
-        }
-        case 't':
-        case 'D': {
-            time_t now = time(NULL);
-            struct tm *local = localtime(&now);
-            char buffer[64];
-            strftime(buffer, sizeof(buffer), *p == 't' ? "%H:%M" : "%Y-%m-%d", local);
-            sb_puts(out, buffer);
-            break;
+        size_t index = 0;
+        while (index < SEGMENT_COUNT && SEGMENTS[index].code != *p) index++;
+        if (*p == '(') {
+            StrBuf command;
+            sb_init(&command);
+            const char *end = read_command(p + 1, &command);
+            if (end) render_segment(index, command.data, out);
+            p = (end ? end : p + strlen(p)) - 1;
+            sb_free(&command);
+            continue;
         }
-        case '?':
-            sb_printf(out, "%d", shell.last_status);
-            break;
-        case 'e':
-            if (shell.last_status != 0) {
-                sb_puts(out, style(COLOR_ERROR));
-                sb_printf(out, "%d \xe2\x86\xb5", shell.last_status);
-                sb_puts(out, style(COLOR_RESET));
-            }
-            break;
-        case '#': {
-            const char *character = var_get("FRESH_PROMPT_CHAR");
-            sb_puts(out, character && *character ? character : "\xce\xbb");
-            break;
+        if (*p && index < SEGMENT_COUNT) {
+            render_segment(index, "", out);
+            continue;
         }
+
+        switch (*p) {
         case 'F':
             p = read_brace(p + 1, name, sizeof(name)) - 1;
             append_color(out, name, 0);
@@ -320,6 +578,10 @@ static const char *default_prompt(void) {
 }
 
 void prompt_build(StrBuf *out) {
+    if (!refreshing) commands_collect();
+    git_waiting = 0;
+    command_waiting = 0;
+
     const char *format = var_get("FRESH_PROMPT");
     if (!format || !*format) format = default_prompt();
 
@@ -360,6 +622,31 @@ void prompt_build(StrBuf *out) {
 
     sb_free(&body);
     sb_free(&right);
+    if (timing > 0 && !refreshing) timing_report();
+}
+
+int prompt_pending(void) {
+    return git_waiting || command_waiting;
+}
+
+int prompt_refresh(StrBuf *out) {
+    int ready = commands_collect();
+    if (git_waiting && !git_busy()) ready = 1;
+    if (!ready) return 0;
+
+    StrBuf rebuilt;
+    sb_init(&rebuilt);
+    refreshing = 1;
+    prompt_build(&rebuilt);
+    refreshing = 0;
+
+    if (strcmp(rebuilt.data, out->data) == 0) {
+        sb_free(&rebuilt);
+        return 0;
+    }
+    sb_free(out);
+    *out = rebuilt;
+    return 1;
 }
 
 void prompt_set_title(void) {
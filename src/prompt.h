@@ -10,6 +10,8 @@
 #include "util.h"
 
 void prompt_build(StrBuf *out);
+int prompt_pending(void);
+int prompt_refresh(StrBuf *out);
 void prompt_set_title(void);
 void prompt_build_continuation(StrBuf *out);
 void prompt_expand(const char *format, StrBuf *out);
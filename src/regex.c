@@ -389,23 +389,43 @@ static int match_node(RegexNode *node, const char *pos, Cont *k, State *st) {
     return 0;
 }
 
-static int run(const char *pattern, const char *text, RegexMatch *match) {
+struct Regex {
     NodePool pool;
-    memset(&pool, 0, sizeof(pool));
+    RegexNode *root;
+    int groups;
+};
+
+Regex *regex_compile(const char *pattern) {
+    if (!pattern) return NULL;
+
+    Regex *regex = xmalloc(sizeof(Regex));
+    memset(&regex->pool, 0, sizeof(regex->pool));
 
     Parser ps;
     ps.pattern = pattern;
-    ps.pool = &pool;
+    ps.pool = &regex->pool;
     ps.groups = 0;
     ps.failed = 0;
 
-    RegexNode *root = parse_alt(&ps);
+    regex->root = parse_alt(&ps);
+    regex->groups = ps.groups;
     if (ps.failed) {
-        pool_free(&pool);
-        return 0;
+        regex_free(regex);
+        return NULL;
     }
+    return regex;
+}
+
+void regex_free(Regex *regex) {
+    if (!regex) return;
+    pool_free(&regex->pool);
+    free(regex);
+}
 
-    for (const char *start = text;; start++) {
+int regex_exec_at(const Regex *regex, const char *text, size_t from, RegexMatch *match) {
+    if (!regex || !text) return 0;
+
+    for (const char *start = text + from;; start++) {
         State st;
         st.text = text;
         st.steps = 0;
@@ -415,22 +435,87 @@ static int run(const char *pattern, const char *text, RegexMatch *match) {
         }
         st.start[0] = (int)(start - text);
 
-        if (match_node(root, start, NULL, &st)) {
+        if (match_node(regex->root, start, NULL, &st)) {
             if (match) {
                 memcpy(match->start, st.start, sizeof(st.start));
                 memcpy(match->end, st.end, sizeof(st.end));
-                match->count = ps.groups + 1;
+                match->count = regex->groups + 1;
             }
-            pool_free(&pool);
             return 1;
         }
         if (!*start) break;
     }
-
-    pool_free(&pool);
     return 0;
 }
 
+int regex_exec(const Regex *regex, const char *text, RegexMatch *match) {
+    return regex_exec_at(regex, text, 0, match);
+}
+
+static void append_replacement(StrBuf *out, const char *replacement, const char *text,
+                               const RegexMatch *match) {
+    for (const char *r = replacement; *r; r++) {
+        if (*r == '\\' && isdigit((unsigned char)r[1])) {
+            int group = *++r - '0';
+            if (group < REGEX_GROUPS && match->start[group] >= 0 && match->end[group] >= 0)
+                sb_putn(out, text + match->start[group],
+                        (size_t)(match->end[group] - match->start[group]));
+            continue;
+        }
+        if (*r == '\\' && r[1]) {
+            r++;
+            sb_putc(out, *r == 'n' ? '\n' : *r == 't' ? '\t' : *r);
+            continue;
+        }
+        if (*r == '&') {
+            sb_putn(out, text + match->start[0], (size_t)(match->end[0] - match->start[0]));
+            continue;
+        }
+        sb_putc(out, *r);
+    }
+}
+
+int regex_substitute(const Regex *regex, const char *replacement, const char *text, int occurrence,
+                     int global, StrBuf *out) {
+    size_t length = strlen(text);
+    size_t copied = 0;
+    size_t from = 0;
+    long previous_end = -1;
+    int seen = 0;
+    int replaced = 0;
+
+    while (from <= length) {
+        RegexMatch match;
+        if (!regex_exec_at(regex, text, from, &match)) break;
+
+        size_t start = (size_t)match.start[0];
+        size_t end = (size_t)match.end[0];
+        if (start == end && (long)start == previous_end) {
+            if (start >= length) break;
+            from = start + 1;
+            continue;
+        }
+
+        if (++seen >= occurrence) {
+            sb_putn(out, text + copied, start - copied);
+            append_replacement(out, replacement, text, &match);
+            copied = end;
+            replaced = 1;
+            if (!global) break;
+        }
+        previous_end = (long)end;
+        if (start == end) {
+            if (end >= length) break;
+            from = end + 1;
+        } else {
+            from = end;
+        }
+    }
+
+    sb_puts(out, text + copied);
+    return replaced;
+}
+
 void regex_bre_to_ere(const char *bre, StrBuf *out) {
     for (const char *p = bre; *p; p++) {
         if (*p == '\\' && p[1]) {
@@ -456,50 +541,20 @@ void regex_bre_to_ere(const char *bre, StrBuf *out) {
 
 int regex_search(const char *pattern, const char *text, RegexMatch *match) {
     if (!pattern || !text) return 0;
-    return run(pattern, text, match);
+    Regex *regex = regex_compile(pattern);
+    int found = regex_exec(regex, text, match);
+    regex_free(regex);
+    return found;
 }
 
 int regex_replace(const char *pattern, const char *replacement, const char *text, int global,
                   StrBuf *out) {
-    const char *cursor = text;
-    int replaced = 0;
-
-    while (*cursor) {
-        RegexMatch match;
-        if (!regex_search(pattern, cursor, &match)) break;
-
-        sb_putn(out, cursor, (size_t)match.start[0]);
-        for (const char *r = replacement; *r; r++) {
-            if (*r == '\\' && isdigit((unsigned char)r[1])) {
-                int group = *++r - '0';
-                if (group < REGEX_GROUPS && match.start[group] >= 0 && match.end[group] >= 0)
-                    sb_putn(out, cursor + match.start[group],
-                            (size_t)(match.end[group] - match.start[group]));
-                continue;
-            }
-            if (*r == '\\' && r[1]) {
-                r++;
-                sb_putc(out, *r == 'n' ? '\n' : *r == 't' ? '\t' : *r);
-                continue;
-            }
-            if (*r == '&') {
-                sb_putn(out, cursor + match.start[0], (size_t)(match.end[0] - match.start[0]));
-                continue;
-            }
-            sb_putc(out, *r);
-        }
-
-        replaced = 1;
-        int width = match.end[0] - match.start[0];
-        cursor += match.end[0];
-        if (width == 0) {
-            if (!*cursor) break;
-            sb_putc(out, *cursor);
-            cursor++;
-        }
-        if (!global) break;
+    Regex *regex = regex_compile(pattern);
+    if (!regex) {
+        sb_puts(out, text);
+        return 0;
     }
-
-    sb_puts(out, cursor);
+    int replaced = regex_substitute(regex, replacement, text, 1, global, out);
+    regex_free(regex);
     return replaced;
 }
@@ -17,6 +17,15 @@ typedef struct {
     int count;
 } RegexMatch;
 
+typedef struct Regex Regex;
+
+Regex *regex_compile(const char *pattern);
+void regex_free(Regex *regex);
+int regex_exec(const Regex *regex, const char *text, RegexMatch *match);
+int regex_exec_at(const Regex *regex, const char *text, size_t from, RegexMatch *match);
+int regex_substitute(const Regex *regex, const char *replacement, const char *text, int occurrence,
+                     int global, StrBuf *out);
+
 void regex_bre_to_ere(const char *bre, StrBuf *out);
 int regex_search(const char *pattern, const char *text, RegexMatch *match);
 int regex_replace(const char *pattern, const char *replacement, const char *text, int global,
@@ -13,6 +13,9 @@
 #define FRESH_SORT_FOLD 1u
 #define FRESH_SORT_NUMERIC 2u
 
+#define FRESH_TRANSLATE_DELETE 1u
+#define FRESH_TRANSLATE_SQUEEZE 2u
+
 #define FRESH_CORE "rust"
 
 typedef struct {
@@ -22,8 +25,18 @@ typedef struct {
     unsigned int in_word;
 } FreshCounts;
 
+typedef struct {
+    unsigned char map[256];
+    unsigned char dropped[32];
+    unsigned char squeezed[32];
+    unsigned int mode;
+    unsigned int last;
+} FreshTranslation;
+
 void fresh_sort_pointers(const unsigned char **items, size_t len, unsigned int mode);
 void fresh_count_block(const unsigned char *data, size_t len, FreshCounts *counts);
+size_t fresh_translate_block(const unsigned char *data, size_t len, unsigned char *out,
+                             FreshTranslation *translation);
 size_t fresh_path_merge(const unsigned char *const *parts, size_t count, unsigned char *out,
                         size_t cap);
 
@@ -31,6 +44,9 @@ size_t fresh_path_merge(const unsigned char *const *parts, size_t count, unsigne
     fresh_sort_pointers((const unsigned char **)(void *)(items), (len), (mode))
 #define core_count_block(data, len, counts) \
     fresh_count_block((const unsigned char *)(data), (len), (counts))
+#define core_translate_block(data, len, out, translation) \
+    fresh_translate_block((const unsigned char *)(data), (len), (unsigned char *)(out), \
+                          (translation))
 #define core_path_merge(parts, count, out, cap) \
     fresh_path_merge((const unsigned char *const *)(const void *)(parts), (count), \
                      (unsigned char *)(out), (cap))
@@ -0,0 +1,997 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#include "sed.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "regex.h"
+#include "shell.h"
+#include "util.h"
+
+typedef enum {
+    ADDRESS_NONE,
+    ADDRESS_LINE,
+    ADDRESS_LAST,
+    ADDRESS_REGEX,
+    ADDRESS_RELATIVE,
+    ADDRESS_STEP
+} AddressKind;
+
+typedef struct {
+    AddressKind kind;
+    long line;
+    long step;
+    Regex *regex;
+} SedAddress;
+
+typedef struct {
+    SedAddress first;
+    SedAddress last;
+    int negate;
+    int active;
+    long range_end;
+    char name;
+    Regex *regex;
+    char *text;
+    int global;
+    int occurrence;
+    int print;
+    int exit_code;
+    size_t jump;
+    unsigned char *table;
+} SedCommand;
+
+typedef struct {
+    SedCommand *items;
+    size_t len;
+    size_t cap;
+    Regex **regexes;
+    size_t regex_count;
+} SedScript;
+
+typedef struct {
+    const char *p;
+    SedScript *script;
+    Regex *last_regex;
+    int extended;
+    size_t *blocks;
+    size_t depth;
+    int failed;
+} SedCompiler;
+
+typedef struct {
+    char **names;
+    int count;
+    int next_name;
+    FILE *file;
+    StrBuf next;
+    int next_kind;
+    long line;
+    int status;
+} SedInput;
+
+typedef struct {
+    SedScript *script;
+    SedInput input;
+    FILE *out;
+    StrBuf pattern;
+    StrBuf hold;
+    StrBuf scratch;
+    StrBuf appended;
+    int missing_newline;
+    int owe_newline;
+    int substituted;
+    int quiet;
+    int quitting;
+    int exit_code;
+} SedRun;
+
+typedef enum { STEP_NEXT, STEP_DELETE, STEP_RESTART, STEP_QUIT, STEP_QUIT_SILENT } SedStep;
+
+static void compile_fail(SedCompiler *cp, const char *message) {
+    if (!cp->failed) shell_error("sed: %s", message);
+    cp->failed = 1;
+}
+
+static SedCommand *command_new(SedScript *script) {
+    if (script->len + 1 >= script->cap) {
+        script->cap = script->cap ? script->cap * 2 : 16;
+        script->items = xrealloc(script->items, script->cap * sizeof(SedCommand));
+    }
+    SedCommand *command = &script->items[script->len++];
+    memset(command, 0, sizeof(SedCommand));
+    command->occurrence = 1;
+    return command;
+}
+
+static void script_free(SedScript *script) {
+    for (size_t i = 0; i < script->len; i++) {
+        free(script->items[i].text);
+        free(script->items[i].table);
+    }
+    for (size_t i = 0; i < script->regex_count; i++) regex_free(script->regexes[i]);
+    free(script->items);
+    free(script->regexes);
+}
+
+static void skip_blanks(SedCompiler *cp) {
+    while (*cp->p == ' ' || *cp->p == '\t') cp->p++;
+}
+
+static const char *skip_class(const char *p) {
+    p++;
+    if (*p == '^') p++;
+    if (*p == ']') p++;
+    while (*p && *p != ']') p++;
+    return p;
+}
+
+static char *read_delimited(SedCompiler *cp, char delimiter, int regex) {
+    StrBuf out;
+    sb_init(&out);
+
+    const char *p = cp->p;
+    while (*p && *p != delimiter) {
+        if (regex && *p == '[') {
+            const char *close = skip_class(p);
+            if (!*close) break;
+            sb_putn(&out, p, (size_t)(close - p + 1));
+            p = close + 1;
+            continue;
+        }
+        if (*p == '\\' && p[1]) {
+            if (p[1] == delimiter) {
+                sb_putc(&out, delimiter);
+            } else if (p[1] == '\n') {
+                sb_putc(&out, '\n');
+            } else {
+                sb_putc(&out, '\\');
+                sb_putc(&out, p[1]);
+            }
+            p += 2;
+            continue;
+        }
+        sb_putc(&out, *p++);
+    }
+    if (*p != delimiter) {
+        sb_free(&out);
+        return NULL;
+    }
+    cp->p = p + 1;
+    return sb_take(&out);
+}
+
+static Regex *compile_regex(SedCompiler *cp, const char *text) {
+    if (!*text) {
+        if (!cp->last_regex) compile_fail(cp, "no previous regular expression");
+        return cp->last_regex;
+    }
+
+    StrBuf expression;
+    sb_init(&expression);
+    if (cp->extended) sb_puts(&expression, text);
+    else regex_bre_to_ere(text, &expression);
+    Regex *regex = regex_compile(expression.data);
+    sb_free(&expression);
+
+    if (!regex) {
+        compile_fail(cp, "invalid regular expression");
+        return NULL;
+    }
+
+    SedScript *script = cp->script;
+    script->regexes = xrealloc(script->regexes, (script->regex_count + 1) * sizeof(Regex *));
+    script->regexes[script->regex_count++] = regex;
+    cp->last_regex = regex;
+    return regex;
+}
+
+static int parse_address(SedCompiler *cp, SedAddress *address, int second) {
+    const char *p = cp->p;
+
+    if (isdigit((unsigned char)*p) || (second && *p == '+' && isdigit((unsigned char)p[1]))) {
+        address->kind = *p == '+' ? ADDRESS_RELATIVE : ADDRESS_LINE;
+        char *end;
+        address->line = strtol(*p == '+' ? p + 1 : p, &end, 10);
+        if (address->kind == ADDRESS_LINE && *end == '~' && isdigit((unsigned char)end[1])) {
+            address->kind = ADDRESS_STEP;
+            address->step = strtol(end + 1, &end, 10);
+        }
+        cp->p = end;
+        return 1;
+    }
+    if (*p == '$') {
+        address->kind = ADDRESS_LAST;
+        cp->p++;
+        return 1;
+    }
+    if (*p == '/' || (*p == '\\' && p[1] && p[1] != '\n')) {
+        char delimiter = *p == '/' ? '/' : p[1];
+        cp->p += *p == '/' ? 1 : 2;
+        char *text = read_delimited(cp, delimiter, 1);
+        if (!text) {
+            compile_fail(cp, "unterminated address regex");
+            return 0;
+        }
+        address->kind = ADDRESS_REGEX;
+        address->regex = compile_regex(cp, text);
+        free(text);
+        return 1;
+    }
+    return 0;
+}
+
+static char *read_text(SedCompiler *cp) {
+    skip_blanks(cp);
+    if (cp->p[0] == '\\' && cp->p[1] == '\n') cp->p += 2;
+    else if (cp->p[0] == '\\') cp->p++;
+
+    StrBuf out;
+    sb_init(&out);
+    while (*cp->p && *cp->p != '\n') {
+        if (*cp->p == '\\' && cp->p[1]) {
+            cp->p++;
+            sb_putc(&out, *cp->p++);
+            continue;
+        }
+        sb_putc(&out, *cp->p++);
+    }
+    return sb_take(&out);
+}
+
+static char *read_label(SedCompiler *cp) {
+    skip_blanks(cp);
+    const char *start = cp->p;
+    while (*cp->p && *cp->p != '\n' && *cp->p != ';') cp->p++;
+    const char *end = cp->p;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    return xstrndup(start, (size_t)(end - start));
+}
+
+static int decode_escape(const char **p, char delimiter) {
+    const char *c = *p;
+    if (*c != '\\' || !c[1]) {
+        (*p)++;
+        return (unsigned char)*c;
+    }
+    *p += 2;
+    switch (c[1]) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    default: return c[1] == delimiter ? delimiter : (unsigned char)c[1];
+    }
+}
+
+static void parse_substitute(SedCompiler *cp, SedCommand *command) {
+    char delimiter = *cp->p;
+    if (!delimiter || delimiter == '\n' || delimiter == '\\') {
+        compile_fail(cp, "unterminated `s' command");
+        return;
+    }
+    cp->p++;
+
+    char *pattern = read_delimited(cp, delimiter, 1);
+    char *replacement = pattern ? read_delimited(cp, delimiter, 0) : NULL;
+    if (!pattern || !replacement) {
+        free(pattern);
+        compile_fail(cp, "unterminated `s' command");
+        return;
+    }
+    command->regex = compile_regex(cp, pattern);
+    command->text = replacement;
+    free(pattern);
+
+    while (*cp->p && !strchr(";\n}# \t", *cp->p)) {
+        char flag = *cp->p;
+        if (flag == 'g') {
+            command->global = 1;
+            cp->p++;
+        } else if (flag == 'p') {
+            command->print = 1;
+            cp->p++;
+        } else if (isdigit((unsigned char)flag) && flag != '0') {
+            char *end;
+            command->occurrence = (int)strtol(cp->p, &end, 10);
+            cp->p = end;
+        } else {
+            compile_fail(cp, "unknown option to `s'");
+            return;
+        }
+    }
+}
+
+static void parse_transliterate(SedCompiler *cp, SedCommand *command) {
+    char delimiter = *cp->p;
+    if (!delimiter || delimiter == '\n' || delimiter == '\\') {
+        compile_fail(cp, "unterminated `y' command");
+        return;
+    }
+    cp->p++;
+
+    char *from = read_delimited(cp, delimiter, 0);
+    char *to = from ? read_delimited(cp, delimiter, 0) : NULL;
+    if (!from || !to) {
+        free(from);
+        compile_fail(cp, "unterminated `y' command");
+        return;
+    }
+
+    command->table = xmalloc(256);
+    for (int c = 0; c < 256; c++) command->table[c] = (unsigned char)c;
+
+    const char *f = from;
+    const char *t = to;
+    while (*f && *t) {
+        int source = decode_escape(&f, delimiter);
+        int target = decode_escape(&t, delimiter);
+        command->table[source] = (unsigned char)target;
+    }
+    if (*f || *t) compile_fail(cp, "strings for `y' command are different lengths");
+    free(from);
+    free(to);
+}
+
+static void parse_command(SedCompiler *cp) {
+    SedScript *script = cp->script;
+    SedAddress first = {ADDRESS_NONE, 0, 0, NULL};
+    SedAddress last = {ADDRESS_NONE, 0, 0, NULL};
+
+    if (parse_address(cp, &first, 0)) {
+        skip_blanks(cp);
+        if (*cp->p == ',') {
+            cp->p++;
+            skip_blanks(cp);
+            if (!parse_address(cp, &last, 1)) {
+                compile_fail(cp, "unexpected `,'");
+                return;
+            }
+        }
+    }
+    if (cp->failed) return;
+
+    skip_blanks(cp);
+    int negate = 0;
+    while (*cp->p == '!') {
+        negate = 1;
+        cp->p++;
+        skip_blanks(cp);
+    }
+
+    char name = *cp->p;
+    if (!name || name == '\n' || name == ';') {
+        compile_fail(cp, "missing command");
+        return;
+    }
+    cp->p++;
+    if ((name == ':' || name == '}') && (first.kind != ADDRESS_NONE || negate)) {
+        compile_fail(cp, name == ':' ? ": doesn't want any addresses" : "} doesn't want any addresses");
+        return;
+    }
+
+    SedCommand *command = command_new(script);
+    command->name = name;
+    command->first = first;
+    command->last = last;
+    command->negate = negate;
+
+    switch (name) {
+    case '{':
+        cp->blocks = xrealloc(cp->blocks, (cp->depth + 1) * sizeof(size_t));
+        cp->blocks[cp->depth++] = script->len - 1;
+        return;
+    case '}':
+        if (!cp->depth) {
+            compile_fail(cp, "unexpected `}'");
+            return;
+        }
+        script->items[cp->blocks[--cp->depth]].jump = script->len - 1;
+        break;
+    case 'a':
+    case 'i':
+    case 'c':
+        command->text = read_text(cp);
+        return;
+    case ':':
+        command->text = read_label(cp);
+        if (!*command->text) compile_fail(cp, "\":\" lacks a label");
+        break;
+    case 'b':
+    case 't':
+    case 'T':
+        command->text = read_label(cp);
+        break;
+    case 'q':
+    case 'Q':
+        skip_blanks(cp);
+        if (isdigit((unsigned char)*cp->p)) {
+            char *end;
+            command->exit_code = (int)strtol(cp->p, &end, 10);
+            cp->p = end;
+        }
+        break;
+    case 's':
+        parse_substitute(cp, command);
+        break;
+    case 'y':
+        parse_transliterate(cp, command);
+        break;
+    case '=':
+    case 'd':
+    case 'D':
+    case 'g':
+    case 'G':
+    case 'h':
+    case 'H':
+    case 'n':
+    case 'N':
+    case 'p':
+    case 'P':
+    case 'x':
+    case 'z':
+        break;
+    default: {
+        char message[64];
+        snprintf(message, sizeof(message), "unknown command: `%c'", name);
+        compile_fail(cp, message);
+        return;
+    }
+    }
+    if (cp->failed) return;
+
+    skip_blanks(cp);
+    if (*cp->p == '#' || *cp->p == '}') return;
+    if (*cp->p && *cp->p != ';' && *cp->p != '\n') {
+        char message[64];
+        snprintf(message, sizeof(message), "extra characters after command `%c'", name);
+        compile_fail(cp, message);
+    }
+}
+
+static void resolve_labels(SedCompiler *cp) {
+    SedScript *script = cp->script;
+    for (size_t i = 0; i < script->len && !cp->failed; i++) {
+        SedCommand *command = &script->items[i];
+        if (!strchr("btT", command->name)) continue;
+        command->jump = script->len;
+        if (!*command->text) continue;
+
+        size_t target = script->len;
+        for (size_t j = 0; j < script->len; j++) {
+            if (script->items[j].name == ':' && strcmp(script->items[j].text, command->text) == 0) {
+                target = j;
+                break;
+            }
+        }
+        if (target == script->len) {
+            StrBuf message;
+            sb_init(&message);
+            sb_printf(&message, "can't find label for jump to `%s'", command->text);
+            compile_fail(cp, message.data);
+            sb_free(&message);
+        }
+        command->jump = target;
+    }
+}
+
+static int compile_script(const char *source, int extended, SedScript *script) {
+    SedCompiler cp;
+    memset(&cp, 0, sizeof(cp));
+    cp.p = source;
+    cp.script = script;
+    cp.extended = extended;
+
+    while (!cp.failed) {
+        while (*cp.p && (isspace((unsigned char)*cp.p) || *cp.p == ';')) cp.p++;
+        if (!*cp.p) break;
+        if (*cp.p == '#') {
+            while (*cp.p && *cp.p != '\n') cp.p++;
+            continue;
+        }
+        parse_command(&cp);
+    }
+    if (!cp.failed && cp.depth) compile_fail(&cp, "unmatched `{'");
+    resolve_labels(&cp);
+    free(cp.blocks);
+    return !cp.failed;
+}
+
+static int input_fill(SedInput *in) {
+    while (!in->next_kind) {
+        if (!in->file) {
+            if (in->next_name >= in->count) return 0;
+            const char *name = in->names[in->next_name++];
+            in->file = strcmp(name, "-") == 0 ? stdin : fopen(name, "rb");
+            if (!in->file) {
+                shell_error("sed: %s: no such file", name);
+                in->status = 2;
+                continue;
+            }
+        }
+        in->next_kind = read_line(in->file, &in->next);
+        if (!in->next_kind) {
+            if (in->file != stdin) fclose(in->file);
+            in->file = NULL;
+        }
+    }
+    return 1;
+}
+
+static void input_close(SedInput *in) {
+    if (in->file && in->file != stdin) fclose(in->file);
+    in->file = NULL;
+    sb_free(&in->next);
+}
+
+static void put(SedRun *run, const char *data, size_t length) {
+    if (run->out == stdout) out_write(data, length);
+    else fwrite(data, 1, length, run->out);
+}
+
+static void emit(SedRun *run, const char *data, size_t length, int newline) {
+    if (run->owe_newline) put(run, "\n", 1);
+    put(run, data, length);
+    if (newline) put(run, "\n", 1);
+    run->owe_newline = !newline;
+}
+
+static void emit_pattern(SedRun *run) {
+    emit(run, run->pattern.data, run->pattern.len, !run->missing_newline);
+}
+
+static void flush_appended(SedRun *run) {
+    if (!run->appended.len) return;
+    emit(run, run->appended.data, run->appended.len, 0);
+    run->owe_newline = 0;
+    sb_clear(&run->appended);
+}
+
+static int next_line(SedRun *run, int append) {
+    if (!input_fill(&run->input)) return 0;
+    if (append) {
+        sb_putc(&run->pattern, '\n');
+        sb_putn(&run->pattern, run->input.next.data, run->input.next.len);
+    } else {
+        StrBuf swap = run->pattern;
+        run->pattern = run->input.next;
+        run->input.next = swap;
+    }
+    run->missing_newline = run->input.next_kind == 2;
+    run->input.next_kind = 0;
+    run->input.line++;
+    return 1;
+}
+
+static int at_last_line(SedRun *run) {
+    return !input_fill(&run->input);
+}
+
+static int address_hit(SedRun *run, const SedAddress *address) {
+    switch (address->kind) {
+    case ADDRESS_LINE: return run->input.line == address->line;
+    case ADDRESS_STEP:
+        if (address->step <= 0) return run->input.line == address->line;
+        return run->input.line >= address->line &&
+               (run->input.line - address->line) % address->step == 0;
+    case ADDRESS_LAST: return at_last_line(run);
+    case ADDRESS_REGEX: return regex_exec(address->regex, run->pattern.data, NULL);
+    default: return 0;
+    }
+}
+
+static int range_ends(SedRun *run, SedCommand *command) {
+    long line = run->input.line;
+    switch (command->last.kind) {
+    case ADDRESS_LINE: return line >= command->last.line;
+    case ADDRESS_RELATIVE: return line >= command->range_end;
+    default: return address_hit(run, &command->last);
+    }
+}
+
+static int selected(SedRun *run, SedCommand *command) {
+    int hit = 0;
+    if (command->first.kind == ADDRESS_NONE) {
+        hit = 1;
+    } else if (command->last.kind == ADDRESS_NONE) {
+        hit = address_hit(run, &command->first);
+    } else if (command->active) {
+        hit = 1;
+        if (range_ends(run, command)) command->active = 0;
+    } else if (address_hit(run, &command->first)) {
+        hit = 1;
+        command->range_end = run->input.line + command->last.line;
+        command->active = command->last.kind == ADDRESS_REGEX || !range_ends(run, command);
+    }
+    return command->negate ? !hit : hit;
+}
+
+static void put_hold(StrBuf *target, const StrBuf *source, int append) {
+    if (!append) sb_clear(target);
+    else sb_putc(target, '\n');
+    sb_putn(target, source->data, source->len);
+}
+
+static SedStep execute(SedRun *run, SedCommand *command, size_t *pc) {
+    StrBuf *pattern = &run->pattern;
+
+    switch (command->name) {
+    case '=': {
+        char number[32];
+        int length = snprintf(number, sizeof(number), "%ld", run->input.line);
+        emit(run, number, (size_t)length, 1);
+        break;
+    }
+    case 'a':
+        sb_puts(&run->appended, command->text);
+        sb_putc(&run->appended, '\n');
+        break;
+    case 'i':
+        emit(run, command->text, strlen(command->text), 1);
+        break;
+    case 'c':
+        if (command->last.kind == ADDRESS_NONE || command->negate || !command->active)
+            emit(run, command->text, strlen(command->text), 1);
+        return STEP_DELETE;
+    case 'd':
+        return STEP_DELETE;
+    case 'D': {
+        char *newline = memchr(pattern->data, '\n', pattern->len);
+        if (!newline) return STEP_DELETE;
+        size_t cut = (size_t)(newline - pattern->data) + 1;
+        memmove(pattern->data, pattern->data + cut, pattern->len - cut + 1);
+        pattern->len -= cut;
+        return STEP_RESTART;
+    }
+    case 'g':
+        put_hold(pattern, &run->hold, 0);
+        break;
+    case 'G':
+        put_hold(pattern, &run->hold, 1);
+        break;
+    case 'h':
+        put_hold(&run->hold, pattern, 0);
+        break;
+    case 'H':
+        put_hold(&run->hold, pattern, 1);
+        break;
+    case 'x': {
+        StrBuf swap = run->hold;
+        run->hold = run->pattern;
+        run->pattern = swap;
+        break;
+    }
+    case 'z':
+        sb_clear(pattern);
+        break;
+    case 'n':
+        if (at_last_line(run)) return STEP_QUIT;
+        if (!run->quiet) emit_pattern(run);
+        flush_appended(run);
+        next_line(run, 0);
+        break;
+    case 'N':
+        if (at_last_line(run)) return STEP_QUIT;
+        flush_appended(run);
+        next_line(run, 1);
+        break;
+    case 'p':
+        emit_pattern(run);
+        break;
+    case 'P': {
+        char *newline = memchr(pattern->data, '\n', pattern->len);
+        if (newline) emit(run, pattern->data, (size_t)(newline - pattern->data), 1);
+        else emit_pattern(run);
+        break;
+    }
+    case 'q':
+        run->exit_code = command->exit_code;
+        return STEP_QUIT;
+    case 'Q':
+        run->exit_code = command->exit_code;
+        return STEP_QUIT_SILENT;
+    case 's':
+        sb_clear(&run->scratch);
+        if (!regex_substitute(command->regex, command->text, pattern->data, command->occurrence,
+                              command->global, &run->scratch))
+            break;
+        {
+            StrBuf swap = run->pattern;
+            run->pattern = run->scratch;
+            run->scratch = swap;
+        }
+        run->substituted = 1;
+        if (command->print) emit_pattern(run);
+        break;
+    case 'y':
+        for (size_t i = 0; i < pattern->len; i++)
+            pattern->data[i] = (char)command->table[(unsigned char)pattern->data[i]];
+        break;
+    case 'b':
+        *pc = command->jump;
+        return STEP_NEXT;
+    case 't':
+    case 'T': {
+        int jump = command->name == 't' ? run->substituted : !run->substituted;
+        run->substituted = 0;
+        if (jump) {
+            *pc = command->jump;
+            return STEP_NEXT;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    (*pc)++;
+    return STEP_NEXT;
+}
+
+static void run_script(SedRun *run) {
+    SedScript *script = run->script;
+    int restart = 0;
+
+    while (!run->quitting && !shell.interrupted) {
+        if (!restart) {
+            if (!next_line(run, 0)) break;
+            run->substituted = 0;
+        }
+        restart = 0;
+
+        SedStep step = STEP_NEXT;
+        size_t pc = 0;
+        while (pc < script->len) {
+            SedCommand *command = &script->items[pc];
+            if (command->name == ':' || command->name == '}') {
+                pc++;
+                continue;
+            }
+            if (!selected(run, command)) {
+                pc = command->name == '{' ? command->jump + 1 : pc + 1;
+                continue;
+            }
+            if (command->name == '{') {
+                pc++;
+                continue;
+            }
+            step = execute(run, command, &pc);
+            if (step != STEP_NEXT) break;
+        }
+
+        if ((step == STEP_NEXT || step == STEP_QUIT) && !run->quiet) emit_pattern(run);
+        flush_appended(run);
+        if (step == STEP_QUIT || step == STEP_QUIT_SILENT) run->quitting = 1;
+        if (step == STEP_RESTART) restart = 1;
+    }
+}
+
+static void reset_ranges(SedScript *script) {
+    for (size_t i = 0; i < script->len; i++) script->items[i].active = 0;
+}
+
+static int run_stream(SedRun *run, char **names, int count, FILE *out) {
+    memset(&run->input, 0, sizeof(run->input));
+    sb_init(&run->input.next);
+    run->input.names = names;
+    run->input.count = count;
+    run->out = out;
+    run->owe_newline = 0;
+    reset_ranges(run->script);
+
+    run_script(run);
+    int status = run->input.status;
+    input_close(&run->input);
+    return status;
+}
+
+static int edit_in_place(SedRun *run, char *path, const char *suffix) {
+    if (strcmp(path, "-") == 0 || !path_is_file(path)) {
+        shell_error("sed: couldn't edit %s: not a regular file", path);
+        return 4;
+    }
+
+    char native[PATH_BUF];
+    snprintf(native, sizeof(native), "%s", path);
+    path_to_backslashes(native);
+
+    char directory[PATH_BUF];
+    snprintf(directory, sizeof(directory), "%s", native);
+    char *slash = strrchr(directory, '\\');
+    if (slash) slash[slash == directory ? 1 : 0] = '\0';
+    else snprintf(directory, sizeof(directory), ".");
+
+    char temporary[PATH_BUF];
+    if (!GetTempFileNameA(directory, "sed", 0, temporary)) {
+        shell_error("sed: couldn't open a temporary file in %s", directory);
+        return 4;
+    }
+    FILE *out = fopen(temporary, "wb");
+    if (!out) {
+        DeleteFileA(temporary);
+        shell_error("sed: couldn't open temporary file %s", temporary);
+        return 4;
+    }
+
+    int status = run_stream(run, &path, 1, out);
+    int written = !ferror(out);
+    written &= fclose(out) == 0;
+    if (!written) {
+        DeleteFileA(temporary);
+        shell_error("sed: couldn't write %s", temporary);
+        return 4;
+    }
+
+    if (suffix && *suffix) {
+        StrBuf backup;
+        sb_init(&backup);
+        sb_printf(&backup, "%s%s", native, suffix);
+        int saved = MoveFileExA(native, backup.data, MOVEFILE_REPLACE_EXISTING) != 0;
+        if (!saved) shell_error("sed: cannot rename %s to %s", path, backup.data);
+        sb_free(&backup);
+        if (!saved) {
+            DeleteFileA(temporary);
+            return 4;
+        }
+    }
+    if (!MoveFileExA(temporary, native, MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
+        DeleteFileA(temporary);
+        shell_error("sed: cannot rename %s", path);
+        return 4;
+    }
+    return status;
+}
+
+static int add_script_file(StrBuf *source, const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f) {
+        shell_error("sed: %s: no such file", path);
+        return 0;
+    }
+    if (source->len) sb_putc(source, '\n');
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), f)) > 0) sb_putn(source, chunk, read);
+    if (f != stdin) fclose(f);
+    return 1;
+}
+
+static void add_script_text(StrBuf *source, const char *text) {
+    if (source->len) sb_putc(source, '\n');
+    sb_puts(source, text);
+}
+
+int sed_main(int argc, char **argv) {
+    StrBuf source;
+    sb_init(&source);
+    int have_script = 0;
+    int quiet = 0;
+    int extended = 0;
+    int separate = 0;
+    int in_place = 0;
+    const char *suffix = NULL;
+    int options_done = 0;
+
+    char **operands = xmalloc((size_t)argc * sizeof(char *));
+    int count = 0;
+    int status = 0;
+
+    for (int i = 1; i < argc && !status; i++) {
+        char *arg = argv[i];
+        if (options_done || arg[0] != '-' || !arg[1]) {
+            operands[count++] = arg;
+            continue;
+        }
+        if (strcmp(arg, "--") == 0) {
+            options_done = 1;
+            continue;
+        }
+        if (arg[1] == '-') {
+            const char *value = strchr(arg, '=');
+            if (strcmp(arg, "--quiet") == 0 || strcmp(arg, "--silent") == 0) {
+                quiet = 1;
+            } else if (strcmp(arg, "--regexp-extended") == 0) {
+                extended = 1;
+            } else if (strcmp(arg, "--separate") == 0) {
+                separate = 1;
+            } else if (str_has_prefix(arg, "--in-place")) {
+                in_place = 1;
+                if (value) suffix = value + 1;
+            } else if (str_has_prefix(arg, "--expression")) {
+                const char *text = value ? value + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!text) status = 2;
+                else add_script_text(&source, text);
+                have_script = 1;
+            } else if (str_has_prefix(arg, "--file")) {
+                const char *path = value ? value + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!path || !add_script_file(&source, path)) status = 2;
+                have_script = 1;
+            }
+            continue;
+        }
+        for (const char *flag = arg + 1; *flag && !status; flag++) {
+            if (*flag == 'n') {
+                quiet = 1;
+            } else if (*flag == 'E' || *flag == 'r') {
+                extended = 1;
+            } else if (*flag == 's') {
+                separate = 1;
+            } else if (*flag == 'i') {
+                in_place = 1;
+                if (flag[1]) suffix = flag + 1;
+                break;
+            } else if (*flag == 'e' || *flag == 'f') {
+                const char *value = flag[1] ? flag + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!value) status = 2;
+                else if (*flag == 'e') add_script_text(&source, value);
+                else if (!add_script_file(&source, value)) status = 2;
+                have_script = 1;
+                break;
+            }
+        }
+    }
+
+    int first_file = 0;
+    if (!status && !have_script) {
+        if (count == 0) status = 2;
+        else add_script_text(&source, operands[first_file++]);
+    }
+    if (status) {
+        shell_error("sed: usage: sed [-n] [-E] [-i[suffix]] [-e script]... [script] [file...]");
+        sb_free(&source);
+        free(operands);
+        return status;
+    }
+
+    SedScript script;
+    memset(&script, 0, sizeof(script));
+    if (!compile_script(source.data, extended, &script)) {
+        script_free(&script);
+        sb_free(&source);
+        free(operands);
+        return 1;
+    }
+    sb_free(&source);
+
+    SedRun run;
+    memset(&run, 0, sizeof(run));
+    run.script = &script;
+    run.quiet = quiet;
+    sb_init(&run.pattern);
+    sb_init(&run.hold);
+    sb_init(&run.scratch);
+    sb_init(&run.appended);
+
+    char *standard_input = "-";
+    char **files = count > first_file ? operands + first_file : &standard_input;
+    int file_count = count > first_file ? count - first_file : 1;
+
+    if (in_place) {
+        for (int i = 0; i < file_count && !run.quitting; i++) {
+            int result = edit_in_place(&run, files[i], suffix);
+            if (result > status) status = result;
+        }
+    } else if (separate) {
+        for (int i = 0; i < file_count && !run.quitting; i++) {
+            int result = run_stream(&run, files + i, 1, stdout);
+            if (result > status) status = result;
+        }
+    } else {
+        status = run_stream(&run, files, file_count, stdout);
+    }
+    out_flush();
+
+    sb_free(&run.pattern);
+    sb_free(&run.hold);
+    sb_free(&run.scratch);
+    sb_free(&run.appended);
+    script_free(&script);
+    free(operands);
+    return run.exit_code ? run.exit_code : status;
+}
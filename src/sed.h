@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#ifndef FRESH_SED_H
+#define FRESH_SED_H
+
+int sed_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#include "startup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "exec.h"
+#include "shell.h"
+#include "theme.h"
+#include "vars.h"
+
+#define IMAGE_MAGIC "FRSHBOOT"
+#define IMAGE_VERSION 2u
+#define IMAGE_LIMIT (64ull * 1024 * 1024)
+
+typedef struct {
+    char *path;
+    unsigned long long size;
+    unsigned long long stamp;
+    char *aliases;
+    const char *data;
+    size_t length;
+    char *owned;
+    int used;
+} ImageEntry;
+
+typedef struct {
+    const char *at;
+    const char *end;
+    int failed;
+} ImageReader;
+
+static ImageEntry *entries = NULL;
+static size_t entry_count = 0;
+static size_t entry_cap = 0;
+static char *image_path = NULL;
+static const char *image_view = NULL;
+static unsigned long long bundle_stamps[2];
+static int image_state = 0;
+static int image_changed = 0;
+
+static DWORD path_stamp(const char *path, unsigned long long *size, unsigned long long *stamp) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return INVALID_FILE_ATTRIBUTES;
+    *size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    *stamp = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+             data.ftLastWriteTime.dwLowDateTime;
+    return data.dwFileAttributes;
+}
+
+static ImageEntry *entry_find(const char *path) {
+    for (size_t i = 0; i < entry_count; i++) {
+        if (str_ieq(entries[i].path, path)) return &entries[i];
+    }
+    return NULL;
+}
+
+static ImageEntry *entry_add(char *path) {
+    if (entry_count == entry_cap) {
+        entry_cap = entry_cap ? entry_cap * 2 : 8;
+        entries = xrealloc(entries, entry_cap * sizeof(ImageEntry));
+    }
+    ImageEntry *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->path = path;
+    return entry;
+}
+
+static void entries_clear(void) {
+    for (size_t i = 0; i < entry_count; i++) {
+        free(entries[i].path);
+        free(entries[i].aliases);
+        free(entries[i].owned);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    entry_cap = 0;
+}
+
+static const char *read_bytes(ImageReader *in, size_t length) {
+    if (in->failed || (size_t)(in->end - in->at) < length) {
+        in->failed = 1;
+        return NULL;
+    }
+    const char *data = in->at;
+    in->at += length;
+    return data;
+}
+
+static unsigned read_number(ImageReader *in) {
+    unsigned value = 0;
+    const char *data = read_bytes(in, sizeof(value));
+    if (data) memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static unsigned long long read_wide(ImageReader *in) {
+    unsigned long long value = 0;
+    const char *data = read_bytes(in, sizeof(value));
+    if (data) memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static const char *read_span(ImageReader *in, size_t *length) {
+    *length = read_number(in);
+    return read_bytes(in, *length);
+}
+
+static void write_number(StrBuf *out, unsigned value) {
+    sb_putn(out, (const char *)&value, sizeof(value));
+}
+
+static void write_wide(StrBuf *out, unsigned long long value) {
+    sb_putn(out, (const char *)&value, sizeof(value));
+}
+
+static void write_span(StrBuf *out, const char *data, size_t length) {
+    write_number(out, (unsigned)length);
+    sb_putn(out, data, length);
+}
+
+static unsigned image_checksum(const char *data, size_t length) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int image_parse(const char *data, size_t length) {
+    ImageReader in = {data, data + length, 0};
+    const char *magic = read_bytes(&in, 8);
+    if (!magic || memcmp(magic, IMAGE_MAGIC, 8) != 0 || read_number(&in) != IMAGE_VERSION)
+        return 0;
+    unsigned checksum = read_number(&in);
+    if (in.failed || image_checksum(in.at, (size_t)(in.end - in.at)) != checksum) return 0;
+    size_t span;
+    const char *version = read_span(&in, &span);
+    if (!version || span != strlen(FRESH_VERSION) || memcmp(version, FRESH_VERSION, span) != 0)
+        return 0;
+
+    bundle_stamps[0] = read_wide(&in);
+    bundle_stamps[1] = read_wide(&in);
+    unsigned count = read_number(&in);
+    for (unsigned i = 0; !in.failed && i < count; i++) {
+        size_t path_length;
+        size_t alias_length;
+        size_t node_length;
+        const char *path = read_span(&in, &path_length);
+        unsigned long long size = read_wide(&in);
+        unsigned long long stamp = read_wide(&in);
+        const char *aliases = read_span(&in, &alias_length);
+        const char *node = read_span(&in, &node_length);
+        if (in.failed) break;
+
+        ImageEntry *entry = entry_add(xstrndup(path, path_length));
+        entry->size = size;
+        entry->stamp = stamp;
+        entry->aliases = xstrndup(aliases, alias_length);
+        entry->data = node;
+        entry->length = node_length;
+    }
+    return !in.failed && in.at == in.end;
+}
+
+static void image_open(void) {
+    if (image_state) return;
+    image_state = 1;
+    image_path = fresh_home_path("startup.cache");
+
+    HANDLE file = CreateFileA(image_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+        (unsigned long long)size.QuadPart < IMAGE_LIMIT) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            image_view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)size.QuadPart);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (!image_view) return;
+
+    if (!image_parse(image_view, (size_t)size.QuadPart)) {
+        entries_clear();
+        bundle_stamps[0] = bundle_stamps[1] = 0;
+        image_changed = 1;
+    }
+}
+
+static char *alias_snapshot(void) {
+    StrList aliases;
+    sl_init(&aliases);
+    alias_list(&aliases);
+    StrBuf snapshot;
+    sb_init(&snapshot);
+    for (size_t i = 0; i < aliases.len; i++) {
+        sb_puts(&snapshot, aliases.items[i]);
+        sb_putc(&snapshot, '\n');
+    }
+    sl_free(&aliases);
+    return sb_take(&snapshot);
+}
+
+static Node *image_compile(const char *path, unsigned long long size, unsigned long long stamp,
+                           char *aliases) {
+    FILE *f = size < IMAGE_LIMIT ? fopen(path, "rb") : NULL;
+    if (!f) {
+        free(aliases);
+        return NULL;
+    }
+    char *text = xmalloc((size_t)size + 1);
+    size_t read = fread(text, 1, (size_t)size, f);
+    text[read] = '\0';
+    fclose(f);
+
+    Node *node = NULL;
+    if (read == size && strchr(text, '\n')) {
+        int incomplete = 0;
+        char *error = NULL;
+        char *aliased = apply_aliases(text);
+        node = parse_string(aliased, &incomplete, &error);
+        free(aliased);
+        free(error);
+    }
+    free(text);
+    if (!node) {
+        free(aliases);
+        return NULL;
+    }
+
+    StrBuf encoded;
+    sb_init(&encoded);
+    ImageEntry *entry = entry_find(path);
+    if (!node_encode(node, &encoded)) {
+        sb_free(&encoded);
+        free(aliases);
+        if (entry) entry->used = 0;
+        return node;
+    }
+    if (entry) {
+        free(entry->aliases);
+        free(entry->owned);
+    } else {
+        entry = entry_add(xstrdup(path));
+    }
+    entry->size = size;
+    entry->stamp = stamp;
+    entry->aliases = aliases;
+    entry->length = encoded.len;
+    entry->owned = sb_take(&encoded);
+    entry->data = entry->owned;
+    entry->used = 1;
+    image_changed = 1;
+    return node;
+}
+
+int startup_source(const char *path) {
+    unsigned long long size;
+    unsigned long long stamp;
+    DWORD attributes = path_stamp(path, &size, &stamp);
+    if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY)) return 0;
+    if (image_state == 2) {
+        exec_script_file(path, NULL);
+        return 1;
+    }
+    image_open();
+
+    char *aliases = alias_snapshot();
+    ImageEntry *entry = entry_find(path);
+    Node *node = NULL;
+    if (entry && entry->size == size && entry->stamp == stamp &&
+        strcmp(entry->aliases, aliases) == 0)
+        node = node_decode(entry->data, entry->length);
+
+    if (node) {
+        free(aliases);
+        entry->used = 1;
+    } else {
+        node = image_compile(path, size, stamp, aliases);
+    }
+
+    if (!node) {
+        exec_script_file(path, NULL);
+        return 1;
+    }
+    exec_script_node(path, node);
+    node_free(node);
+    return 1;
+}
+
+static void bundle_stamp(unsigned long long stamps[2]) {
+    static const char *KINDS[2] = {"themes", "plugins"};
+    for (int i = 0; i < 2; i++) {
+        char *directory = fresh_home_path(KINDS[i]);
+        unsigned long long size;
+        if (path_stamp(directory, &size, &stamps[i]) == INVALID_FILE_ATTRIBUTES) stamps[i] = 0;
+        free(directory);
+    }
+}
+
+int startup_bundles_current(void) {
+    if (image_state == 2) return 0;
+    image_open();
+    if (!bundle_stamps[0] || !bundle_stamps[1]) return 0;
+
+    unsigned long long current[2];
+    bundle_stamp(current);
+    return current[0] == bundle_stamps[0] && current[1] == bundle_stamps[1];
+}
+
+void startup_bundles_installed(void) {
+    if (image_state != 1) return;
+
+    unsigned long long current[2];
+    bundle_stamp(current);
+    if (current[0] != bundle_stamps[0] || current[1] != bundle_stamps[1]) image_changed = 1;
+    bundle_stamps[0] = current[0];
+    bundle_stamps[1] = current[1];
+}
+
+static void image_encode(StrBuf *out) {
+    unsigned count = 0;
+    for (size_t i = 0; i < entry_count; i++) count += entries[i].used;
+
+    sb_putn(out, IMAGE_MAGIC, 8);
+    write_number(out, IMAGE_VERSION);
+    write_number(out, 0);
+    size_t body = out->len;
+    write_span(out, FRESH_VERSION, strlen(FRESH_VERSION));
+    write_wide(out, bundle_stamps[0]);
+    write_wide(out, bundle_stamps[1]);
+    write_number(out, count);
+    for (size_t i = 0; i < entry_count; i++) {
+        const ImageEntry *entry = &entries[i];
+        if (!entry->used) continue;
+        write_span(out, entry->path, strlen(entry->path));
+        write_wide(out, entry->size);
+        write_wide(out, entry->stamp);
+        write_span(out, entry->aliases, strlen(entry->aliases));
+        write_span(out, entry->data, entry->length);
+    }
+    unsigned checksum = image_checksum(out->data + body, out->len - body);
+    memcpy(out->data + body - sizeof(checksum), &checksum, sizeof(checksum));
+}
+
+static void image_write(const StrBuf *image) {
+    char temporary[PATH_BUF];
+    snprintf(temporary, sizeof(temporary), "%s.%lu", image_path,
+             (unsigned long)GetCurrentProcessId());
+
+    FILE *f = fopen(temporary, "wb");
+    if (!f) return;
+    int failed = fwrite(image->data, 1, image->len, f) != image->len;
+    if (fclose(f) != 0) failed = 1;
+    if (failed || !MoveFileExA(temporary, image_path, MOVEFILE_REPLACE_EXISTING))
+        DeleteFileA(temporary);
+}
+
+void startup_image_finish(void) {
+    if (image_state != 1) {
+        image_state = 2;
+        return;
+    }
+    image_state = 2;
+
+    int changed = image_changed;
+    for (size_t i = 0; i < entry_count; i++) {
+        if (!entries[i].used) changed = 1;
+    }
+
+    StrBuf image;
+    sb_init(&image);
+    if (changed) image_encode(&image);
+    entries_clear();
+    if (image_view) UnmapViewOfFile(image_view);
+    image_view = NULL;
+
+    if (changed) image_write(&image);
+    sb_free(&image);
+    free(image_path);
+    image_path = NULL;
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2025-2026 Musa Bostanci
+ * FreSH - First-Run Experience Shell
+ * GNU General Public License v3.0 - See LICENSE file for details
+ */
+
+#ifndef FRESH_STARTUP_H
+#define FRESH_STARTUP_H
+
+int startup_source(const char *path);
+int startup_bundles_current(void);
+void startup_bundles_installed(void);
+void startup_image_finish(void);
+
+#endif
@@ -6,7 +6,6 @@
 
 #include "style.h"
 
-#include <io.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -21,7 +20,7 @@ int option_enabled(const char *name, int fallback) {
 }
 
 int style_enabled(void) {
-    return _isatty(_fileno(stdout)) && option_enabled("FRESH_COLOR", 1);
+    return out_is_terminal() && option_enabled("FRESH_COLOR", 1);
 }
 
 const char *style(const char *code) {
@@ -19,6 +19,8 @@
 static DWORD saved_out_mode = 0;
 static UINT saved_output_cp = 0;
 static UINT saved_input_cp = 0;
+static int input_console = 0;
+static int input_ended = 0;
 
 static BOOL WINAPI ctrl_handler(DWORD type) {
     if (type == CTRL_C_EVENT) {
@@ -38,6 +40,8 @@ static BOOL WINAPI ctrl_handler(DWORD type) {
 
 void term_init(void) {
     HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD input_mode;
+    input_console = GetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), &input_mode) != 0;
 
     if (GetConsoleMode(out, &saved_out_mode)) {
         saved_output_cp = GetConsoleOutputCP();
@@ -48,7 +52,6 @@ void term_init(void) {
     }
 
     SetConsoleCtrlHandler(ctrl_handler, TRUE);
-    setvbuf(stdout, NULL, _IOFBF, 8192);
 }
 
 void term_cleanup(void) {
@@ -60,6 +63,7 @@ void term_cleanup(void) {
 }
 
 static int screen_info(CONSOLE_SCREEN_BUFFER_INFO *csbi) {
+    if (out_is_buffered()) return 0;
     return GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), csbi) != 0;
 }
 
@@ -146,14 +150,37 @@ static int map_extended(int code) {
 static int pushback = -1;
 
 int term_input_pending(void) {
+    if (!input_console) return pushback >= 0;
     return pushback >= 0 || _kbhit() != 0;
 }
 
+int term_input_ended(void) {
+    return input_ended;
+}
+
+static int stream_read_byte(void) {
+    unsigned char ch;
+    DWORD got = 0;
+    if (input_ended || !ReadFile(GetStdHandle(STD_INPUT_HANDLE), &ch, 1, &got, NULL) || got == 0) {
+        input_ended = 1;
+        return KEY_CTRL_D;
+    }
+    return ch;
+}
+
+int term_wait_input(int milliseconds) {
+    if (term_input_pending()) return 1;
+    Sleep((DWORD)milliseconds);
+    return term_input_pending();
+}
+
 int term_read_key(void) {
     int ch;
     if (pushback >= 0) {
         ch = pushback;
         pushback = -1;
+    } else if (!input_console) {
+        return stream_read_byte();
     } else {
         ch = _getch();
     }
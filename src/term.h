@@ -62,6 +62,8 @@ int term_width(void);
 int term_height(void);
 int term_read_key(void);
 int term_input_pending(void);
+int term_input_ended(void);
+int term_wait_input(int milliseconds);
 void term_write(const char *s);
 void term_clear_screen(void);
 void term_set_title(const char *title);
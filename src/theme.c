@@ -13,6 +13,7 @@
 
 #include "exec.h"
 #include "shell.h"
+#include "startup.h"
 #include "style.h"
 #include "util.h"
 #include "vars.h"
@@ -118,11 +119,11 @@ static char *fresh_home(void) {
     return config_path(".fresh");
 }
 
-static char *bundle_directory(const char *kind) {
+char *fresh_home_path(const char *name) {
     char *home = fresh_home();
-    char *directory = path_join(home, kind);
+    char *path = path_join(home, name);
     free(home);
-    return directory;
+    return path;
 }
 
 static void write_bundle(const char *directory, const BundledFile *files, size_t count,
@@ -143,8 +144,8 @@ static void write_bundle(const char *directory, const BundledFile *files, size_t
 }
 
 static void install_bundles(int overwrite) {
-    char *themes = bundle_directory("themes");
-    char *plugins = bundle_directory("plugins");
+    char *themes = fresh_home_path("themes");
+    char *plugins = fresh_home_path("plugins");
 
     path_mkdirs(themes);
     path_mkdirs(plugins);
@@ -156,18 +157,19 @@ static void install_bundles(int overwrite) {
 }
 
 void fresh_home_init(void) {
+    if (startup_bundles_current()) return;
     install_bundles(0);
+    startup_bundles_installed();
 }
 
 static int source_bundle(const char *kind, const char *name, const char *extension) {
-    char *directory = bundle_directory(kind);
+    char *directory = fresh_home_path(kind);
     char file[PATH_BUF];
     snprintf(file, sizeof(file), "%s%s", name, extension);
     char *target = path_join(directory, file);
     free(directory);
 
-    int found = path_is_file(target);
-    if (found) exec_script_file(target, NULL);
+    int found = startup_source(target);
     free(target);
     return found;
 }
@@ -197,7 +199,7 @@ void plugins_load_configured(void) {
 }
 
 static void list_bundle(const char *kind, const char *extension, const char *active) {
-    char *directory = bundle_directory(kind);
+    char *directory = fresh_home_path(kind);
     char pattern[PATH_BUF];
     snprintf(pattern, sizeof(pattern), "%s\\*%s", directory, extension);
 
@@ -10,6 +10,7 @@
 #include "builtins.h"
 
 void fresh_home_init(void);
+char *fresh_home_path(const char *name);
 void theme_load_configured(void);
 void plugins_load_configured(void);
 
@@ -200,8 +200,8 @@ static int install_update(const char *version) {
     memset(&pi, 0, sizeof(pi));
     si.cb = sizeof(si);
 
-    if (!CreateProcessA(NULL, command, NULL, NULL, FALSE, CREATE_NEW_CONSOLE, NULL, NULL, &si,
-                        &pi)) {
+    if (!CreateProcessA(NULL, command, NULL, NULL, FALSE, CREATE_NEW_CONSOLE, vars_environment(),
+                        NULL, &si, &pi)) {
         shell_error("update: could not start the installer");
         return 1;
     }
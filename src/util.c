@@ -13,6 +13,7 @@
 #ifdef _WIN32
 #include <io.h>
 #else
+#include <sys/stat.h>
 #include <unistd.h>
 #endif
 #include <stdarg.h>
@@ -181,6 +182,218 @@ char *sb_take(StrBuf *sb) {
     return p;
 }
 
+#define OUT_BUFFER 65536
+#define SGR_MAX 16
+
+typedef struct {
+    const char *text[SGR_MAX];
+    size_t length[SGR_MAX];
+    int count;
+    int params;
+} SgrRun;
+
+static Sink *out_top = NULL;
+static StrBuf out_formatted;
+static StrBuf out_coalesced;
+
+void out_init(void) {
+    setvbuf(stdout, NULL, _IOFBF, OUT_BUFFER);
+    setvbuf(stderr, NULL, _IOFBF, OUT_BUFFER / 16);
+}
+
+void sink_file(Sink *sink, FILE *file) {
+    memset(sink, 0, sizeof(*sink));
+    sink->file = file;
+}
+
+void sink_buffer(Sink *sink, StrBuf *buffer) {
+    memset(sink, 0, sizeof(*sink));
+    sink->buffer = buffer;
+}
+
+void out_push(Sink *sink) {
+    sink->outer = out_top;
+    out_top = sink;
+}
+
+void out_pop(Sink *sink) {
+    if (out_top == sink) out_top = sink->outer;
+}
+
+int out_is_buffered(void) {
+    return out_top && out_top->buffer;
+}
+
+#ifndef _WIN32
+#define _isatty isatty
+#define _fileno fileno
+#define _fwrite_nolock fwrite_unlocked
+#define _fputc_nolock putc_unlocked
+#endif
+
+int out_is_terminal(void) {
+    if (out_is_buffered()) return 0;
+    FILE *file = out_top ? out_top->file : stdout;
+    return _isatty(_fileno(file));
+}
+
+static void out_drained(Sink *sink) {
+    if (sink->limit && sink->buffer->len >= sink->limit && sink->drain) sink->drain(sink);
+}
+
+static int sgr_sequence(const char *data, size_t length, size_t at, size_t *end) {
+    if (at + 2 >= length || data[at] != '\x1b' || data[at + 1] != '[') return 0;
+    size_t i = at + 2;
+    while (i < length && (isdigit((unsigned char)data[i]) || data[i] == ';')) i++;
+    if (i >= length || data[i] != 'm') return 0;
+    *end = i + 1;
+    return 1;
+}
+
+static int sgr_value(const char *text, size_t length) {
+    int value = 0;
+    for (size_t i = 0; i < length && value < 1000; i++) value = value * 10 + (text[i] - '0');
+    return value;
+}
+
+static void sgr_emit(StrBuf *out, SgrRun *run) {
+    if (!run->count) return;
+    sb_putn(out, "\x1b[", 2);
+    for (int i = 0; i < run->count; i++) {
+        if (i > 0) sb_putc(out, ';');
+        sb_putn(out, run->text[i], run->length[i]);
+    }
+    sb_putc(out, 'm');
+    run->count = 0;
+    run->params = 0;
+}
+
+static void sgr_add(StrBuf *out, SgrRun *run, const char *text, size_t length, int params) {
+    if (run->count == SGR_MAX || run->params + params > SGR_MAX) sgr_emit(out, run);
+    run->text[run->count] = text;
+    run->length[run->count] = length;
+    run->count++;
+    run->params += params;
+}
+
+static void sgr_parse(StrBuf *out, SgrRun *run, const char *body, size_t length) {
+    size_t at = 0;
+    for (;;) {
+        size_t end = at;
+        while (end < length && body[end] != ';') end++;
+        int value = sgr_value(body + at, end - at);
+        int params = 1;
+        if ((value == 38 || value == 48 || value == 58) && end < length) {
+            size_t kind_end = end + 1;
+            while (kind_end < length && body[kind_end] != ';') kind_end++;
+            int kind = sgr_value(body + end + 1, kind_end - end - 1);
+            int extra = kind == 5 ? 2 : kind == 2 ? 4 : SGR_MAX;
+            for (int i = 0; i < extra && end < length; i++) {
+                end++;
+                while (end < length && body[end] != ';') end++;
+                params++;
+            }
+        }
+        if (value == 0 && params == 1) {
+            run->count = 0;
+            run->params = 0;
+            sgr_add(out, run, "0", 1, 1);
+        } else {
+            sgr_add(out, run, body + at, end - at, params);
+        }
+        if (end >= length) break;
+        at = end + 1;
+    }
+}
+
+static int sgr_adjacent(const char *data, size_t length) {
+    const char *end = data + length;
+    const char *p = data;
+    while ((p = memchr(p, '\x1b', (size_t)(end - p))) != NULL) {
+        if (p > data && p[-1] == 'm' && p + 1 < end && p[1] == '[') return 1;
+        p++;
+    }
+    return 0;
+}
+
+static void sgr_coalesce(const char *data, size_t length, StrBuf *out) {
+    SgrRun run;
+    run.count = 0;
+    run.params = 0;
+    size_t at = 0;
+    while (at < length) {
+        size_t end;
+        if (sgr_sequence(data, length, at, &end)) {
+            sgr_parse(out, &run, data + at + 2, end - at - 3);
+            at = end;
+            continue;
+        }
+        sgr_emit(out, &run);
+        const char *next = memchr(data + at + 1, '\x1b', length - at - 1);
+        size_t stop = next ? (size_t)(next - data) : length;
+        sb_putn(out, data + at, stop - at);
+        at = stop;
+    }
+    sgr_emit(out, &run);
+}
+
+static size_t file_write(FILE *file, const char *data, size_t length) {
+    if (!sgr_adjacent(data, length) || !_isatty(_fileno(file)))
+        return _fwrite_nolock(data, 1, length, file);
+
+    if (!out_coalesced.data) sb_init(&out_coalesced);
+    sb_clear(&out_coalesced);
+    sgr_coalesce(data, length, &out_coalesced);
+    size_t written = _fwrite_nolock(out_coalesced.data, 1, out_coalesced.len, file);
+    return written == out_coalesced.len ? length : written;
+}
+
+size_t out_write(const char *data, size_t length) {
+    Sink *sink = out_top;
+    if (!sink || !sink->buffer) return file_write(sink ? sink->file : stdout, data, length);
+    sb_putn(sink->buffer, data, length);
+    out_drained(sink);
+    return length;
+}
+
+void out_putc(char c) {
+    Sink *sink = out_top;
+    if (!sink || !sink->buffer) _fputc_nolock(c, sink ? sink->file : stdout);
+    else out_write(&c, 1);
+}
+
+void out_puts(const char *s) {
+    out_write(s, strlen(s));
+}
+
+int out_printf(const char *fmt, ...) {
+    Sink *sink = out_top;
+    va_list ap;
+    va_start(ap, fmt);
+    StrBuf *target = sink && sink->buffer ? sink->buffer : &out_formatted;
+    if (!target->data) sb_init(target);
+    if (target == &out_formatted) sb_clear(target);
+
+    va_list copy;
+    va_copy(copy, ap);
+    int n = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (n >= 0) {
+        sb_reserve(target, (size_t)n);
+        vsnprintf(target->data + target->len, (size_t)n + 1, fmt, ap);
+        target->len += (size_t)n;
+        if (target != &out_formatted) out_drained(sink);
+        else file_write(sink ? sink->file : stdout, target->data, (size_t)n);
+    }
+    va_end(ap);
+    return n;
+}
+
+int out_flush(void) {
+    if (out_is_buffered()) return 0;
+    return fflush(out_top ? out_top->file : stdout);
+}
+
 int read_line(FILE *f, StrBuf *out) {
     sb_clear(out);
     if (!f) return 0;
@@ -212,10 +425,129 @@ int read_line(FILE *f, StrBuf *out) {
 
 #ifndef _WIN32
 #define _read read
+#define _lseeki64 lseek
 #endif
 
+typedef struct {
+    unsigned long long file;
+    unsigned long long size;
+    unsigned long long stamp;
+} FdIdentity;
+
+static struct {
+    FdIdentity identity;
+    long long offset;
+    size_t pos;
+    size_t len;
+    char data[65536];
+} fd_buffer;
+
+void read_buffer_reset(void) {
+    memset(&fd_buffer.identity, 0, sizeof(fd_buffer.identity));
+    fd_buffer.offset = 0;
+    fd_buffer.pos = fd_buffer.len = 0;
+}
+
+#ifdef _WIN32
+static int fd_identity(int fd, FdIdentity *out) {
+    intptr_t handle = _get_osfhandle(fd);
+    BY_HANDLE_FILE_INFORMATION info;
+    if (handle == -1 || GetFileType((HANDLE)handle) != FILE_TYPE_DISK ||
+        !GetFileInformationByHandle((HANDLE)handle, &info))
+        return 0;
+    out->file = ((unsigned long long)info.dwVolumeSerialNumber << 48) ^
+                ((unsigned long long)info.nFileIndexHigh << 32) ^ info.nFileIndexLow;
+    out->size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    out->stamp = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) |
+                 info.ftLastWriteTime.dwLowDateTime;
+    return 1;
+}
+#else
+static int fd_identity(int fd, FdIdentity *out) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return 0;
+    out->file = ((unsigned long long)info.st_dev << 48) ^ (unsigned long long)info.st_ino;
+    out->size = (unsigned long long)info.st_size;
+    out->stamp = (unsigned long long)info.st_mtime;
+    return 1;
+}
+#endif
+
+static int fd_buffer_attach(int fd) {
+    FdIdentity identity;
+    if (!fd_identity(fd, &identity)) {
+        read_buffer_reset();
+        return 0;
+    }
+
+    long long position = _lseeki64(fd, 0, SEEK_CUR);
+    if (memcmp(&fd_buffer.identity, &identity, sizeof(identity)) == 0 &&
+        position == fd_buffer.offset + (long long)fd_buffer.pos)
+        return 1;
+
+    read_buffer_reset();
+    if (position < 0) return 0;
+    fd_buffer.identity = identity;
+    fd_buffer.offset = position;
+    return 1;
+}
+
+static int fd_buffer_fill(int fd) {
+    fd_buffer.offset += (long long)fd_buffer.len;
+    fd_buffer.pos = fd_buffer.len = 0;
+    int n = _read(fd, fd_buffer.data, sizeof(fd_buffer.data));
+    if (n <= 0) return 0;
+    fd_buffer.len = (size_t)n;
+    return 1;
+}
+
+static int read_line_buffered(int fd, StrBuf *out) {
+    int any = 0;
+    int ended = 0;
+
+    while (fd_buffer.pos < fd_buffer.len || fd_buffer_fill(fd)) {
+        const char *start = fd_buffer.data + fd_buffer.pos;
+        size_t available = fd_buffer.len - fd_buffer.pos;
+        const char *newline = memchr(start, '\n', available);
+        size_t take = newline ? (size_t)(newline - start) : available;
+
+        sb_putn(out, start, take);
+        fd_buffer.pos += take;
+        any = 1;
+        if (newline) {
+            fd_buffer.pos++;
+            ended = 1;
+            break;
+        }
+    }
+    _lseeki64(fd, fd_buffer.offset + (long long)fd_buffer.pos, SEEK_SET);
+
+    if (ended) {
+        if (out->len && out->data[out->len - 1] == '\r') {
+            out->len--;
+            out->data[out->len] = '\0';
+        }
+        return 1;
+    }
+    return any ? 2 : 0;
+}
+
+int read_all_fd(int fd, StrBuf *out) {
+    int any = 0;
+    read_buffer_reset();
+
+    char block[65536];
+    int n;
+    while ((n = _read(fd, block, sizeof(block))) > 0) {
+        sb_putn(out, block, (size_t)n);
+        any = 1;
+    }
+    return any;
+}
+
 int read_line_fd(int fd, StrBuf *out) {
     sb_clear(out);
+    if (fd_buffer_attach(fd)) return read_line_buffered(fd, out);
 
     char c;
     int any = 0;
@@ -251,6 +583,15 @@ void sl_free(StrList *l) {
     MARK_DEAD(l);
 }
 
+void sl_free_borrowed(StrList *l) {
+    ASSERT_UNBORROWED(l, "a list");
+    free(l->items);
+    l->items = NULL;
+    l->len = 0;
+    l->cap = 0;
+    MARK_DEAD(l);
+}
+
 void sl_clear(StrList *l) {
     ASSERT_UNBORROWED(l, "a list");
     for (size_t i = 0; i < l->len; i++) free(l->items[i]);
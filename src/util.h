@@ -59,11 +59,36 @@ void sb_puts(StrBuf *sb, const char *s);
 void sb_printf(StrBuf *sb, const char *fmt, ...);
 char *sb_take(StrBuf *sb);
 
+typedef struct Sink {
+    FILE *file;
+    StrBuf *buffer;
+    size_t limit;
+    void (*drain)(struct Sink *sink);
+    void *context;
+    struct Sink *outer;
+} Sink;
+
+void sink_file(Sink *sink, FILE *file);
+void sink_buffer(Sink *sink, StrBuf *buffer);
+void out_init(void);
+void out_push(Sink *sink);
+void out_pop(Sink *sink);
+int out_is_buffered(void);
+int out_is_terminal(void);
+size_t out_write(const char *data, size_t length);
+void out_putc(char c);
+void out_puts(const char *s);
+int out_printf(const char *fmt, ...);
+int out_flush(void);
+
 int read_line(FILE *f, StrBuf *out);
 int read_line_fd(int fd, StrBuf *out);
+int read_all_fd(int fd, StrBuf *out);
+void read_buffer_reset(void);
 
 void sl_init(StrList *l);
 void sl_free(StrList *l);
+void sl_free_borrowed(StrList *l);
 void sl_clear(StrList *l);
 void sl_push(StrList *l, char *s);
 void sl_push_copy(StrList *l, const char *s);
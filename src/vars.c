@@ -7,25 +7,39 @@
 #include "vars.h"
 
 #include "exec.h"
+#include "expand.h"
 #include "shell.h"
 #include "table.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <windows.h>
 
+typedef struct {
+    char *key;
+    long index;
+    char *value;
+} Element;
+
 typedef struct {
     char *name;
     char *value;
-    StrList keys;
-    StrList values;
+    size_t length;
+    size_t room;
+    Element *elements;
+    size_t count;
+    size_t cap;
+    size_t holes;
+    Table lookup;
     VarKind kind;
     int exported;
     int integer;
     int readonly;
     int nameref;
+    int stale;
     int used;
 } Entry;
 
@@ -57,6 +71,31 @@ static size_t *free_slots = NULL;
 static size_t free_count = 0;
 static size_t free_cap = 0;
 
+static size_t stale_exports = 0;
+static int env_changed = 1;
+static char *env_block = NULL;
+static Table env_table;
+static int env_loaded = 0;
+
+static void apply_export(const char *name, const char *value);
+
+static void mark_stale(Entry *e) {
+    env_changed = 1;
+    if (e->exported && (str_ieq(e->name, "HOME") || str_ieq(e->name, "USERPROFILE"))) {
+        apply_export(e->name, e->value ? e->value : "");
+        return;
+    }
+    if (e->stale) return;
+    e->stale = 1;
+    stale_exports++;
+}
+
+static void touch(const char *name);
+
+static void env_note(const Entry *e) {
+    if (e->exported || (env_loaded && table_get(&env_table, e->name))) env_changed = 1;
+}
+
 static void index_ready(void) {
     if (!var_index.buckets) table_init(&var_index, 128, 0, NULL);
 }
@@ -84,18 +123,29 @@ static Entry *find(const char *name) {
     return slot ? &vars[slot - 1] : NULL;
 }
 
+static void elements_clear(Entry *e) {
+    for (size_t i = 0; i < e->count; i++) {
+        free(e->elements[i].key);
+        free(e->elements[i].value);
+    }
+    e->count = 0;
+    e->holes = 0;
+    table_free(&e->lookup);
+}
+
 static void entry_reset(Entry *e) {
     free(e->value);
     e->value = NULL;
-    sl_clear(&e->keys);
-    sl_clear(&e->values);
+    e->length = 0;
+    e->room = 0;
+    elements_clear(e);
 }
 
 static void entry_free(Entry *e) {
     free(e->name);
     free(e->value);
-    sl_free(&e->keys);
-    sl_free(&e->values);
+    elements_clear(e);
+    free(e->elements);
 }
 
 static Entry *add(const char *name) {
@@ -117,10 +167,9 @@ static Entry *add(const char *name) {
     e->name = xstrdup(name);
     e->kind = VAR_SCALAR;
     e->used = 1;
-    sl_init(&e->keys);
-    sl_init(&e->values);
 
     table_put(&var_index, name, (void *)(slot + 1));
+    env_note(e);
     return e;
 }
 
@@ -128,6 +177,7 @@ static void release_slot(Entry *e) {
     size_t slot = (size_t)(e - vars);
     table_remove(&var_index, e->name);
     e->used = 0;
+    env_note(e);
 
     if (free_count + 1 >= free_cap) {
         free_cap = free_cap ? free_cap * 2 : 16;
@@ -142,9 +192,6 @@ static void remove_entry(Entry *e) {
     memset(e, 0, sizeof(Entry));
 }
 
-static Table env_table;
-static int env_loaded = 0;
-
 static void env_ready(void) {
     if (env_loaded) return;
     env_loaded = 1;
@@ -200,6 +247,10 @@ void vars_cleanup(void) {
 
     table_free(&env_table);
     env_loaded = 0;
+    free(env_block);
+    env_block = NULL;
+    env_changed = 1;
+    stale_exports = 0;
 
     table_free(&alias_table);
 
@@ -246,6 +297,7 @@ static const char *dynamic_value(const char *name) {
 }
 
 void var_mark_nameref(const char *name) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     e->nameref = 1;
@@ -264,8 +316,12 @@ const char *var_get(const char *name) {
 
     Entry *e = find(name);
     if (e) {
-        if (e->kind != VAR_SCALAR) return e->values.len > 0 ? e->values.items[0] : "";
-        return e->value ? e->value : "";
+        if (e->kind == VAR_SCALAR) return e->value ? e->value : "";
+        const char *first = NULL;
+        if (e->kind == VAR_INDEXED) first = var_get_element(name, "0");
+        for (size_t i = 0; !first && e->kind == VAR_ASSOC && i < e->count; i++)
+            first = e->elements[i].value;
+        return first ? first : "";
     }
     const char *generated = dynamic_value(name);
     if (generated) return generated;
@@ -280,6 +336,7 @@ int var_exists(const char *name) {
 }
 
 void var_set(const char *name, const char *value) {
+    touch(name);
     name = follow_nameref(name, 0);
 
     Entry *existing = find(name);
@@ -296,20 +353,22 @@ void var_set(const char *name, const char *value) {
     entry_reset(e);
     e->kind = VAR_SCALAR;
     e->value = xstrdup(value ? value : "");
-    if (e->exported) apply_export(name, e->value);
+    if (e->exported) mark_stale(e);
 }
 
 void var_set_exported(const char *name, const char *value) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     entry_reset(e);
     e->kind = VAR_SCALAR;
     e->value = xstrdup(value ? value : "");
     e->exported = 1;
-    apply_export(name, e->value);
+    mark_stale(e);
 }
 
 void var_export(const char *name) {
+    touch(name);
     Entry *e = find(name);
     if (!e) {
         const char *env = env_value(name);
@@ -317,7 +376,7 @@ void var_export(const char *name) {
         e->value = xstrdup(env ? env : "");
     }
     e->exported = 1;
-    apply_export(name, e->value ? e->value : "");
+    mark_stale(e);
 }
 
 int var_is_exported(const char *name) {
@@ -327,6 +386,7 @@ int var_is_exported(const char *name) {
 }
 
 void var_unset(const char *name) {
+    touch(name);
     Entry *e = find(name);
     if (e) {
         int was_exported = e->exported;
@@ -334,13 +394,16 @@ void var_unset(const char *name) {
         if (was_exported) apply_export(name, NULL);
     } else if (env_value(name)) {
         apply_export(name, NULL);
+        env_changed = 1;
     }
 }
 
 void var_declare(const char *name, VarKind kind) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     if (e->kind != kind) {
+        if (e->exported) env_changed = 1;
         entry_reset(e);
         e->kind = kind;
     }
@@ -351,7 +414,100 @@ VarKind var_kind(const char *name) {
     return e ? e->kind : VAR_SCALAR;
 }
 
+static Element *element_push(Entry *e) {
+    if (e->count + 1 >= e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 8;
+        e->elements = xrealloc(e->elements, e->cap * sizeof(Element));
+    }
+    Element *element = &e->elements[e->count++];
+    memset(element, 0, sizeof(Element));
+    return element;
+}
+
+static long next_index(const Entry *e) {
+    return e->count ? e->elements[e->count - 1].index + 1 : 0;
+}
+
+static int subscript(const char *name, const char *index, long *out) {
+    char *end;
+    long number = strtol(index, &end, 10);
+    if (end == index || *end) {
+        int ok = 1;
+        number = eval_arith(index, &ok);
+        if (!ok) return 0;
+    }
+    if (number < 0) {
+        Entry *e = find(name);
+        if (e && e->kind == VAR_INDEXED) number += next_index(e);
+    }
+    *out = number;
+    return number >= 0;
+}
+
+static size_t indexed_search(const Entry *e, long index) {
+    if ((size_t)index < e->count && e->elements[index].index == index) return (size_t)index;
+    size_t low = 0;
+    size_t high = e->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (e->elements[middle].index < index) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+static void assoc_compact(Entry *e) {
+    size_t kept = 0;
+    for (size_t i = 0; i < e->count; i++) {
+        if (e->elements[i].key) e->elements[kept++] = e->elements[i];
+    }
+    e->count = kept;
+    e->holes = 0;
+    table_free(&e->lookup);
+    table_init(&e->lookup, e->count, 0, NULL);
+    for (size_t i = 0; i < e->count; i++)
+        table_put(&e->lookup, e->elements[i].key, (void *)(i + 1));
+}
+
+static Element *assoc_find(Entry *e, const char *key, int create) {
+    size_t slot = e->lookup.buckets ? (size_t)table_get(&e->lookup, key) : 0;
+    if (slot || !create) return slot ? &e->elements[slot - 1] : NULL;
+    if (!e->lookup.buckets) table_init(&e->lookup, 16, 0, NULL);
+    Element *element = element_push(e);
+    element->key = xstrdup(key);
+    table_put(&e->lookup, key, (void *)e->count);
+    return element;
+}
+
+static Element *indexed_find(Entry *e, long index, int create) {
+    size_t position = indexed_search(e, index);
+    if (position < e->count && e->elements[position].index == index) return &e->elements[position];
+    if (!create) return NULL;
+
+    element_push(e);
+    memmove(e->elements + position + 1, e->elements + position,
+            (e->count - 1 - position) * sizeof(Element));
+    Element *element = &e->elements[position];
+    memset(element, 0, sizeof(Element));
+    element->index = index;
+    return element;
+}
+
+static Element *element_lookup(const char *name, const char *index, Entry **owner) {
+    Entry *e = find(name);
+    if (!e || e->kind == VAR_SCALAR) return NULL;
+    if (e->kind == VAR_ASSOC) {
+        *owner = e;
+        return assoc_find(e, index, 0);
+    }
+    long number;
+    if (!subscript(name, index, &number)) return NULL;
+    *owner = e = find(name);
+    return e && e->kind == VAR_INDEXED ? indexed_find(e, number, 0) : NULL;
+}
+
 void var_set_array(const char *name, const StrList *values, VarKind kind) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     entry_reset(e);
@@ -359,34 +515,28 @@ void var_set_array(const char *name, const StrList *values, VarKind kind) {
 
     for (size_t i = 0; i < values->len; i++) {
         if (kind == VAR_ASSOC && i + 1 < values->len) {
-            sl_push_copy(&e->keys, values->items[i]);
-            sl_push_copy(&e->values, values->items[i + 1]);
+            Element *element = assoc_find(e, values->items[i], 1);
+            free(element->value);
+            element->value = xstrdup(values->items[i + 1]);
             i++;
             continue;
         }
-        char index[32];
-        snprintf(index, sizeof(index), "%zu", e->values.len);
-        sl_push_copy(&e->keys, index);
-        sl_push_copy(&e->values, values->items[i]);
-    }
-}
-
-static int index_position(Entry *e, const char *index) {
-    char resolved[24];
-    if (index[0] == '-' && e->kind == VAR_INDEXED) {
-        int n = (int)e->values.len + atoi(index);
-        if (n < 0) return -1;
-        snprintf(resolved, sizeof(resolved), "%d", n);
-        index = resolved;
-    }
-    for (size_t i = 0; i < e->keys.len; i++) {
-        if (strcmp(e->keys.items[i], index) == 0) return (int)i;
+        if (kind == VAR_ASSOC) break;
+        Element *element = element_push(e);
+        element->index = (long)(e->count - 1);
+        element->value = xstrdup(values->items[i]);
     }
-    return -1;
 }
 
 void var_set_element(const char *name, const char *index, const char *value) {
+    touch(name);
     Entry *e = find(name);
+    long number = 0;
+    if (!(e && e->kind == VAR_ASSOC) && !subscript(name, index, &number)) {
+        shell_error("%s[%s]: bad array subscript", name, index);
+        return;
+    }
+    e = find(name);
     if (!e) {
         e = add(name);
         e->kind = VAR_INDEXED;
@@ -394,44 +544,40 @@ void var_set_element(const char *name, const char *index, const char *value) {
     if (e->kind == VAR_SCALAR) {
         char *previous = e->value;
         e->value = NULL;
+        e->room = 0;
         e->kind = VAR_INDEXED;
-        if (previous && *previous) {
-            sl_push_copy(&e->keys, "0");
-            sl_push(&e->values, previous);
-        } else {
-            free(previous);
-        }
+        if (previous && *previous) element_push(e)->value = previous;
+        else free(previous);
     }
 
-    int position = index_position(e, index);
-    if (position >= 0) {
-        free(e->values.items[position]);
-        e->values.items[position] = xstrdup(value);
-        return;
-    }
-    sl_push_copy(&e->keys, index);
-    sl_push_copy(&e->values, value);
+    Element *element = e->kind == VAR_ASSOC ? assoc_find(e, index, 1) : indexed_find(e, number, 1);
+    free(element->value);
+    element->value = xstrdup(value);
 }
 
 int var_unset_element(const char *name, const char *index) {
-    Entry *e = find(name);
-    if (!e || e->kind == VAR_SCALAR) return 0;
-
-    int position = index_position(e, index);
-    if (position < 0) return 0;
-
-    free(e->keys.items[position]);
-    free(e->values.items[position]);
-    memmove(e->keys.items + position, e->keys.items + position + 1,
-            (e->keys.len - (size_t)position - 1) * sizeof(char *));
-    memmove(e->values.items + position, e->values.items + position + 1,
-            (e->values.len - (size_t)position - 1) * sizeof(char *));
-    e->keys.len--;
-    e->values.len--;
+    touch(name);
+    Entry *e = NULL;
+    Element *element = element_lookup(name, index, &e);
+    if (!element) return 0;
+
+    free(element->value);
+    if (e->kind == VAR_ASSOC) {
+        table_remove(&e->lookup, element->key);
+        free(element->key);
+        element->key = NULL;
+        element->value = NULL;
+        if (++e->holes * 2 > e->count) assoc_compact(e);
+        return 1;
+    }
+    size_t position = (size_t)(element - e->elements);
+    memmove(element, element + 1, (e->count - position - 1) * sizeof(Element));
+    e->count--;
     return 1;
 }
 
 void var_mark_readonly(const char *name) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     e->readonly = 1;
@@ -453,6 +599,7 @@ void vars_exported_names(StrList *out) {
 }
 
 void var_mark_integer(const char *name) {
+    touch(name);
     Entry *e = find(name);
     if (!e) e = add(name);
     e->integer = 1;
@@ -468,8 +615,8 @@ const char *var_get_element(const char *name, const char *index) {
     if (!e) return NULL;
     if (e->kind == VAR_SCALAR) return strcmp(index, "0") == 0 ? e->value : NULL;
 
-    int position = index_position(e, index);
-    return position >= 0 ? e->values.items[position] : NULL;
+    Element *element = element_lookup(name, index, &e);
+    return element ? element->value : NULL;
 }
 
 void var_values(const char *name, StrList *out) {
@@ -483,7 +630,8 @@ void var_values(const char *name, StrList *out) {
         if (e->value) sl_push_copy(out, e->value);
         return;
     }
-    for (size_t i = 0; i < e->values.len; i++) sl_push_copy(out, e->values.items[i]);
+    for (size_t i = 0; i < e->count; i++)
+        if (e->elements[i].value) sl_push_copy(out, e->elements[i].value);
 }
 
 void var_keys(const char *name, StrList *out) {
@@ -493,18 +641,43 @@ void var_keys(const char *name, StrList *out) {
         if (e->value) sl_push_copy(out, "0");
         return;
     }
-    for (size_t i = 0; i < e->keys.len; i++) sl_push_copy(out, e->keys.items[i]);
+    for (size_t i = 0; i < e->count; i++) {
+        if (e->kind == VAR_ASSOC) {
+            if (e->elements[i].key) sl_push_copy(out, e->elements[i].key);
+            continue;
+        }
+        char index[32];
+        snprintf(index, sizeof(index), "%ld", e->elements[i].index);
+        sl_push_copy(out, index);
+    }
 }
 
 int var_count(const char *name) {
     Entry *e = find(name);
     if (!e) return env_value(name) ? 1 : 0;
     if (e->kind == VAR_SCALAR) return e->value && *e->value ? 1 : 0;
-    return (int)e->values.len;
+    return (int)(e->count - e->holes);
 }
 
 void var_append(const char *name, const char *value) {
+    touch(name);
+    name = follow_nameref(name, 0);
     Entry *e = find(name);
+    if (e && e->kind == VAR_SCALAR && e->value && !e->readonly && !e->nameref) {
+        size_t extra = strlen(value);
+        if (!e->room) {
+            e->length = strlen(e->value);
+            e->room = e->length + 1;
+        }
+        if (e->length + extra + 1 > e->room) {
+            e->room = (e->length + extra + 1) * 2;
+            e->value = xrealloc(e->value, e->room);
+        }
+        memcpy(e->value + e->length, value, extra + 1);
+        e->length += extra;
+        if (e->exported) mark_stale(e);
+        return;
+    }
     if (!e || e->kind == VAR_SCALAR) {
         const char *current = var_get(name);
         StrBuf sb;
@@ -515,10 +688,97 @@ void var_append(const char *name, const char *value) {
         sb_free(&sb);
         return;
     }
-    char index[32];
-    snprintf(index, sizeof(index), "%zu", e->values.len);
-    sl_push_copy(&e->keys, index);
-    sl_push_copy(&e->values, value);
+    if (e->kind == VAR_ASSOC) return;
+    long index = next_index(e);
+    Element *element = element_push(e);
+    element->index = index;
+    element->value = xstrdup(value);
+}
+
+void vars_sync_environment(void) {
+    if (!stale_exports) return;
+    for (size_t i = 0; i < var_count_total; i++) {
+        if (!vars[i].used || !vars[i].stale) continue;
+        vars[i].stale = 0;
+        if (vars[i].exported) apply_export(vars[i].name, vars[i].value ? vars[i].value : "");
+    }
+    stale_exports = 0;
+}
+
+static int pair_compare(const void *a, const void *b) {
+    const char *left = *(char *const *)a;
+    const char *right = *(char *const *)b;
+    size_t left_name = strcspn(left + 1, "=") + 1;
+    size_t right_name = strcspn(right + 1, "=") + 1;
+    int order = _strnicmp(left, right, left_name < right_name ? left_name : right_name);
+    if (order) return order;
+    return (left_name > right_name) - (left_name < right_name);
+}
+
+char *vars_environment(void) {
+    if (env_block && !env_changed) return env_block;
+    env_ready();
+
+    StrList pairs;
+    sl_init(&pairs);
+    char *block = GetEnvironmentStringsA();
+    for (char *entry = block; entry && *entry; entry += strlen(entry) + 1) {
+        if (entry[0] == '=') sl_push_copy(&pairs, entry);
+    }
+    if (block) FreeEnvironmentStringsA(block);
+
+    Table known;
+    table_init(&known, 64, 1, NULL);
+    for (size_t i = 0; i < var_count_total; i++) {
+        if (vars[i].used && vars[i].exported && vars[i].kind == VAR_SCALAR)
+            table_put(&known, vars[i].name, &vars[i]);
+    }
+
+    StrList names;
+    sl_init(&names);
+    table_names(&env_table, &names);
+    for (size_t i = 0; i < names.len; i++) {
+        if (table_get(&known, names.items[i])) continue;
+        StrBuf sb;
+        sb_init(&sb);
+        sb_printf(&sb, "%s=%s", names.items[i], (const char *)table_get(&env_table, names.items[i]));
+        sl_push(&pairs, sb_take(&sb));
+    }
+    sl_free(&names);
+
+    for (size_t i = 0; i < var_count_total; i++) {
+        if (!vars[i].used || !vars[i].exported || vars[i].kind != VAR_SCALAR) continue;
+        if (table_get(&known, vars[i].name) != &vars[i]) continue;
+        StrBuf sb;
+        sb_init(&sb);
+        sb_printf(&sb, "%s=%s", vars[i].name, vars[i].value ? vars[i].value : "");
+        sl_push(&pairs, sb_take(&sb));
+    }
+    table_free(&known);
+    qsort(pairs.items, pairs.len, sizeof(char *), pair_compare);
+
+    StrBuf sb;
+    sb_init(&sb);
+    for (size_t i = 0; i < pairs.len; i++) {
+        sb_puts(&sb, pairs.items[i]);
+        sb_putc(&sb, '\0');
+    }
+    sb_putc(&sb, '\0');
+    sl_free(&pairs);
+
+    free(env_block);
+    env_block = sb_take(&sb);
+    env_changed = 0;
+    return env_block;
+}
+
+char *vars_environment_copy(void) {
+    const char *block = vars_environment();
+    size_t length = 0;
+    while (block[length] || block[length + 1]) length++;
+    char *copy = xmalloc(length + 2);
+    memcpy(copy, block, length + 2);
+    return copy;
 }
 
 void vars_list(StrList *out) {
@@ -530,10 +790,14 @@ void vars_list(StrList *out) {
             sb_printf(&sb, "%s=%s", vars[i].name, vars[i].value ? vars[i].value : "");
         } else {
             sb_printf(&sb, "%s=(", vars[i].name);
-            for (size_t v = 0; v < vars[i].values.len; v++) {
-                if (v > 0) sb_putc(&sb, ' ');
-                if (vars[i].kind == VAR_ASSOC) sb_printf(&sb, "[%s]=", vars[i].keys.items[v]);
-                sb_puts(&sb, vars[i].values.items[v]);
+            int first = 1;
+            for (size_t v = 0; v < vars[i].count; v++) {
+                const Element *element = &vars[i].elements[v];
+                if (!element->value) continue;
+                if (!first) sb_putc(&sb, ' ');
+                first = 0;
+                if (vars[i].kind == VAR_ASSOC) sb_printf(&sb, "[%s]=", element->key);
+                sb_puts(&sb, element->value);
             }
             sb_putc(&sb, ')');
         }
@@ -552,11 +816,19 @@ void vars_list(StrList *out) {
     sl_sort(out);
 }
 
-typedef struct {
+typedef struct Snapshot {
     Entry *entries;
     size_t count;
+    int full;
+    Saved *touched;
+    size_t touched_len;
+    size_t touched_cap;
+    size_t scope_depth;
+    struct Snapshot *outer;
 } Snapshot;
 
+static Snapshot *snapshots = NULL;
+
 static Entry entry_copy(const Entry *src) {
     Entry e;
     memset(&e, 0, sizeof(e));
@@ -565,35 +837,109 @@ static Entry entry_copy(const Entry *src) {
     e.kind = src->kind;
     e.exported = src->exported;
     e.integer = src->integer;
+    e.readonly = src->readonly;
+    e.nameref = src->nameref;
     e.used = 1;
-    sl_init(&e.keys);
-    sl_init(&e.values);
-    for (size_t i = 0; i < src->keys.len; i++) sl_push_copy(&e.keys, src->keys.items[i]);
-    for (size_t i = 0; i < src->values.len; i++) sl_push_copy(&e.values, src->values.items[i]);
+    for (size_t i = 0; i < src->count; i++) {
+        if (!src->elements[i].value) continue;
+        Element *element = element_push(&e);
+        element->key = src->elements[i].key ? xstrdup(src->elements[i].key) : NULL;
+        element->index = src->elements[i].index;
+        element->value = xstrdup(src->elements[i].value);
+    }
+    if (e.kind == VAR_ASSOC) assoc_compact(&e);
     return e;
 }
 
-void *vars_snapshot(void) {
-    Snapshot *snap = xmalloc(sizeof(Snapshot));
-    snap->count = 0;
+static void snapshot_full(Snapshot *snap) {
+    snap->full = 1;
     snap->entries = var_count_total ? xmalloc(var_count_total * sizeof(Entry)) : NULL;
     for (size_t i = 0; i < var_count_total; i++) {
         if (vars[i].used) snap->entries[snap->count++] = entry_copy(&vars[i]);
     }
+}
+
+static void snapshot_note(Snapshot *snap, const char *name) {
+    for (size_t i = 0; i < snap->touched_len; i++) {
+        if (strcmp(snap->touched[i].name, name) == 0) return;
+    }
+    if (snap->touched_len == 32) {
+        snapshot_full(snap);
+        return;
+    }
+    if (snap->touched_len + 1 >= snap->touched_cap) {
+        snap->touched_cap = snap->touched_cap ? snap->touched_cap * 2 : 8;
+        snap->touched = xrealloc(snap->touched, snap->touched_cap * sizeof(Saved));
+    }
+
+    Saved *saved = &snap->touched[snap->touched_len++];
+    saved->name = xstrdup(name);
+    Entry *current = find(name);
+    saved->existed = current != NULL;
+    if (current) saved->saved = entry_copy(current);
+    else memset(&saved->saved, 0, sizeof(Entry));
+}
+
+static void watch_path(const char *name) {
+    if (name[0] == 'P' && (strcmp(name, "PATH") == 0 || strcmp(name, "PATHEXT") == 0))
+        path_rehash();
+}
+
+static void touch(const char *name) {
+    watch_path(name);
+    if (!snapshots) return;
+    const char *target = follow_nameref(name, 0);
+    for (Snapshot *snap = snapshots; snap; snap = snap->outer) {
+        if (snap->full) continue;
+        snapshot_note(snap, name);
+        if (!snap->full && target != name) snapshot_note(snap, target);
+    }
+}
+
+void *vars_snapshot(void) {
+    Snapshot *snap = xmalloc(sizeof(Snapshot));
+    memset(snap, 0, sizeof(Snapshot));
+    snap->scope_depth = scope_depth;
+    snap->outer = snapshots;
+    snapshots = snap;
     return snap;
 }
 
 void vars_restore(void *handle) {
     Snapshot *snap = handle;
-    for (size_t i = 0; i < var_count_total; i++) {
-        if (vars[i].used) entry_free(&vars[i]);
+    snapshots = snap->outer;
+
+    if (snap->full) {
+        for (size_t i = 0; i < var_count_total; i++) {
+            if (vars[i].used) entry_free(&vars[i]);
+        }
+        free(vars);
+        vars = snap->entries;
+        var_count_total = snap->count;
+        var_cap = snap->count;
+        index_rebuild();
+        env_changed = 1;
+        path_rehash();
     }
-    free(vars);
-    vars = snap->entries;
-    var_count_total = snap->count;
-    var_cap = snap->count;
+
+    for (size_t i = snap->touched_len; i > 0; i--) {
+        Saved *saved = &snap->touched[i - 1];
+        watch_path(saved->name);
+        Entry *current = find(saved->name);
+        if (current) remove_entry(current);
+
+        if (saved->existed) {
+            Entry *restored = add(saved->name);
+            free(restored->name);
+            *restored = saved->saved;
+            if (restored->exported) env_changed = 1;
+        } else {
+            entry_free(&saved->saved);
+        }
+        free(saved->name);
+    }
+    free(snap->touched);
     free(snap);
-    index_rebuild();
 }
 
 void scope_push(void) {
@@ -609,19 +955,22 @@ void scope_push(void) {
 
 void scope_pop(void) {
     if (scope_depth == 0) return;
+    for (Snapshot *snap = snapshots; snap; snap = snap->outer) {
+        if (!snap->full && scope_depth <= snap->scope_depth) snapshot_full(snap);
+    }
     Scope *scope = &scopes[--scope_depth];
 
     for (size_t i = scope->len; i > 0; i--) {
         Saved *saved = &scope->items[i - 1];
+        watch_path(saved->name);
         Entry *current = find(saved->name);
         if (current) remove_entry(current);
 
         if (saved->existed) {
             Entry *restored = add(saved->name);
             free(restored->name);
-            sl_free(&restored->keys);
-            sl_free(&restored->values);
             *restored = saved->saved;
+            if (restored->exported) env_changed = 1;
         } else {
             entry_free(&saved->saved);
         }
@@ -632,6 +981,7 @@ void scope_pop(void) {
 
 void var_make_local(const char *name) {
     if (scope_depth == 0) return;
+    touch(name);
     Scope *scope = &scopes[scope_depth - 1];
 
     for (size_t i = 0; i < scope->len; i++) {
@@ -654,8 +1004,6 @@ void var_make_local(const char *name) {
     } else {
         saved->existed = 0;
         memset(&saved->saved, 0, sizeof(Entry));
-        sl_init(&saved->saved.keys);
-        sl_init(&saved->saved.values);
     }
 
     Entry *fresh = add(name);
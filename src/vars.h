@@ -44,6 +44,9 @@ void var_values(const char *name, StrList *out);
 void var_keys(const char *name, StrList *out);
 int var_count(const char *name);
 void var_append(const char *name, const char *value);
+void vars_sync_environment(void);
+char *vars_environment(void);
+char *vars_environment_copy(void);
 
 void scope_push(void);
 void scope_pop(void);